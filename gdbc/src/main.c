@@ -5,6 +5,7 @@
 #define _GNU_SOURCE
 #include <assert.h>
 #include <ctype.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,11 +13,42 @@
 #include <webserver/utility.h>
 #include <webserver/json.h>
 #include <webserver/runner.h>
+#include <webserver/websocket.h>
 
 #include "service.h"
 
 static atomic_int source_code_count = 0;
 
+/**
+ * @brief Content-Type 및 CORS 헤더. 시작 시 한 번 직렬화되어 모든 API 응답이 공유한다.
+ */
+static struct http_header_set *api_headers;
+
+/**
+ * @brief `text/event-stream` 및 CORS 헤더. 프로그램 출력 이벤트 스트림이 공유한다.
+ */
+static struct http_header_set *event_stream_headers;
+
+/**
+ * @brief Allocate an API response, to which `api_headers` is attached.
+ * Callbacks set the rest of fields, and insert into `headers` only response-specific headers.
+ *
+ * @return Response allocated by `malloc`. NULL if allocation failed.
+ */
+static struct http_response *create_api_response(void) {
+    struct http_response *response = malloc(sizeof(struct http_response));
+    if (!response) {
+        return NULL;
+    }
+
+    *response = (struct http_response) {
+        .headers = (struct http_headers) {},
+        .http_version = HTTP_1_1,
+        .header_set = retain_http_header_set(api_headers)
+    };
+    return response;
+}
+
 /**
  * @brief Trim whitespace from the beginning and end of a string
  * @param str String to trim
@@ -55,6 +87,19 @@ static char *trim_string(const char *str) {
     return trimmed;
 }
 
+/**
+ * @brief Find a <string> value of `key` in `object`
+ * @return Value of `key`, or NULL if `object` is NULL, or `key` is missing or not a string (e.g. nested object)
+ */
+static char *find_json_string(const json_object_t *object, const char *key) {
+    if (!object)
+        return NULL;
+    struct json_element *element = find_json_element(object, key);
+    if (!element || element->value_type != JSON_STRING)
+        return NULL;
+    return element->value;
+}
+
 /**
  * @brief Common configuration for handling program execution requests
  */
@@ -78,36 +123,22 @@ struct run_handler_config {
 static struct http_response *validate_run_request(
     struct http_request request,
     struct run_handler_config *config) {
-    struct http_response *response = malloc(sizeof(struct http_response));
+    struct http_response *response = create_api_response();
     if (!response) {
         return NULL;
     }
 
-    struct http_headers headers = {
-        .capacity = 8,
-        .size = 0,
-        .items = malloc(8 * sizeof(struct http_header *))};
-
-    if (!headers.items) {
-        free(response);
-        return NULL;
-    }
+    struct http_headers headers = {};
 
     // 1. Content-Type 헤더 검증 - 대소문자 구분 없이 검사
-    struct http_header *content_type = NULL;
-    for (int i = 0; i < request.headers.size; i++) {
-        if (strcasecmp(request.headers.items[i]->key, "Content-Type") == 0) {
-            content_type = request.headers.items[i];
-            break;
-        }
-    }
+    struct http_header *content_type = find_http_request_header(&request, "Content-Type");
     
     if (!content_type || strcasecmp(content_type->value, "application/json") != 0) {        
         response->body = strdup("Content-Type must be application/json");
         goto validate_error;
     }
 
-    json_object_t *request_body = parse_json(request.body);
+    json_object_t *request_body = parse_json(get_http_request_body(&request));
 
     if (request_body == NULL) {
         DLOGV("informed `parse failed`\n");
@@ -117,7 +148,7 @@ static struct http_response *validate_run_request(
 
     // 2. language 파라미터 검증
     struct http_query_parameter *language =
-        find_query_parameter(&request.query_parameters, "language");
+        find_http_request_query_parameter(&request, "language");
     if (!language || !language->value || strlen(language->value) == 0) {
         response->body = strdup("Missing required query parameter: language");
         goto validate_error;
@@ -125,23 +156,27 @@ static struct http_response *validate_run_request(
 
     // 3. compiler_type 파라미터 검증
     struct http_query_parameter *compiler_type =
-        find_query_parameter(&request.query_parameters, "compiler_type");
+        find_http_request_query_parameter(&request, "compiler_type");
     if (!compiler_type || !compiler_type->value || strlen(compiler_type->value) == 0) {
         response->body = strdup("Missing required query parameter: compiler_type");
         goto validate_error;
     }
 
     // 4. 요청 본문 검증
-    if (!request.body || strlen(request.body) == 0) {        
+    if (get_http_request_body(&request)[0] == '\0') {        
         response->body = strdup("Missing request body");
         goto validate_error;
     }
 
     // 5. 선택적 파라미터 처리
-    struct json_element *compile_opt =
-        find_json_element(request_body, "compiler_options");
-    struct json_element *args =
-        find_json_element(request_body, "command_line_arguments");
+    const char *source_code = find_json_string(request_body, "source_code");
+    if (!source_code) {
+        response->body = strdup("Missing required field: source_code");
+        destruct_json_object(request_body);
+        goto validate_error;
+    }
+    const char *compile_opt = find_json_string(request_body, "compiler_options");
+    const char *args = find_json_string(request_body, "command_line_arguments");
 
 
     
@@ -149,13 +184,13 @@ static struct http_response *validate_run_request(
     // 구성 저장
     config->language = language->value;
     config->compiler_type = compiler_type->value;
-    config->source_code = find_json_element(request_body, "source_code")->value;
-    config->compile_options = compile_opt ? trim_string(compile_opt->value) : NULL;
-    config->command_line_args = args ? trim_string(args->value) : NULL;
+    config->source_code = source_code;
+    config->compile_options = compile_opt ? trim_string(compile_opt) : NULL;
+    config->command_line_args = args ? trim_string(args) : NULL;
     config->parsed_body = request_body;
 
     // 임시 응답 구조체 정리
-    destruct_http_headers(&headers);
+    release_http_header_set(response->header_set);
     free(response);
 
     return NULL;
@@ -174,27 +209,12 @@ static struct http_response *validate_run_request(
  * @return struct http_response* Response containing execution results or error
  */
 static struct http_response *execute_program(const struct run_handler_config *config) {
-    struct http_response *response = malloc(sizeof(struct http_response));
+    struct http_response *response = create_api_response();
     if (!response) {
         return NULL;
     }
 
-    struct http_headers headers = {
-        .capacity = 8,
-        .size = 0,
-        .items = malloc(8 * sizeof(struct http_header *))};
-
-    if (!headers.items) {
-        free(response);
-        return NULL;
-    }
-
-    // 응답 헤더 설정
-    insert_header(&headers, "Content-Type", "application/json");
-    insert_header(&headers, "Access-Control-Allow-Origin", "*");
-    insert_header(&headers, "Access-Control-Allow-Methods",
-                  "GET, POST, PUT, DELETE, OPTIONS");
-    insert_header(&headers, "Access-Control-Allow-Headers", "*");
+    struct http_headers headers = {};
 
     // 소스 파일 생성
     char source_code_file[32];
@@ -286,7 +306,7 @@ static struct http_response *execute_program(const struct run_handler_config *co
         return response;
     }
 
-    char *input_data = find_json_element(config->parsed_body, "stdin")->value;
+    char *input_data = find_json_string(config->parsed_body, "stdin");
     if (input_data) {
         int pass_input_res = pass_input_to_child(result, input_data);
         assert(pass_input_res != -2);
@@ -332,7 +352,7 @@ static struct http_response *handle_run_request(struct http_request request, int
     if (config.command_line_args)
         free((void *)config.command_line_args);
     if (config.parsed_body)
-        free((void *)config.parsed_body);
+        destruct_json_object((json_object_t *)config.parsed_body);
 
     return response;
 }
@@ -344,30 +364,16 @@ static struct http_response *stop_callback(struct http_request request) {
     DLOG("Enter '/stop' route\n");
 
     // 1. 응답 구조체 초기화
-    struct http_response *response = malloc(sizeof(struct http_response));
+    struct http_response *response = create_api_response();
 
     if (!response) {
         return NULL;
     }
 
-    struct http_headers response_headers = {
-        .capacity = 8,
-        .size = 0,
-        .items = malloc(8 * sizeof(struct http_header *))};
-
-    if (!response_headers.items) {
-        free(response);
-        return NULL;
-    }
-
-    // 응답 헤더 설정
-    insert_header(&response_headers, "Content-Type", "application/json");
-    insert_header(&response_headers, "Access-Control-Allow-Origin", "*");
-    insert_header(&response_headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-    insert_header(&response_headers, "Access-Control-Allow-Headers", "*");
+    struct http_headers response_headers = {};
 
     // 2. Content-Type 헤더 검증
-    struct http_header *content_type_header = find_header(&request.headers, "Content-Type");
+    struct http_header *content_type_header = find_http_request_header(&request, "Content-Type");
 
     if (!content_type_header || strcmp(content_type_header->value, "application/json") != 0) {
         response->status_code = HTTP_BAD_REQUEST;
@@ -379,7 +385,7 @@ static struct http_response *stop_callback(struct http_request request) {
     }
 
     // 3. 필수 쿼리 파라미터 'pid' 검증
-    struct http_query_parameter *pid_query_parameter = find_query_parameter(&request.query_parameters, "pid");
+    struct http_query_parameter *pid_query_parameter = find_http_request_query_parameter(&request, "pid");
 
     if (!pid_query_parameter || !pid_query_parameter->value || strlen(pid_query_parameter->value) == 0) {
         response->status_code = HTTP_BAD_REQUEST;
@@ -413,30 +419,16 @@ static struct http_response *input_callback(struct http_request request) {
     DLOG("Enter '/input' route\n");
 
     // 1. 응답 구조체 초기화
-    struct http_response *response = malloc(sizeof(struct http_response));
+    struct http_response *response = create_api_response();
 
     if (!response) {
         return NULL;
     }
 
-    struct http_headers response_headers = {
-        .capacity = 8,
-        .size = 0,
-        .items = malloc(8 * sizeof(struct http_header *))};
-
-    if (!response_headers.items) {
-        free(response);
-        return NULL;
-    }
-    
-    // 응답 헤더 설정
-    insert_header(&response_headers, "Content-Type", "application/json");
-    insert_header(&response_headers, "Access-Control-Allow-Origin", "*");
-    insert_header(&response_headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-    insert_header(&response_headers, "Access-Control-Allow-Headers", "*");
+    struct http_headers response_headers = {};
 
     // 2. Content-Type 헤더 검증
-    struct http_header *content_type_header = find_header(&request.headers, "Content-Type");
+    struct http_header *content_type_header = find_http_request_header(&request, "Content-Type");
 
     if (!content_type_header || strcmp(content_type_header->value, "application/json") != 0) {
         response->status_code = HTTP_BAD_REQUEST;
@@ -448,7 +440,7 @@ static struct http_response *input_callback(struct http_request request) {
     }
 
     // 3. 필수 쿼리 파라미터 'pid' 검증
-    struct http_query_parameter *pid_query_parameter = find_query_parameter(&request.query_parameters, "pid");
+    struct http_query_parameter *pid_query_parameter = find_http_request_query_parameter(&request, "pid");
     DLOG("%s\n", pid_query_parameter->value);
 
     if (!pid_query_parameter || !pid_query_parameter->value || strlen(pid_query_parameter->value) == 0) {
@@ -463,8 +455,12 @@ static struct http_response *input_callback(struct http_request request) {
     // 4. 로직
     int pid = atoi(pid_query_parameter->value);
 
-    json_object_t *body = parse_json(request.body);
-    pass_input_to_child(pid, find_json_element(body, "stdin")->value);
+    json_object_t *body = parse_json(get_http_request_body(&request));
+    char *input_data = find_json_string(body, "stdin");
+    if (input_data)
+        pass_input_to_child(pid, input_data);
+    if (body)
+        destruct_json_object(body);
 
     // 5. 성공 응답 생성
     char response_body[32];
@@ -480,37 +476,30 @@ static struct http_response *input_callback(struct http_request request) {
 
 /**
  * @test curl -X GET http://localhost:10010/program?pid=10
+ * @test curl -X GET http://localhost:10010/program/10
  */
 static struct http_response *program_callback(struct http_request request) {
     // DLOG("Enter '/program' route\n");
 
     // 1. 응답 구조체 초기화
-    struct http_response *response = malloc(sizeof(struct http_response));
+    struct http_response *response = create_api_response();
     if (!response) return NULL;
 
-    struct http_headers response_headers = {
-        .capacity = 8,
-        .size = 0,
-        .items = malloc(8 * sizeof(struct http_header *))
-    };
+    struct http_headers response_headers = {};
 
-    if (!response_headers.items) {
-        free(response);
-        return NULL;
-    }
+    // 2. 필수 파라미터 'pid' 검증 - `/program/:pid` 경로를 우선하고, 없으면 `?pid=` 쿼리 파라미터
+    // 폴링마다 호출되므로 경로 파라미터를 쓰면 쿼리 파싱을 하지 않는다
+    const char *pid_value = find_http_request_path_parameter(&request, "pid", NULL);
 
-    // 응답 헤더 설정
-    insert_header(&response_headers, "Content-Type", "application/json");
-    insert_header(&response_headers, "Access-Control-Allow-Origin", "*");
-    insert_header(&response_headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-    insert_header(&response_headers, "Access-Control-Allow-Headers", "*");
+    if (!pid_value) {
+        struct http_query_parameter *pid_query_parameter = 
+            find_http_request_query_parameter(&request, "pid");
 
-    // 2. 필수 쿼리 파라미터 'pid' 검증
-    struct http_query_parameter *pid_query_parameter = 
-        find_query_parameter(&request.query_parameters, "pid");
+        if (pid_query_parameter && pid_query_parameter->value && strlen(pid_query_parameter->value) > 0)
+            pid_value = pid_query_parameter->value;
+    }
     
-    if (!pid_query_parameter || !pid_query_parameter->value || 
-        strlen(pid_query_parameter->value) == 0) {
+    if (!pid_value) {
         response->status_code = HTTP_BAD_REQUEST;
         response->body = strdup("Missing required query parameter: pid");
         response->headers = response_headers;
@@ -518,55 +507,295 @@ static struct http_response *program_callback(struct http_request request) {
         return response;
     }
 
-    // 3. 로직
-    int pid = atoi(pid_query_parameter->value);
+    // 3. 로직 - 경로 파라미터는 '/' 또는 문자열 끝에서 끝나므로 atoi로 바로 읽는다
+    int pid = atoi(pid_value);
 
     // 4. 성공 응답 생성
     //char response_body[32];
     //snprintf(response_body, sizeof(response_body), "{\"pid\": %d}", pid);
-    char *output = get_output_from_child(pid);
-    if (output == 0) {
-        /* add empty string for client */
-        output = malloc(1);
-        output[0] = '\0';
-    } else if (output == (char *)-1) {
-        response->status_code = HTTP_NO_CONTENT;
-        response->body = NULL;
+    /* 파이프에서 스택 버퍼로 바로 읽는다. 스트림이 출력을 가져간 동안에는 읽지 않는다 */
+    struct child_output child_output;
+    char output[1024 * 14];
+    int result = open_output_of_child(pid, &child_output);
+    if (result != 0) {
+        response->status_code = result == -1 ? HTTP_CONFLICT : HTTP_BAD_REQUEST;
+        response->body = strdup(result == -1 ? "Output is being streamed" : "Invalid parameter: pid");
         response->headers = response_headers;
         response->http_version = HTTP_1_1;
         return response;
-    } else if (output == (char *)-2) {
-        response->status_code = HTTP_BAD_REQUEST;
-        response->body = strdup("Invalid parameter: pid");
+    }
+    ssize_t bytes_read = read_output_from_child(&child_output, output, sizeof(output), 0);
+    close_output_of_child(&child_output);
+
+    if (bytes_read == -1) {
+        response->status_code = HTTP_NO_CONTENT;
+        response->body = NULL;
         response->headers = response_headers;
         response->http_version = HTTP_1_1;
-        return response;        
+        return response;
     }
+    /* add empty string for client */
+    if (bytes_read < 0)
+        bytes_read = 0;
 
-    json_object_t response_json_body = (json_object_t) {
-        .capacity = 2,
-        .items = 0,
-        .items = malloc(2 * sizeof(sizeof(struct json_element *)))
-    };
-
-    char pid_str[16];
-    sprintf(pid_str, "%d", pid);
-    insert_json_element(&response_json_body, "pid", pid_str, JSON_NUMBER);
-    insert_json_element(&response_json_body, "output", output, JSON_STRING);
-    
-    char *response_body = json_object_stringify(&response_json_body);
-    int response_body_size = strlen(response_body) + 1;
-
-    free(output);
+    /* 출력은 JSON 으로 이스케이프되며 한 번 복사되고, 그 버퍼가 헤더 뒤에 복사 없이 전송된다 */
+    struct json_writer writer;
+    init_json_writer(&writer, NULL, NULL);
+    begin_json_object(&writer);
+    write_json_key(&writer, "pid");
+    write_json_integer(&writer, pid);
+    write_json_key(&writer, "output");
+    write_json_string(&writer, output, (size_t)bytes_read);
+    end_json_object(&writer);
 
     response->http_version = HTTP_1_1;
-    response->status_code = HTTP_OK;
-    response->body = response_body;
     response->headers = response_headers;
+    if (finish_json_writer(&writer) == -1) {
+        destruct_json_writer(&writer);
+        response->status_code = HTTP_INTERNAL_SERVER_ERROR;
+        response->body = NULL;
+        return response;
+    }
+    response->status_code = HTTP_OK;
+    response->body = writer.buffer;
+    response->body_length = writer.length;
 
     return response;
 }
 
+/**
+ * @brief 출력이 없을 때 연결 확인용 주석(SSE) 또는 ping(WebSocket)을 보내는 주기 (ms). 떠난 클라이언트는 이 때 발견된다.
+ */
+#define PROGRAM_EVENT_HEARTBEAT 15000
+
+/**
+ * @brief WebSocket 으로 받는 입력 메시지 하나의 최대 크기 (바이트). 더 큰 메시지는 1009 로 연결을 닫는다.
+ */
+#define PROGRAM_INPUT_MAX_SIZE (1024 * 1024)
+
+/**
+ * @brief Send `output` as one `message` event. Each line becomes a `data:` field, so the client receives `output` as it is
+ * (CR and CRLF are received as LF).
+ *
+ * @return 0 on success, -1 if the client has gone
+ */
+static int write_output_event(struct http_response_writer *writer, const char *output, size_t length) {
+    size_t line_start = 0;
+
+    for (size_t i = 0; i <= length; i++) {
+        if (i < length && output[i] != '\n' && output[i] != '\r')
+            continue;
+
+        if (write_http_chunk(writer, "data: ", 6) == -1
+                || write_http_chunk(writer, output + line_start, i - line_start) == -1
+                || write_http_chunk(writer, "\n", 1) == -1)
+            return -1;
+
+        if (i + 1 < length && output[i] == '\r' && output[i + 1] == '\n')
+            i++;
+        line_start = i + 1;
+    }
+
+    /* empty line dispatches the event, and it is sent right away */
+    if (write_http_chunk(writer, "\n", 1) == -1)
+        return -1;
+    return flush_http_chunks(writer);
+}
+
+/**
+ * @brief Push output of the process as server-sent events until it exits or the client leaves.
+ * Output is read as soon as the pipe becomes readable, and `exit` event is sent when the process is reclaimed.
+ *
+ * @param data output taken by `program_events_handler`, allocated by `malloc`. Released here.
+ */
+static void stream_program_output(struct http_response_writer *writer, void *data) {
+    static const char exit_event[] = "event: exit\ndata: \n\n";
+    static const char error_event[] = "event: error\ndata: Failed to read output\n\n";
+    static const char heartbeat[] = ": keep-alive\n\n";
+    struct child_output *child_output = (struct child_output *)data;
+    char output[4096];
+
+    /* failed writer (HEAD, or the client has gone) must not consume output of the process */
+    while (flush_http_chunks(writer) == 0) {
+        ssize_t bytes_read = read_output_from_child(child_output, output, sizeof(output), PROGRAM_EVENT_HEARTBEAT);
+
+        if (bytes_read == -1) {
+            write_http_chunk(writer, exit_event, sizeof(exit_event) - 1);
+            break;
+        }
+        if (bytes_read == -2) {
+            write_http_chunk(writer, error_event, sizeof(error_event) - 1);
+            break;
+        }
+        if (bytes_read == 0) {
+            write_http_chunk(writer, heartbeat, sizeof(heartbeat) - 1);
+            continue;
+        }
+        if (write_output_event(writer, output, (size_t)bytes_read) == -1)
+            break;
+    }
+
+    close_output_of_child(child_output);
+    free(child_output);
+}
+
+/**
+ * @brief `/program/:pid/events` 에 대한 핸들러. 폴링 대신 하나의 연결로 출력을 `text/event-stream` 으로 보낸다.
+ * @test curl -N http://localhost:10010/program/10/events
+ */
+static int program_events_handler(const struct http_request *request, struct http_response *response) {
+    const char *pid_value = find_http_request_path_parameter(request, "pid", NULL);
+    int pid = atoi(pid_value);
+    struct child_output *output = malloc(sizeof(struct child_output));
+
+    if (output == NULL)
+        return -1;
+
+    /* 출력을 읽는 쪽은 하나뿐이어야 프로세스가 한 번만 회수된다 */
+    int result = open_output_of_child(pid, output);
+    if (result != 0) {
+        free(output);
+        response->status_code = result == -1 ? HTTP_CONFLICT : HTTP_BAD_REQUEST;
+        response->header_set = retain_http_header_set(api_headers);
+        response->body = result == -1 ? "Output is being streamed" : "Invalid parameter: pid";
+        response->body_type = HTTP_BODY_BORROWED;
+        return 0;
+    }
+
+    response->header_set = retain_http_header_set(event_stream_headers);
+    response->stream = stream_program_output;
+    response->stream_data = output;
+    return 0;
+}
+
+/**
+ * @brief Relay one WebSocket in both directions to the process until it exits or the client leaves.
+ * Each text or binary message of up to `PROGRAM_INPUT_MAX_SIZE` bytes is written to stdin as it is, including NUL, followed by a newline
+ * same as `/input`. Output is sent as binary messages as soon as it is read, since output may cut UTF-8 sequences. Connection is closed with 1000 when the process is reclaimed.
+ * Stdin is written without blocking, as far as the pipe takes, and output keeps being relayed while the rest of a message waits,
+ * so that a process echoing its input does not stall on its full stdout. The next message is not received until the pending one is written.
+ *
+ * @param data output taken by `program_socket_handler`, allocated by `malloc`. Released here.
+ */
+static void relay_program_io(struct websocket *socket, void *data) {
+    struct child_output *output = (struct child_output *)data;
+    const int pid = output->pidx;
+    const int input_fd = open_input_of_child(pid);
+    char buffer[4096];
+    char *input = malloc(PROGRAM_INPUT_MAX_SIZE + 1);
+    size_t input_offset = 0;
+    size_t input_length = 0;
+    enum websocket_opcode opcode;
+
+    if (input == NULL || input_fd == -1) {
+        close_websocket(socket, WEBSOCKET_CLOSE_INTERNAL_ERROR);
+        goto relay_program_io_close;
+    }
+
+    /* closed socket (the head was not sent) must not consume output of the process */
+    while (!socket->closed) {
+        const bool input_pending = input_offset < input_length;
+        struct pollfd fds[3] = {
+            {.fd = input_pending ? -1 : socket->socket, .events = POLLIN},
+            {.fd = output->fd, .events = POLLIN},
+            {.fd = input_pending ? input_fd : -1, .events = POLLOUT}
+        };
+        int ready = poll(fds, 3, PROGRAM_EVENT_HEARTBEAT);
+
+        if (ready == -1 && errno == EINTR)
+            continue;
+        if (ready == -1) {
+            perror("poll");
+            close_websocket(socket, WEBSOCKET_CLOSE_INTERNAL_ERROR);
+            goto relay_program_io_close;
+        }
+
+        /* idle connection is kept open through proxies by ping */
+        if (ready == 0) {
+            if (send_websocket_message(socket, WEBSOCKET_PING, NULL, 0) == -1)
+                goto relay_program_io_close;
+            continue;
+        }
+
+        if (fds[1].revents) {
+            ssize_t bytes_read = read_output_from_child(output, buffer, sizeof(buffer), 0);
+
+            /* output has ended and the process is reclaimed */
+            if (bytes_read == -1) {
+                close_websocket(socket, WEBSOCKET_CLOSE_NORMAL);
+                goto relay_program_io_close;
+            }
+            if (bytes_read == -2) {
+                close_websocket(socket, WEBSOCKET_CLOSE_INTERNAL_ERROR);
+                goto relay_program_io_close;
+            }
+            if (bytes_read > 0 && send_websocket_message(socket, WEBSOCKET_BINARY, buffer, (size_t)bytes_read) == -1)
+                goto relay_program_io_close;
+        }
+
+        if (fds[2].revents) {
+            ssize_t written = write_input_without_blocking(input_fd, input + input_offset, input_length - input_offset);
+
+            /* process which has exited takes no more input. its output ends soon, and closes the connection. */
+            if (written == -1)
+                input_offset = input_length = 0;
+            else
+                input_offset += (size_t)written;
+        }
+
+        if (fds[0].revents) {
+            ssize_t length = receive_websocket_message(socket, input, PROGRAM_INPUT_MAX_SIZE, &opcode);
+
+            if (length == -1)
+                goto relay_program_io_close;
+            if (opcode == WEBSOCKET_TEXT || opcode == WEBSOCKET_BINARY) {
+                input[length] = '\n';
+                input_offset = 0;
+                input_length = (size_t)length + 1;
+            }
+        }
+    }
+
+    relay_program_io_close:
+    if (input_fd != -1)
+        close(input_fd);
+    free(input);
+    close_output_of_child(output);
+    free(output);
+}
+
+/**
+ * @brief `/program/:pid/socket` 에 대한 핸들러. 입력마다 `/input` 요청을 보내는 대신 하나의 WebSocket 으로 표준 입출력을 주고받는다.
+ * @test websocat ws://localhost:10010/program/10/socket
+ */
+static int program_socket_handler(const struct http_request *request, struct http_response *response) {
+    const char *pid_value = find_http_request_path_parameter(request, "pid", NULL);
+    int pid = atoi(pid_value);
+    struct child_output *output = malloc(sizeof(struct child_output));
+
+    if (output == NULL)
+        return -1;
+
+    /* 스트림과 마찬가지로 출력은 업그레이드 전에 가져가서, 두 번째 연결은 101 대신 409 로 거절된다 */
+    int result = open_output_of_child(pid, output);
+    if (result != 0) {
+        free(output);
+        response->status_code = result == -1 ? HTTP_CONFLICT : HTTP_BAD_REQUEST;
+        response->header_set = retain_http_header_set(api_headers);
+        response->body = result == -1 ? "Output is being streamed" : "Invalid parameter: pid";
+        response->body_type = HTTP_BODY_BORROWED;
+        return 0;
+    }
+
+    /* failed handshake is answered with the status set by `accept_websocket`, and the session is not called */
+    if (accept_websocket(request, response, relay_program_io, output) == -1) {
+        close_output_of_child(output);
+        free(output);
+        response->header_set = retain_http_header_set(api_headers);
+    }
+    return 0;
+}
+
 /**
  * @brief Handle POST requests to /run/text-mode endpoint
  *
@@ -628,17 +857,48 @@ int main() {
         }
     }
 
+    struct http_headers headers = {};
+    insert_header(&headers, "Content-Type", "application/json");
+    insert_header(&headers, "Access-Control-Allow-Origin", "*");
+    insert_header(&headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
+    insert_header(&headers, "Access-Control-Allow-Headers", "*");
+    api_headers = create_http_header_set(&headers);
+
+    /* 이벤트 스트림은 Content-Type 만 다르고, 프록시나 브라우저가 캐시하지 않도록 한다 */
+    insert_header(&headers, "Content-Type", "text/event-stream");
+    insert_header(&headers, "Cache-Control", "no-cache");
+    event_stream_headers = create_http_header_set(&headers);
+    destruct_http_headers(&headers);
+
+    if (!api_headers || !event_stream_headers) {
+        perror("Failed to create response headers");
+        return 1;
+    }
+
     struct routes route_table = {};
     init_routes(&route_table);
 
     insert_route(&route_table, "/stop", HTTP_POST, stop_callback);
     insert_route(&route_table, "/input", HTTP_POST, input_callback);
     insert_route(&route_table, "/program", HTTP_GET, program_callback);
+    insert_route(&route_table, "/program/:pid", HTTP_GET, program_callback);
+    insert_route_handler(&route_table, "/program/:pid/events", HTTP_GET, program_events_handler);
+    insert_route_handler(&route_table, "/program/:pid/socket", HTTP_GET, program_socket_handler);
 
     insert_route(&route_table, "/run/text-mode", HTTP_POST, handle_text_mode);
     insert_route(&route_table, "/run/interactive-mode", HTTP_POST, handle_interactive_mode);
     insert_route(&route_table, "/run/debugger", HTTP_POST, handle_debugger);
 
+    /* health check is answered with bytes serialized here, without callback */
+    struct http_response health_response = {
+        .status_code = HTTP_OK,
+        .http_version = HTTP_1_1,
+        .headers = {},
+        .body = "{\"status\":\"ok\"}",
+        .header_set = api_headers
+    };
+    insert_canned_route(&route_table, "/health", HTTP_GET, &health_response);
+
     struct web_server app = (struct web_server) {
         .route_table = &route_table,
         .port_num = 10010,
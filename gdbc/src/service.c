@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdatomic.h>
@@ -16,6 +17,7 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -35,7 +37,9 @@ static atomic_int pcnt = 0;
 /**
  * @brief List of processes for managing user's run request
  */
-struct process_running PROCESSES[MAX_PROCESS];
+struct process_running PROCESSES[MAX_PROCESS] = {
+    [0 ... MAX_PROCESS - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER}
+};
 
 static inline int check_pidx(int pidx) {
     /* check for `is_running` doesn't need strong atomic */
@@ -71,6 +75,9 @@ static pid_t check_pid_alive(pid_t pid) {
     return 0;
 }
 
+/**
+ * @brief Reclaim the process. Called with `p_info->lock` held.
+ */
 static int cleanup_child_process(struct process_running *p_info) {
     assert(p_info->is_running != 0);
 
@@ -104,14 +111,14 @@ int build_and_run(const char *path_to_source_code, enum compiler_type compiler_t
     int from_child_pipe[2] = {-1,-1};
     int to_child_pipe[2] = {-1,-1};    
 
-    PROCESSES[pidx].executable_file_path = NULL;
-    PROCESSES[pidx].source_code_path = NULL;
-
+    /* slot is claimed under its lock, and published as running only after pid, pipes and generation are filled.
+       until then, requests with this id see the previous process as reclaimed. a slot locked by someone is skipped. */
     for (pidx = 0; pidx < MAX_PROCESS; pidx++) {
-        bool expected = false;
-        if (atomic_compare_exchange_strong(&PROCESSES[pidx].is_running, &expected, true)) {
+        if (pthread_mutex_trylock(&PROCESSES[pidx].lock) != 0)
+            continue;
+        if (!atomic_load(&PROCESSES[pidx].is_running))
             break;
-        }
+        pthread_mutex_unlock(&PROCESSES[pidx].lock);
     }
         
     if (pidx == MAX_PROCESS) {
@@ -153,11 +160,11 @@ int build_and_run(const char *path_to_source_code, enum compiler_type compiler_t
     }
     compile_args[4 + compile_option_cnt] = (char *)NULL;
 
-    PROCESSES[pidx] = (struct process_running) {
-        .is_running = 1,
-        .source_code_path  = strdup(path_to_source_code),
-        .executable_file_path = strdup(executable_filename)
-    };
+    /* lock of the slot is kept, and consumers of the previous process see the new generation */
+    PROCESSES[pidx].source_code_path = strdup(path_to_source_code);
+    PROCESSES[pidx].executable_file_path = strdup(executable_filename);
+    PROCESSES[pidx].generation++;
+    PROCESSES[pidx].output_taken = false;
 
     /* 파이프 생성 */
     if (pipe(from_child_pipe) == -1) {
@@ -258,6 +265,12 @@ int build_and_run(const char *path_to_source_code, enum compiler_type compiler_t
         -1) {
         perror("fcntl");
     }
+    /* stdin is written without blocking by a relay, which keeps reading output meanwhile */
+    int outpipe_flags = fcntl(to_child_pipe[1], F_GETFL);
+    if (fcntl(to_child_pipe[1], F_SETFL, outpipe_flags | O_NONBLOCK) ==
+        -1) {
+        perror("fcntl");
+    }
 
     if (c_options) {
         free(c_options);
@@ -265,6 +278,8 @@ int build_and_run(const char *path_to_source_code, enum compiler_type compiler_t
     if (compile_args) {
         free(compile_args);
     }
+    atomic_store(&PROCESSES[pidx].is_running, true);
+    pthread_mutex_unlock(&PROCESSES[pidx].lock);
     return pidx;
 
     build_and_run_error:
@@ -289,6 +304,9 @@ int build_and_run(const char *path_to_source_code, enum compiler_type compiler_t
     if (pidx != MAX_PROCESS) {
         free(PROCESSES[pidx].executable_file_path);
         free(PROCESSES[pidx].source_code_path);
+        PROCESSES[pidx].executable_file_path = NULL;
+        PROCESSES[pidx].source_code_path = NULL;
+        pthread_mutex_unlock(&PROCESSES[pidx].lock);
     }
     return -1;
 }
@@ -302,54 +320,179 @@ void show_process_list() {
 }
 
 int stop_process(int pidx) {
-    if (check_pidx(pidx) == 0)
+    int result = 0;
+
+    if (pidx < 0 || pidx >= MAX_PROCESS)
         return 0;
+    pthread_mutex_lock(&PROCESSES[pidx].lock);
+    if (check_pidx(pidx) == 0)
+        goto stop_process_unlock;
     if (kill(PROCESSES[pidx].pid, SIGKILL) == -1) {
         perror("kill");        
-        return 0;
+        goto stop_process_unlock;
     }
     DLOGV("CLEANUP: %d\n", pidx);
     cleanup_child_process(&PROCESSES[pidx]);
-    return 1;
+    result = 1;
+
+    stop_process_unlock:
+    pthread_mutex_unlock(&PROCESSES[pidx].lock);
+    return result;
 }
 
 int pass_input_to_child(int pidx, char *input) {
     DLOGV("pass input like:\n%s\n", input);
-    if (check_pidx(pidx) == 0)
+    return write_input_to_child(pidx, input, strlen(input));
+}
+
+/**
+ * @brief Duplicate the stdin pipe of the process, so that it is written outside of the lock.
+ * The process can be stopped meanwhile, and then writes fail.
+ * 
+ * @return descriptor, -2 if `pidx` is invalid, or -1 if process is unavailable
+ */
+static int dup_input_of_child(int pidx) {
+    if (pidx < 0 || pidx >= MAX_PROCESS)
+        return -2;
+
+    pthread_mutex_lock(&PROCESSES[pidx].lock);
+    if (check_pidx(pidx) == 0) {
+        pthread_mutex_unlock(&PROCESSES[pidx].lock);
         return -2;
+    }
     if (!check_pid_alive(PROCESSES[pidx].pid)) {
+        pthread_mutex_unlock(&PROCESSES[pidx].lock);
         printf("CANNOT ACCESS TO PROCESS\n");
         return -1;
     }
+    int fd = fcntl(fileno(PROCESSES[pidx].to_child), F_DUPFD_CLOEXEC, 0);
+    pthread_mutex_unlock(&PROCESSES[pidx].lock);
+    if (fd == -1) {
+        perror("fcntl - F_DUPFD_CLOEXEC");
+        return -1;
+    }
+    return fd;
+}
 
-    int n = fprintf(PROCESSES[pidx].to_child, "%s\n", input);
+/**
+ * @brief `writev` once to stdin pipe of a process. Pipe is non-blocking, so it fails with `EAGAIN` when the pipe is full.
+ * `SIGPIPE` raised by a process which has exited is blocked and discarded, so that it does not kill the server.
+ */
+static ssize_t write_input_vectors(int fd, const struct iovec *vectors, int count) {
+    sigset_t pipe_signal, previous_mask;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, &previous_mask);
+
+    ssize_t written = writev(fd, vectors, count);
+    const int saved_errno = errno;
+
+    if (written == -1 && saved_errno == EPIPE && !sigismember(&previous_mask, SIGPIPE)) {
+        struct timespec no_wait = {0, 0};
+        sigtimedwait(&pipe_signal, NULL, &no_wait);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+    errno = saved_errno;
+    return written;
+}
+
+int write_input_to_child(int pidx, const char *input, size_t length) {
+    int fd = dup_input_of_child(pidx);
+    if (fd < 0)
+        return fd;
+
+    struct iovec vectors[2] = {
+        {(char *)input, length},
+        {"\n", 1}
+    };
+    struct iovec *vector = vectors;
+    int count = 2;
+    int n = (int)(length + 1);
+
+    while (count > 0) {
+        ssize_t written = write_input_vectors(fd, vector, count);
+        if (written == -1 && errno == EINTR)
+            continue;
+        /* wait until the process reads, same as a blocking write */
+        if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+                n = -1;
+                break;
+            }
+            continue;
+        }
+        if (written == -1) {
+            n = -1;
+            break;
+        }
+
+        while (count > 0 && (size_t)written >= vector->iov_len) {
+            written -= vector->iov_len;
+            vector++;
+            count--;
+        }
+        if (count > 0) {
+            vector->iov_base = (char *)vector->iov_base + written;
+            vector->iov_len -= written;
+        }
+    }
+    close(fd);
 
     if (n < 0) {
         printf("PROCESS CANNOT GET INPUT\n");
         return -1;
     }
-    fflush(PROCESSES[pidx].to_child);
     return n;
 }
 
+int open_input_of_child(int pidx) {
+    int fd = dup_input_of_child(pidx);
+    return fd < 0 ? -1 : fd;
+}
+
+ssize_t write_input_without_blocking(int fd, const char *input, size_t length) {
+    struct iovec vector = {(char *)input, length};
+    ssize_t written = write_input_vectors(fd, &vector, 1);
+
+    if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 0;
+    return written;
+}
+
 char *get_output_from_child(int pidx) {
-    if (check_pidx(pidx) == 0)
+    char *buf = NULL;
+
+    if (pidx < 0 || pidx >= MAX_PROCESS)
         return (char *)-2;
-    char *buf = malloc(1024 * 14);
+    pthread_mutex_lock(&PROCESSES[pidx].lock);
+    if (check_pidx(pidx) == 0) {
+        buf = (char *)-2;
+        goto get_output_unlock;
+    }
+    /* a stream reads the output and reclaims the process instead */
+    if (PROCESSES[pidx].output_taken) {
+        buf = (char *)-3;
+        goto get_output_unlock;
+    }
+    buf = malloc(1024 * 14);
     buf[0] = '\0';
     int pfd = fileno(PROCESSES[pidx].from_child);
 
     ssize_t bytes_read;
-    bytes_read = read(pfd, buf, 1024 * 14);
+    bytes_read = read(pfd, buf, 1024 * 14 - 1);
 
     if (bytes_read == 0) {
         free(buf);
         cleanup_child_process(&PROCESSES[pidx]);
-        return (char *)-1;
+        buf = (char *)-1;
+        goto get_output_unlock;
     }
 
     if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-        return NULL;
+        free(buf);
+        buf = NULL;
+        goto get_output_unlock;
     }
 
     if (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
@@ -359,5 +502,90 @@ char *get_output_from_child(int pidx) {
     }
     
     DLOGV("%s\n", buf);
+
+    get_output_unlock:
+    pthread_mutex_unlock(&PROCESSES[pidx].lock);
     return buf;
-}
\ No newline at end of file
+}
+
+int is_process_running(int pidx) {
+    return check_pidx(pidx);
+}
+
+int open_output_of_child(int pidx, struct child_output *output) {
+    int result = 0;
+
+    if (pidx < 0 || pidx >= MAX_PROCESS)
+        return -2;
+    pthread_mutex_lock(&PROCESSES[pidx].lock);
+    if (check_pidx(pidx) == 0) {
+        result = -2;
+        goto open_output_unlock;
+    }
+    if (PROCESSES[pidx].output_taken) {
+        result = -1;
+        goto open_output_unlock;
+    }
+
+    /* pipe is closed when the process is reclaimed, but the duplicate is not, so its number is never reused under the consumer */
+    output->fd = fcntl(fileno(PROCESSES[pidx].from_child), F_DUPFD_CLOEXEC, 0);
+    if (output->fd == -1) {
+        perror("fcntl - F_DUPFD_CLOEXEC");
+        result = -2;
+        goto open_output_unlock;
+    }
+    output->pidx = pidx;
+    output->generation = PROCESSES[pidx].generation;
+    PROCESSES[pidx].output_taken = true;
+
+    open_output_unlock:
+    pthread_mutex_unlock(&PROCESSES[pidx].lock);
+    return result;
+}
+
+void close_output_of_child(struct child_output *output) {
+    struct process_running *p_info = &PROCESSES[output->pidx];
+
+    pthread_mutex_lock(&p_info->lock);
+    if (p_info->generation == output->generation)
+        p_info->output_taken = false;
+    pthread_mutex_unlock(&p_info->lock);
+
+    close(output->fd);
+    output->fd = -1;
+}
+
+ssize_t read_output_from_child(struct child_output *output, char *buffer, size_t size, int timeout) {
+    /* sleep in `poll` until the pipe becomes readable, instead of being polled by requests */
+    struct pollfd pfd = {
+        .fd = output->fd,
+        .events = POLLIN
+    };
+    int ready = poll(&pfd, 1, timeout);
+    if (ready == 0 || (ready == -1 && errno == EINTR))
+        return 0;
+    if (ready == -1) {
+        perror("poll");
+        return -2;
+    }
+
+    ssize_t bytes_read = read(pfd.fd, buffer, size);
+
+    if (bytes_read == 0) {
+        /* process may have been stopped, and the slot reused, while output was waited for */
+        struct process_running *p_info = &PROCESSES[output->pidx];
+        pthread_mutex_lock(&p_info->lock);
+        if (p_info->is_running && p_info->generation == output->generation)
+            cleanup_child_process(p_info);
+        pthread_mutex_unlock(&p_info->lock);
+        return -1;
+    }
+
+    if (bytes_read == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+        perror("read");
+        return -2;
+    }
+    return bytes_read;
+}
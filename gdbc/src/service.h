@@ -1,5 +1,6 @@
 
 #pragma once
+#include <pthread.h>
 #include <sys/types.h>
 #include <stdbool.h>
 #include <stdatomic.h>
@@ -14,6 +15,22 @@ struct process_running {
     char *source_code_path;
     char *executable_file_path;
     atomic_bool is_running;    
+    /* guards the fields above from reads, input and reclaiming by other requests */
+    pthread_mutex_t lock;
+    /* increased whenever the slot is reused, so that a consumer of output does not reclaim the next process */
+    unsigned generation;
+    /* set while output is taken by `open_output_of_child` */
+    bool output_taken;
+};
+
+/**
+ * @brief Output of a child process taken by one consumer, e.g. a stream. See `open_output_of_child`.
+ */
+struct child_output {
+    int pidx;
+    /* duplicated read end of the pipe, owned by the consumer */
+    int fd;
+    unsigned generation;
 };
 
 /**
@@ -86,14 +103,88 @@ int stop_process(int pidx);
  */
 int pass_input_to_child(int pidx, char *input);
 
+/**
+ * @brief Write exactly `length` bytes of `input` to stdin of the child process, followed by a newline.
+ * 
+ * @param pidx id of process that `build_and_run` have returned.
+ * @param input bytes to write. May contain NUL.
+ * @param length the number of bytes of `input`
+ * @return If not under than 0, the number of bytes written, including the newline.
+ * @retval -2 given `pidx` argument is invalid
+ * @retval -1 error to write or process is unavailable.
+ */
+int write_input_to_child(int pidx, const char *input, size_t length);
+
+/**
+ * @brief Get a descriptor of stdin of the child process, to write input without blocking together with `poll` (`POLLOUT`).
+ * 
+ * @param pidx id of process that `build_and_run` have returned.
+ * @return non-blocking descriptor duplicated from the pipe, or -1 if `pidx` is invalid or process is unavailable.
+ * It stays open after the process is reclaimed, and the caller closes it.
+ */
+int open_input_of_child(int pidx);
+
+/**
+ * @brief Write as many bytes of `input` as stdin pipe of the child process takes now, without blocking.
+ * 
+ * @param fd descriptor from `open_input_of_child`
+ * @param input bytes to write. May contain NUL.
+ * @param length the number of bytes of `input`
+ * @return the number of bytes written. 0 if the pipe is full.
+ * @retval -1 error to write, e.g. process has exited.
+ */
+ssize_t write_input_without_blocking(int fd, const char *input, size_t length);
+
 /**
  * @brief Get the output from child process. 
  * If process has no more output and exited, this function will reclaim that process and return -1.
  * 
  * @param pidx id of process that `build_and_run` have returned.
- * @return char* buffer of output allocated with `malloc`, including stderr and stdout. -1 and 0 represent error.
+ * @return char* buffer of output allocated with `malloc`, including stderr and stdout. -3, -1 and 0 represent error.
+ * @retval -3 (== 0xfffffd) output is taken by `open_output_of_child`
  * @retval -2 (== 0xfffffe) given argument is invalid
  * @retval -1 (== 0xffffff) no more read and process is dead
  * @retval 0 have no output at now 
  */
-char *get_output_from_child(int pidx);
\ No newline at end of file
+char *get_output_from_child(int pidx);
+
+/**
+ * @brief Check the process of given id is running.
+ * 
+ * @param pidx id of process that `build_and_run` have returned.
+ * @return 1 if running, or 0.
+ */
+int is_process_running(int pidx);
+
+/**
+ * @brief Take the output of the child process for one consumer, e.g. a stream, until `close_output_of_child`.
+ * Meanwhile `get_output_from_child` and other consumers are rejected, so that output is not split and the process is reclaimed once.
+ * 
+ * @param pidx id of process that `build_and_run` have returned.
+ * @param output taken output. `output->fd` can be polled together with other descriptors,
+ * and stays open even after the process is reclaimed, e.g. by `stop_process`.
+ * @return 0 on success
+ * @retval -2 given `pidx` argument is invalid, or failed to duplicate the descriptor
+ * @retval -1 output is already taken by another consumer
+ */
+int open_output_of_child(int pidx, struct child_output *output);
+
+/**
+ * @brief Release output taken by `open_output_of_child`, and close `output->fd`.
+ */
+void close_output_of_child(struct child_output *output);
+
+/**
+ * @brief Wait until the child process writes output or `timeout` passes, and read it into `buffer` without allocating.
+ * If process has no more output and exited, this function will reclaim that process and return -1.
+ * 
+ * @param output output taken by `open_output_of_child`
+ * @param buffer buffer to store output, including stderr and stdout. Not NUL-terminated.
+ * @param size size of `buffer`
+ * @param timeout milliseconds to wait for output
+ * @return If greater than 0, the number of bytes read.
+ * @retval -2 failed to read
+ * @retval -1 no more read and process is dead
+ * @retval 0 no output until `timeout`
+ */
+ssize_t read_output_from_child(struct child_output *output, char *buffer, size_t size, int timeout);
@@ -1,8 +1,10 @@
 #define _GNU_SOURCE
+#include <ctype.h>
 #include <time.h>
 #include <stdio.h>
 
 #include "http.h"
+#include "router.h"
 #include "utility.h"
 
 #define BUF_SIZE 1024 /* <- 임시 버퍼 크기*/
@@ -16,28 +18,49 @@ struct http_header* find_header(const struct http_headers *headers, const char *
 }
 
 struct route *find_route(const struct routes* routes, const char *path, enum http_method method) {
-    for (int i = 0; i < routes->size; i++) {
-        if (routes->items[i]->method == method && url_path_cmp(path, routes->items[i]->path) == 0)
-            return routes->items[i];
+    if (method < 0 || method >= HTTP_METHOD_UNKNOWN)
+        return NULL;
+
+    const struct route_node *node = find_route_node(routes->tree, path, NULL);
+    return node ? node->routes[method] : NULL;
+}
+
+struct route *match_route(const struct routes *routes, const struct http_request *request, enum http_method method) {
+    struct http_path_parameters *parameters = &request->cache->path_parameters;
+
+    if (method < 0 || method >= HTTP_METHOD_UNKNOWN) {
+        parameters->size = 0;
+        return NULL;
     }
-    return NULL;
+
+    const struct route_node *node = find_route_node(routes->tree, request->path, parameters);
+    if (node == NULL || node->routes[method] == NULL) {
+        parameters->size = 0;
+        return NULL;
+    }
+    return node->routes[method];
 }
 
-struct routes* insert_route(
-		struct routes       *route_table,
-		const char          *path,
-		enum http_method    method,
-		struct http_response *(*callback)(struct http_request request)
+/**
+ * @brief Insert a route answered by `callback`, `handler`, or `canned` if it is not NULL. Reference of `canned` is taken over on success.
+ */
+static struct routes* insert_route_entry(
+		struct routes                   *route_table,
+		const char                      *path,
+		enum http_method                method,
+		struct http_response            *(*callback)(struct http_request request),
+		int                             (*handler)(const struct http_request *request, struct http_response *response),
+		struct http_canned_response     *canned
 ) {
     if (path[0] != '/')
         return NULL;
-    if (find_route(route_table, path, method))
-        return NULL;
 
     if (route_table->capacity == route_table->size) {
         int new_capacity = route_table->capacity * 2;
 
         struct route** new_route_table = (struct route**)realloc(route_table->items, new_capacity * sizeof(struct route*));
+        if (new_route_table == NULL)
+            return NULL;
 
         route_table->items = new_route_table;
         route_table->capacity = new_capacity;
@@ -49,8 +72,10 @@ struct routes* insert_route(
 
     *route = (struct route) {
         .callback = callback,
+        .handler = handler,
         .method = method,
-        .path = strdup(path)
+        .path = strdup(path),
+        .canned = canned
     };
 
     if (!route->path) {
@@ -58,18 +83,94 @@ struct routes* insert_route(
         return NULL;
     }
 
+    /* fails also when a route with same path and method already exists */
+    if (insert_route_node(&route_table->tree, route) == -1) {
+        free(route->path);
+        free(route);
+        return NULL;
+    }
+
     route_table->items[route_table->size++] = route;
 
     return route_table;
 }
 
+struct routes* insert_route(
+		struct routes       *route_table,
+		const char          *path,
+		enum http_method    method,
+		struct http_response *(*callback)(struct http_request request)
+) {
+    return insert_route_entry(route_table, path, method, callback, NULL, NULL);
+}
+
+struct routes* insert_route_handler(
+		struct routes       *route_table,
+		const char          *path,
+		enum http_method    method,
+		int                 (*handler)(const struct http_request *request, struct http_response *response)
+) {
+    return insert_route_entry(route_table, path, method, NULL, handler, NULL);
+}
+
+struct routes* insert_canned_route(
+		struct routes               *route_table,
+		const char                  *path,
+		enum http_method            method,
+		const struct http_response  *response
+) {
+    struct http_canned_response *canned = create_http_canned_response(response);
+    if (canned == NULL)
+        return NULL;
+
+    if (insert_route_entry(route_table, path, method, NULL, NULL, canned) == NULL) {
+        release_http_canned_response(canned);
+        return NULL;
+    }
+    return route_table;
+}
+
+struct routes* remove_route(struct routes *route_table, const char *path, enum http_method method) {
+    int index = -1;
+
+    for (int i = 0; i < route_table->size; i++) {
+        if (route_table->items[i]->method == method && url_path_cmp(path, route_table->items[i]->path) == 0) {
+            index = i;
+            break;
+        }
+    }
+    if (index == -1)
+        return NULL;
+
+    /* parameter segments make path lookup ambiguous, so the tree is rebuilt without the route. removal is rare. */
+    struct route_node *tree = NULL;
+    for (int i = 0; i < route_table->size; i++) {
+        if (i != index && insert_route_node(&tree, route_table->items[i]) == -1) {
+            free_route_nodes(tree);
+            return NULL;
+        }
+    }
+
+    free_route_nodes(route_table->tree);
+    route_table->tree = tree;
+
+    release_http_canned_response(route_table->items[index]->canned);
+    free(route_table->items[index]->path);
+    free(route_table->items[index]);
+    memmove(&route_table->items[index], &route_table->items[index + 1], (route_table->size - index - 1) * sizeof(struct route *));
+    route_table->size--;
+
+    return route_table;
+}
+
 struct routes* init_routes(struct routes *route_table) {
     const int INITIAL_CAPACITY = 8;
 
     *route_table = (struct routes) {
         .capacity = INITIAL_CAPACITY,
         .items = (struct route **)malloc(INITIAL_CAPACITY * sizeof(struct route *)),
-        .size = 0
+        .size = 0,
+        .tree = NULL
     };
 
     if (route_table->items == NULL) {
@@ -96,9 +197,12 @@ struct http_headers* insert_header(struct http_headers *headers, char *key, char
 
     // If key doesn't exist, create new header
     if (headers->capacity == headers->size) {
-        int new_capacity = headers->capacity * 2;
+        /* empty `struct http_headers` ({}) can be inserted, too */
+        int new_capacity = headers->capacity ? headers->capacity * 2 : 4;
 
         struct http_header** new_headers = realloc(headers->items, new_capacity * sizeof(struct http_header*));
+        if (new_headers == NULL)
+            return NULL;
 
         headers->items = new_headers;
         headers->capacity = new_capacity;
@@ -137,21 +241,22 @@ void destruct_http_headers(struct http_headers *headers) {
         free(parsed_header);
     }
     free(headers->items);
+    headers->items = NULL;
     headers->capacity = 0;
     headers->size = 0;
 }
 
 void destruct_http_request(struct http_request *request) {
-    if (request->body)
-        free(request->body);
+    struct http_request_cache *cache = request->cache;
+
+    if (cache && (cache->decoded & HTTP_REQUEST_HEADERS) && cache->headers.capacity)
+        destruct_http_headers(&cache->headers);
 
-    if (request->headers.capacity)
-        destruct_http_headers(&request->headers);
+    if (cache && (cache->decoded & HTTP_REQUEST_QUERY_PARAMETERS))
+        free_query_parameters(&cache->query_parameters);
 
     if (request->path)
         free(request->path);
-
-    free_query_parameters(&request->query_parameters);
 }
 
 struct http_header *parse_http_header(char *header_string) {
@@ -165,8 +270,13 @@ struct http_header *parse_http_header(char *header_string) {
     header->key = NULL;
     header->value = NULL;
 
+    if (end_of_header == NULL)
+        goto parse_header_error;
+
     /* trim prefix */
     start_of_key = find_non_space(header_string);
+    if (start_of_key == NULL || start_of_key >= end_of_header)
+        goto parse_header_error;
 
     offset = (int)(start_of_key - header_string);
 
@@ -180,14 +290,16 @@ struct http_header *parse_http_header(char *header_string) {
         if (end_of_key == end_of_header)
             goto parse_header_error;
 
-        offset = (int)(end_of_key - start_of_key) + 1;
+        offset = (int)(end_of_key - header_string) + 1;
 
         end_of_key--;
         /* trim suffix */
-        while (is_non_space(*end_of_key))
+        while (end_of_key >= start_of_key && is_non_space(*end_of_key))
             end_of_key--;
 
         length = (int)(end_of_key - start_of_key) + 1;
+        if (length <= 0)
+            goto parse_header_error;
 
         header->key = (char*)malloc(length + 1);
         strncpy(header->key, start_of_key, length);
@@ -200,7 +312,8 @@ struct http_header *parse_http_header(char *header_string) {
         int length;
         /* find first non-whitespace except for double quotes at start */
         char *last_non_space_at = find_non_space(start_of_key + 1);
-
+        if (last_non_space_at == NULL || last_non_space_at >= end_of_header)
+            goto parse_header_error;
 
         end_of_key = last_non_space_at + 1;
 
@@ -213,7 +326,7 @@ struct http_header *parse_http_header(char *header_string) {
             goto parse_header_error;
         }
 
-        offset = (int)(end_of_key - start_of_key) + 1;
+        offset = (int)(end_of_key - header_string) + 1;
         end_of_key = last_non_space_at - 1;
         start_of_key++;
 
@@ -230,6 +343,12 @@ struct http_header *parse_http_header(char *header_string) {
     /* trim prefix */
     start_of_value = find_non_space(header_string + offset);
 
+    /* empty value */
+    if (start_of_value == NULL || start_of_value >= end_of_header) {
+        header->value = strdup("");
+        return header;
+    }
+
     offset = (int)(start_of_value - header_string);
 
     /* if not quoted string */
@@ -244,7 +363,7 @@ struct http_header *parse_http_header(char *header_string) {
 
         end_of_value--;
         /* trim suffix */
-        while (is_non_space(*end_of_value))
+        while (end_of_value >= start_of_value && is_non_space(*end_of_value))
             end_of_value--;
 
         length = (int)(end_of_value - start_of_value) + 1;
@@ -260,7 +379,8 @@ struct http_header *parse_http_header(char *header_string) {
         int length;
         /* find first non-whitespace except for double quotes at start */
         char *last_non_space_at = find_non_space(start_of_value + 1);
-
+        if (last_non_space_at == NULL || last_non_space_at >= end_of_header)
+            goto parse_header_error;
 
         end_of_value = last_non_space_at + 1;
 
@@ -345,15 +465,14 @@ struct http_headers parse_http_headers(char *headers_string) {
     return headers_ret;
 }
 
-char *http_headers_stringify(struct http_headers *headers) {
-    // No headers to process
-    if (headers == NULL || headers->size == 0 || headers->items == NULL) {
-        return NULL;
-    }
-
+/**
+ * @brief Length of serialized header lines of `headers`, skipping invalid headers.
+ */
+static size_t http_headers_length(const struct http_headers *headers) {
     size_t total_length = 0;
+
     for (int i = 0; i < headers->size; i++) {
-        struct http_header *header = headers->items[i];
+        const struct http_header *header = headers->items[i];
 
         // No header to process
         if (header == NULL || header->key == NULL || header->value == NULL) {
@@ -361,31 +480,51 @@ char *http_headers_stringify(struct http_headers *headers) {
         }
 
         // key + ": " + value + "\r\n"
-        // 1. ": " (2 bytes) - separator between key and value
-        // 2. "\r\n" (2 bytes) - line terminator for HTTP headers
         total_length += strlen(header->key) + strlen(header->value) + 4;
     }
+    return total_length;
+}
 
-    char *result = (char *)calloc(total_length + 1, sizeof(char));
-    if (result == NULL) {
-        return NULL;
-    }
-
+/**
+ * @brief Write header lines of `headers` at `cursor`, without NUL. `cursor` must have `http_headers_length` bytes.
+ * 
+ * @return End of written lines
+ */
+static char *write_http_headers(char *cursor, const struct http_headers *headers) {
     for (int i = 0; i < headers->size; i++) {
-        struct http_header *header = headers->items[i];
+        const struct http_header *header = headers->items[i];
 
-        // Ensure the header and its fields are valid
         if (header == NULL || header->key == NULL || header->value == NULL) {
             continue;
         }
 
-        // Safely concatenate strings
-        strncat(result, header->key, strlen(header->key));
-        strncat(result, ": ", 2);
-        strncat(result, header->value, strlen(header->value));
-        strncat(result, "\r\n", 2);
+        const size_t key_length = strlen(header->key);
+        const size_t value_length = strlen(header->value);
+
+        memcpy(cursor, header->key, key_length);
+        cursor += key_length;
+        memcpy(cursor, ": ", 2);
+        cursor += 2;
+        memcpy(cursor, header->value, value_length);
+        cursor += value_length;
+        memcpy(cursor, "\r\n", 2);
+        cursor += 2;
     }
+    return cursor;
+}
 
+char *http_headers_stringify(struct http_headers *headers) {
+    // No headers to process
+    if (headers == NULL || headers->size == 0 || headers->items == NULL) {
+        return NULL;
+    }
+
+    char *result = (char *)malloc(http_headers_length(headers) + 1);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    *write_http_headers(result, headers) = '\0';
     return result;
 }
 
@@ -432,9 +571,7 @@ struct http_query_parameter parse_http_query_parameter(char* parameter_string){
 
 struct http_query_parameters* insert_query_parameter(struct http_query_parameters *query_parameters, char* parameter_string){
 
-    char * param_string_copy = strdup(parameter_string);
-
-    if (!query_parameters || !param_string_copy) {
+    if (!query_parameters || !parameter_string) {
         return NULL;
     }
 
@@ -443,7 +580,8 @@ struct http_query_parameters* insert_query_parameter(struct http_query_parameter
         return NULL;
     }
 
-    struct http_query_parameter parsed_param = parse_http_query_parameter(param_string_copy);
+    /* `parse_http_query_parameter` works on its own copy */
+    struct http_query_parameter parsed_param = parse_http_query_parameter(parameter_string);
 
     if (!parsed_param.key || !parsed_param.value) {
         if (parsed_param.key) free(parsed_param.key);
@@ -488,6 +626,7 @@ struct http_query_parameters parse_query_parameters(char* parameters_string){
         if (insert_query_parameter(&query_parameters, token) == NULL){
             // 오류 발생 시 이미 할당된 메모리 정리
             free_query_parameters(&query_parameters);
+            free(parameters);
             return (struct http_query_parameters){0};
         }
         token = strtok_r(NULL, "&", &save_ptr);
@@ -555,89 +694,908 @@ int init_http_response(
     response->headers = headers;
     response->http_version = version;
     response->body = body ? strdup(body) : NULL;
+    response->body_length = 0;
+    response->body_type = HTTP_BODY_OWNED;
+    response->body_fd = -1;
+    response->body_offset = 0;
+    response->ranges = NULL;
+    response->header_set = NULL;
+    response->stream = NULL;
+    response->stream_data = NULL;
 
     return 0; // 성공
 }
 
-char* http_response_stringify(struct http_response http_response) {
-    char *header_string = http_headers_stringify(&http_response.headers);
-
-    const char *status_code_string = http_status_code_stringify(
-        http_response.status_code
-    );
-
-    const char *version_string = http_version_stringify(
-        http_response.http_version
-    );
-
-    const char *body = http_response.body ? http_response.body : "";
-
-    //  최종 문자열의 길이를 계산합니다.
-    int required_len = snprintf(
-        NULL, 0, "%s %d %s\r\n%s\r\n%s",
-        version_string,
-        http_response.status_code,
-        status_code_string,
-        header_string != NULL ? header_string : "",
-        body
-    );
-
-    if (required_len < 0) {
-        if (header_string != NULL) {
-            free(header_string);
+/**
+ * @brief Status line following version, such as "200 OK\r\n", and its reason phrase.
+ */
+struct http_status_line {
+    const char      *reason;
+    const char      *line;
+    unsigned char   length;
+};
+
+#define HTTP_STATUS_LINE(code, number, reason) \
+    [code] = { reason, number " " reason "\r\n", sizeof(number " " reason "\r\n") - 1 }
+
+/**
+ * @brief Precomputed status lines, indexed by `enum http_status_code`. `line` is NULL for undefined codes.
+ */
+static const struct http_status_line http_status_lines[600] = {
+    HTTP_STATUS_LINE(HTTP_SWITCHING_PROTOCOLS,              "101", "Switching Protocols"),
+
+    HTTP_STATUS_LINE(HTTP_OK,                               "200", "OK"),
+    HTTP_STATUS_LINE(HTTP_CREATED,                          "201", "Created"),
+    HTTP_STATUS_LINE(HTTP_ACCEPTED,                         "202", "Accepted"),
+    HTTP_STATUS_LINE(HTTP_NO_CONTENT,                       "204", "No Content"),
+    HTTP_STATUS_LINE(HTTP_PARTIAL_CONTENT,                  "206", "Partial Content"),
+
+    HTTP_STATUS_LINE(HTTP_MOVED_PERMANENTLY,                "301", "Moved Permanently"),
+    HTTP_STATUS_LINE(HTTP_FOUND,                            "302", "Found"),
+    HTTP_STATUS_LINE(HTTP_NOT_MODIFIED,                     "304", "Not Modified"),
+    HTTP_STATUS_LINE(HTTP_TEMPORARY_REDIRECT,               "307", "Temporary Redirect"),
+    HTTP_STATUS_LINE(HTTP_PERMANENT_REDIRECT,               "308", "Permanent Redirect"),
+
+    HTTP_STATUS_LINE(HTTP_BAD_REQUEST,                      "400", "Bad Request"),
+    HTTP_STATUS_LINE(HTTP_UNAUTHORIZED,                     "401", "Unauthorized"),
+    HTTP_STATUS_LINE(HTTP_FORBIDDEN,                        "403", "Forbidden"),
+    HTTP_STATUS_LINE(HTTP_NOT_FOUND,                        "404", "Not Found"),
+    HTTP_STATUS_LINE(HTTP_METHOD_NOT_ALLOWED,               "405", "Method Not Allowed"),
+    HTTP_STATUS_LINE(HTTP_REQUEST_TIMEOUT,                  "408", "Request Timeout"),
+    HTTP_STATUS_LINE(HTTP_CONFLICT,                         "409", "Conflict"),
+    HTTP_STATUS_LINE(HTTP_GONE,                             "410", "Gone"),
+    HTTP_STATUS_LINE(HTTP_LENGTH_REQUIRED,                  "411", "Length Required"),
+    HTTP_STATUS_LINE(HTTP_PAYLOAD_TOO_LARGE,                "413", "Payload Too Large"),
+    HTTP_STATUS_LINE(HTTP_URI_TOO_LONG,                     "414", "URI Too Long"),
+    HTTP_STATUS_LINE(HTTP_UNSUPPORTED_MEDIA_TYPE,           "415", "Unsupported Media Type"),
+    HTTP_STATUS_LINE(HTTP_RANGE_NOT_SATISFIABLE,            "416", "Range Not Satisfiable"),
+    HTTP_STATUS_LINE(HTTP_UPGRADE_REQUIRED,                 "426", "Upgrade Required"),
+    HTTP_STATUS_LINE(HTTP_TOO_MANY_REQUESTS,                "429", "Too Many Requests"),
+    HTTP_STATUS_LINE(HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE,  "431", "Request Header Fields Too Large"),
+
+    HTTP_STATUS_LINE(HTTP_INTERNAL_SERVER_ERROR,            "500", "Internal Server Error"),
+    HTTP_STATUS_LINE(HTTP_NOT_IMPLEMENTED,                  "501", "Not Implemented"),
+    HTTP_STATUS_LINE(HTTP_BAD_GATEWAY,                      "502", "Bad Gateway"),
+    HTTP_STATUS_LINE(HTTP_SERVICE_UNAVAILABLE,              "503", "Service Unavailable"),
+    HTTP_STATUS_LINE(HTTP_GATEWAY_TIMEOUT,                  "504", "Gateway Timeout"),
+    HTTP_STATUS_LINE(HTTP_HTTP_VERSION_NOT_SUPPORTED,       "505", "HTTP Version Not Supported")
+};
+
+#undef HTTP_STATUS_LINE
+
+/**
+ * @brief "HTTP/x.y " prefix of status line, indexed by `enum http_version`. Every prefix has `HTTP_VERSION_PREFIX_LENGTH` bytes.
+ */
+static const char *http_version_prefixes[] = {
+    [HTTP_1_0] = "HTTP/1.0 ",
+    [HTTP_1_1] = "HTTP/1.1 ",
+    [HTTP_2_0] = "HTTP/2.0 ",
+    [HTTP_3_0] = "HTTP/3.0 "
+};
+#define HTTP_VERSION_PREFIX_LENGTH 9
+
+void reset_http_response(struct http_response *response) {
+    struct http_headers headers = response->headers;
+
+    if (response->body && response->body_type == HTTP_BODY_OWNED)
+        free(response->body);
+    if (response->body_type == HTTP_BODY_FILE && response->body_fd >= 0)
+        close(response->body_fd);
+    free(response->ranges);
+
+    /* entries are freed, but the array is kept for the next response */
+    for (int i = 0; i < headers.size; i++) {
+        free(headers.items[i]->key);
+        free(headers.items[i]->value);
+        free(headers.items[i]);
+    }
+    headers.size = 0;
+
+    release_http_header_set(response->header_set);
+
+    *response = (struct http_response) {
+        .headers = headers,
+        .status_code = HTTP_OK,
+        .http_version = HTTP_1_1,
+        .body = NULL,
+        .body_length = 0,
+        .body_type = HTTP_BODY_OWNED,
+        .body_fd = -1,
+        .body_offset = 0,
+        .ranges = NULL,
+        .header_set = NULL,
+        .stream = NULL,
+        .stream_data = NULL,
+        .websocket = NULL,
+        .websocket_data = NULL
+    };
+}
+
+/**
+ * @brief month names of HTTP-date
+ */
+static const char *http_months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+/**
+ * @brief Cached `Date` line, and its sequence counter. Counter is odd while the line is written, and 0 before the first update.
+ */
+static char         http_date_line[HTTP_DATE_LINE_LENGTH + 1];
+static atomic_uint  http_date_sequence = 0;
+
+void format_http_date(time_t time, char date[HTTP_DATE_LENGTH + 1]) {
+    static const char *days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    struct tm tm;
+
+    gmtime_r(&time, &tm);
+
+    /* HTTP-date has four year digits. clamped, so that the line always fits `HTTP_DATE_LENGTH` */
+    int year = tm.tm_year + 1900;
+    if (year < 0)
+        year = 0;
+    else if (year > 9999)
+        year = 9999;
+
+    snprintf(date, HTTP_DATE_LENGTH + 1, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+             days[tm.tm_wday], tm.tm_mday, http_months[tm.tm_mon], year, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+void update_http_date(time_t now) {
+    char date[HTTP_DATE_LENGTH + 1];
+    char line[HTTP_DATE_LINE_LENGTH + 1];
+
+    format_http_date(now, date);
+    snprintf(line, sizeof(line), "Date: %s\r\n", date);
+
+    /* only one thread updates. readers see the odd counter, or a changed one after their copy, and retry. */
+    const unsigned sequence = atomic_load_explicit(&http_date_sequence, memory_order_relaxed);
+    atomic_store_explicit(&http_date_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(http_date_line, line, HTTP_DATE_LINE_LENGTH);
+    atomic_store_explicit(&http_date_sequence, sequence + 2, memory_order_release);
+}
+
+bool copy_http_date_line(char line[HTTP_DATE_LINE_LENGTH]) {
+    unsigned before, after;
+
+    do {
+        before = atomic_load_explicit(&http_date_sequence, memory_order_acquire);
+        if (before == 0)
+            return false;
+        if (before & 1)
+            continue;
+        memcpy(line, http_date_line, HTTP_DATE_LINE_LENGTH);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&http_date_sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return true;
+}
+
+int parse_http_date(const char *value, time_t *time) {
+    char        day_name[4], month_name[4];
+    int         consumed = 0;
+    struct tm   tm = {};
+
+    /* "Sun, 06 Nov 1994 08:49:37 GMT" */
+    if (strlen(value) != HTTP_DATE_LENGTH
+            || sscanf(value, "%3s, %2d %3s %4d %2d:%2d:%2d GMT%n", day_name, &tm.tm_mday, month_name, &tm.tm_year,
+                      &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &consumed) != 7
+            || consumed != HTTP_DATE_LENGTH)
+        return -1;
+
+    tm.tm_mon = -1;
+    for (int i = 0; i < 12; i++) {
+        if (strcmp(month_name, http_months[i]) == 0)
+            tm.tm_mon = i;
+    }
+    if (tm.tm_mon == -1 || tm.tm_mday < 1 || tm.tm_mday > 31 || tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60)
+        return -1;
+    tm.tm_year -= 1900;
+
+    *time = timegm(&tm);
+    return 0;
+}
+
+void format_http_etag(const struct stat *file_stat, char etag[HTTP_ETAG_MAX_LENGTH]) {
+    /* nanoseconds of modification time tell apart writes within a second */
+    snprintf(etag, HTTP_ETAG_MAX_LENGTH, "\"%llx-%llx-%llx\"",
+             (unsigned long long)file_stat->st_ino,
+             (unsigned long long)file_stat->st_size,
+             (unsigned long long)file_stat->st_mtim.tv_sec * 1000000000ULL + (unsigned long long)file_stat->st_mtim.tv_nsec);
+}
+
+bool match_http_etag(const char *if_none_match, const char *etag) {
+    size_t etag_length = strlen(etag);
+
+    /* tags are compared without quotes, since header parser drops quotes around a whole value */
+    if (etag_length >= 2 && etag[0] == '"' && etag[etag_length - 1] == '"') {
+        etag++;
+        etag_length -= 2;
+    }
+
+    while (*if_none_match) {
+        while (*if_none_match == ' ' || *if_none_match == '\t' || *if_none_match == ',')
+            if_none_match++;
+        if (*if_none_match == '*')
+            return true;
+
+        const size_t entry_length = strcspn(if_none_match, ",");
+        const char *tag = if_none_match;
+        size_t length = entry_length;
+
+        while (length > 0 && (tag[length - 1] == ' ' || tag[length - 1] == '\t'))
+            length--;
+        /* weak comparison: W/"x" matches "x" */
+        if (length >= 2 && strncmp(tag, "W/", 2) == 0) {
+            tag += 2;
+            length -= 2;
         }
+        if (length > 0 && tag[0] == '"') {
+            tag++;
+            length--;
+        }
+        if (length > 0 && tag[length - 1] == '"')
+            length--;
+
+        if (length == etag_length && strncmp(tag, etag, length) == 0)
+            return true;
+        if_none_match += entry_length;
+    }
+    return false;
+}
+
+bool is_http_not_modified(const struct http_request *request, const char *etag, time_t last_modified) {
+    const struct http_header    *condition;
+    time_t                      since;
+
+    if (request->method != HTTP_GET && request->method != HTTP_HEAD)
+        return false;
+
+    if ((condition = find_http_request_header(request, "If-None-Match")) != NULL)
+        return match_http_etag(condition->value, etag);
+
+    if ((condition = find_http_request_header(request, "If-Modified-Since")) != NULL)
+        return parse_http_date(condition->value, &since) == 0 && last_modified <= since;
+    return false;
+}
+
+/**
+ * @brief Extension and `Content-Type` of a slot of MIME type table
+ */
+struct http_mime_type {
+    const char *extension;
+    const char *type;
+};
+
+/**
+ * @brief Maximum length of extensions in MIME type table (`woff2`). Longer extensions are not hashed.
+ */
+#define HTTP_MIME_EXTENSION_MAX_LENGTH 5
+
+/**
+ * @brief Slot of lower-cased `extension` of `length` bytes. Constants are chosen so that no two extensions of the table collide.
+ */
+static unsigned int http_mime_slot(const char *extension, size_t length) {
+    const unsigned int first = tolower((unsigned char)extension[0]);
+    const unsigned int middle = tolower((unsigned char)extension[length / 2]);
+    const unsigned int last = tolower((unsigned char)extension[length - 1]);
+
+    return (first * 13 + last * 48 + (unsigned int)length * 15 + middle) & (HTTP_MIME_TABLE_SIZE - 1);
+}
 
+/**
+ * @brief MIME types of static files, each placed at `http_mime_slot` of its extension. Text types are sent as UTF-8.
+ * @note Adding an extension requires a slot not taken, or other constants of `http_mime_slot`. `test_http_mime_type` checks every slot.
+ */
+static const struct http_mime_type http_mime_types[HTTP_MIME_TABLE_SIZE] = {
+    [  1] = {"bz2",   "application/x-bzip2"},
+    [  3] = {"js",    "text/javascript; charset=utf-8"},
+    [  7] = {"ogg",   "audio/ogg"},
+    [  9] = {"c",     "text/x-c; charset=utf-8"},
+    [ 14] = {"yaml",  "application/yaml"},
+    [ 16] = {"xz",    "application/x-xz"},
+    [ 18] = {"zst",   "application/zstd"},
+    [ 20] = {"bmp",   "image/bmp"},
+    [ 23] = {"map",   "application/json"},
+    [ 25] = {"webm",  "video/webm"},
+    [ 27] = {"png",   "image/png"},
+    [ 28] = {"woff2", "font/woff2"},
+    [ 36] = {"cpp",   "text/x-c++; charset=utf-8"},
+    [ 37] = {"ttf",   "font/ttf"},
+    [ 41] = {"webp",  "image/webp"},
+    [ 42] = {"wasm",  "application/wasm"},
+    [ 45] = {"json",  "application/json"},
+    [ 48] = {"mjs",   "text/javascript; charset=utf-8"},
+    [ 49] = {"html",  "text/html; charset=utf-8"},
+    [ 50] = {"avif",  "image/avif"},
+    [ 51] = {"gz",    "application/gzip"},
+    [ 53] = {"ico",   "image/x-icon"},
+    [ 54] = {"mp3",   "audio/mpeg"},
+    [ 55] = {"css",   "text/css; charset=utf-8"},
+    [ 57] = {"wav",   "audio/wav"},
+    [ 63] = {"h",     "text/x-c; charset=utf-8"},
+    [ 67] = {"7z",    "application/x-7z-compressed"},
+    [ 71] = {"csv",   "text/csv; charset=utf-8"},
+    [ 72] = {"zip",   "application/zip"},
+    [ 73] = {"txt",   "text/plain; charset=utf-8"},
+    [ 74] = {"svg",   "image/svg+xml"},
+    [ 75] = {"md",    "text/markdown; charset=utf-8"},
+    [ 77] = {"woff",  "font/woff"},
+    [ 79] = {"jpg",   "image/jpeg"},
+    [ 82] = {"tar",   "application/x-tar"},
+    [ 83] = {"jpeg",  "image/jpeg"},
+    [ 88] = {"tgz",   "application/gzip"},
+    [ 89] = {"htm",   "text/html; charset=utf-8"},
+    [ 93] = {"sh",    "text/x-shellscript; charset=utf-8"},
+    [ 97] = {"pdf",   "application/pdf"},
+    [100] = {"otf",   "font/otf"},
+    [101] = {"hpp",   "text/x-c++; charset=utf-8"},
+    [102] = {"mp4",   "video/mp4"},
+    [113] = {"gif",   "image/gif"},
+    [114] = {"xml",   "application/xml"},
+    [119] = {"py",    "text/x-python; charset=utf-8"},
+    [127] = {"yml",   "application/yaml"},
+};
+
+int find_http_mime_type(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(slash ? slash : path, '.');
+
+    if (dot == NULL || dot[1] == '\0')
+        return -1;
+
+    const char *extension = dot + 1;
+    const size_t length = strlen(extension);
+    if (length > HTTP_MIME_EXTENSION_MAX_LENGTH)
+        return -1;
+
+    const unsigned int slot = http_mime_slot(extension, length);
+    if (http_mime_types[slot].extension == NULL || strcasecmp(http_mime_types[slot].extension, extension) != 0)
+        return -1;
+    return (int)slot;
+}
+
+const char *get_http_mime_type(int slot) {
+    if (slot < 0 || slot >= HTTP_MIME_TABLE_SIZE)
         return NULL;
+    return http_mime_types[slot].type;
+}
+
+/**
+ * @brief Parse a decimal position of `Range` at `*cursor`, and advance `*cursor` past it.
+ *
+ * @return 0 on success, -1 if there is no digit or the number overflows
+ */
+static int parse_range_position(const char **cursor, unsigned long long *position) {
+    char *end;
+
+    if (**cursor < '0' || **cursor > '9')
+        return -1;
+    errno = 0;
+    *position = strtoull(*cursor, &end, 10);
+    if (errno == ERANGE)
+        return -1;
+    *cursor = end;
+    return 0;
+}
+
+int parse_http_range(const char *value, off_t size, struct http_byte_range *ranges, int max_ranges) {
+    const unsigned long long    length = (unsigned long long)size;
+    int                         count = 0;
+    int                         specs = 0;
+
+    if (strncasecmp(value, "bytes=", 6) != 0)
+        return -1;
+    value += 6;
+
+    while (1) {
+        unsigned long long first, last;
+
+        while (*value == ' ' || *value == '\t' || *value == ',')
+            value++;
+        if (*value == '\0')
+            break;
+        if (++specs > max_ranges)
+            return -1;
+
+        if (*value == '-') {
+            /* suffix range: the last N bytes */
+            unsigned long long suffix;
+            value++;
+            if (parse_range_position(&value, &suffix) == -1)
+                return -1;
+            first = suffix < length ? length - suffix : 0;
+            last = length - 1;
+            if (suffix == 0 || length == 0)
+                first = length;
+        } else {
+            if (parse_range_position(&value, &first) == -1 || *value++ != '-')
+                return -1;
+            if (*value >= '0' && *value <= '9') {
+                if (parse_range_position(&value, &last) == -1 || last < first)
+                    return -1;
+            } else {
+                last = length - 1;
+            }
+            if (last >= length)
+                last = length - 1;
+        }
+
+        while (*value == ' ' || *value == '\t')
+            value++;
+        if (*value != ',' && *value != '\0')
+            return -1;
+
+        /* unsatisfiable range is dropped, but the others are still served */
+        if (first < length)
+            ranges[count++] = (struct http_byte_range) {(off_t)first, (off_t)last};
     }
+    return specs == 0 ? -1 : count;
+}
+
+bool match_http_if_range(const struct http_request *request, const char *etag, time_t last_modified) {
+    const struct http_header    *condition = find_http_request_header(request, "If-Range");
+    time_t                      date;
+
+    if (condition == NULL)
+        return true;
+    if (parse_http_date(condition->value, &date) == 0)
+        return date == last_modified;
+
+    /* strong comparison: weak tags never match, and `*` or lists are not allowed */
+    if (strncmp(condition->value, "W/", 2) == 0 || strchr(condition->value, ',') != NULL)
+        return false;
+    return strcmp(condition->value, "*") != 0 && match_http_etag(condition->value, etag);
+}
+
+size_t format_http_range_delimiter(char *buffer, const struct http_byte_ranges *ranges, int index) {
+    if (index == ranges->count)
+        return snprintf(buffer, HTTP_RANGE_DELIMITER_MAX_LENGTH, "\r\n--%s--\r\n", ranges->boundary);
+
+    return snprintf(buffer, HTTP_RANGE_DELIMITER_MAX_LENGTH, "\r\n--%s\r\n%s%s%sContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                    ranges->boundary,
+                    ranges->content_type ? "Content-Type: " : "", ranges->content_type ? ranges->content_type : "", ranges->content_type ? "\r\n" : "",
+                    (long long)ranges->items[index].first, (long long)ranges->items[index].last, (long long)ranges->size);
+}
 
-    // 최종 문자열 생성
-    char *response_string = (char *)malloc(required_len + 1);
-    if (!response_string) {
-         if (header_string != NULL) {
-            free(header_string);
+int init_http_output_buffer(struct http_output_buffer *buffer, size_t capacity) {
+    *buffer = (struct http_output_buffer) {
+        .data = (char *)malloc(capacity),
+        .length = 0,
+        .head_length = 0,
+        .capacity = capacity
+    };
+
+    if (buffer->data == NULL) {
+        buffer->capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void destruct_http_output_buffer(struct http_output_buffer *buffer) {
+    free(buffer->data);
+    *buffer = (struct http_output_buffer) {};
+}
+
+/**
+ * @brief Make `buffer` hold at least `required` bytes, growing twice at least. Contents are kept.
+ */
+static int reserve_http_output_buffer(struct http_output_buffer *buffer, size_t required) {
+    if (required <= buffer->capacity)
+        return 0;
+
+    size_t new_capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+    while (new_capacity < required)
+        new_capacity *= 2;
+
+    char *new_data = (char *)realloc(buffer->data, new_capacity);
+    if (new_data == NULL)
+        return -1;
+
+    buffer->data = new_data;
+    buffer->capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Check `headers` has `key`, ignoring case as HTTP field names do.
+ */
+static bool has_header_ignoring_case(const struct http_headers *headers, const char *key) {
+    for (int i = 0; i < headers->size; i++) {
+        if (headers->items[i] && headers->items[i]->key && strcasecmp(headers->items[i]->key, key) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Byte length of body of `response`. 0 if it is streamed. Parts of `multipart/byteranges` are counted with their delimiters.
+ */
+static size_t http_response_body_length(const struct http_response *response) {
+    if (response->stream)
+        return 0;
+    if (response->body_type == HTTP_BODY_FILE && response->ranges) {
+        char    delimiter[HTTP_RANGE_DELIMITER_MAX_LENGTH];
+        size_t  length = format_http_range_delimiter(delimiter, response->ranges, response->ranges->count);
+
+        for (int i = 0; i < response->ranges->count; i++) {
+            length += format_http_range_delimiter(delimiter, response->ranges, i);
+            length += (size_t)(response->ranges->items[i].last - response->ranges->items[i].first + 1);
         }
+        return length;
+    }
+    if (response->body_type == HTTP_BODY_FILE)
+        return response->body_length;
+    if (response->body == NULL)
+        return 0;
+    return response->body_length ? response->body_length : strlen(response->body);
+}
+
+/**
+ * @brief Serialize `response` as `build_http_response` does. `Date` line is written only if `with_date` is true,
+ * and body is copied only if `with_body` is true. Streamed body is framed by chunks unless `request_version` is HTTP/1.0.
+ */
+static ssize_t serialize_http_response(struct http_output_buffer *buffer, const struct http_response *response,
+                                       enum http_version request_version, bool with_date, bool with_body) {
+    char unknown_line[32];
+    char content_length_line[48];
+    char date_line[HTTP_DATE_LINE_LENGTH];
+    const char *status_line;
+    size_t status_line_length;
+
+    if (response->status_code >= 0 && response->status_code < 600 && http_status_lines[response->status_code].line) {
+        status_line = http_status_lines[response->status_code].line;
+        status_line_length = http_status_lines[response->status_code].length;
+    } else {
+        status_line_length = snprintf(unknown_line, sizeof(unknown_line), "%d Unknown Status\r\n", (int)response->status_code);
+        status_line = unknown_line;
+    }
+
+    const char *version_prefix = response->http_version >= HTTP_1_0 && response->http_version <= HTTP_3_0
+        ? http_version_prefixes[response->http_version]
+        : http_version_prefixes[HTTP_1_1];
+
+    const size_t header_set_length = response->header_set ? response->header_set->length : 0;
+    const size_t headers_length = response->headers.items ? http_headers_length(&response->headers) : 0;
+    /* streamed body and file body are written later by the server */
+    const size_t body_length = http_response_body_length(response);
+    const size_t copied_body_length = response->body_type == HTTP_BODY_FILE || !with_body ? 0 : body_length;
+
+    /* line may be rewritten by the timer thread meanwhile, so it is copied once here */
+    const size_t date_line_length = with_date && copy_http_date_line(date_line) ? HTTP_DATE_LINE_LENGTH : 0;
+
+    /* body is framed by its measured length, so that clients need not wait for the connection to close */
+    size_t content_length_line_length = 0;
+    const bool bodiless_status = (response->status_code >= 100 && response->status_code < 200)
+        || response->status_code == HTTP_NO_CONTENT || response->status_code == HTTP_NOT_MODIFIED;
+    if (response->stream) {
+        /* HTTP/1.0 client does not know chunked coding, and its body ends when the connection is closed */
+        if (request_version != HTTP_1_0)
+            content_length_line_length = snprintf(content_length_line, sizeof(content_length_line), "Transfer-Encoding: chunked\r\n");
+    } else if (!bodiless_status && !(response->headers.items && has_header_ignoring_case(&response->headers, "Content-Length")))
+        content_length_line_length = snprintf(content_length_line, sizeof(content_length_line), "Content-Length: %zu\r\n", body_length);
+
+    /* everything is measured first, so that buffer grows at most once */
+    const size_t head_length = HTTP_VERSION_PREFIX_LENGTH + status_line_length + date_line_length
+        + header_set_length + headers_length + content_length_line_length + 2;
+    const size_t total_length = head_length + copied_body_length;
+
+    if (reserve_http_output_buffer(buffer, total_length + 1) == -1)
+        return -1;
+
+    char *cursor = buffer->data;
+
+    memcpy(cursor, version_prefix, HTTP_VERSION_PREFIX_LENGTH);
+    cursor += HTTP_VERSION_PREFIX_LENGTH;
+    memcpy(cursor, status_line, status_line_length);
+    cursor += status_line_length;
+    if (date_line_length) {
+        memcpy(cursor, date_line, date_line_length);
+        cursor += date_line_length;
+    }
+    if (header_set_length) {
+        memcpy(cursor, response->header_set->data, header_set_length);
+        cursor += header_set_length;
+    }
+    if (headers_length)
+        cursor = write_http_headers(cursor, &response->headers);
+    if (content_length_line_length) {
+        memcpy(cursor, content_length_line, content_length_line_length);
+        cursor += content_length_line_length;
+    }
+    memcpy(cursor, "\r\n", 2);
+    cursor += 2;
+    if (copied_body_length) {
+        memcpy(cursor, response->body, copied_body_length);
+        cursor += copied_body_length;
+    }
+    *cursor = '\0';
+
+    buffer->length = total_length;
+    buffer->head_length = head_length;
+    return (ssize_t)total_length;
+}
+
+ssize_t build_http_response(struct http_output_buffer *buffer, const struct http_response *response) {
+    return serialize_http_response(buffer, response, response->http_version, true, true);
+}
+
+ssize_t build_http_response_head(struct http_output_buffer *buffer, const struct http_response *response, enum http_version request_version) {
+    return serialize_http_response(buffer, response, request_version, true, false);
+}
+
+struct http_canned_response *create_http_canned_response(const struct http_response *response) {
+    struct http_output_buffer buffer = {};
+
+    if (response->stream || response->websocket || response->body_type == HTTP_BODY_FILE)
+        return NULL;
+
+    /* `Date` changes every second, so it is written per request after the status line */
+    if (serialize_http_response(&buffer, response, response->http_version, false, true) == -1) {
+        destruct_http_output_buffer(&buffer);
+        return NULL;
+    }
 
+    struct http_canned_response *canned = (struct http_canned_response *)malloc(sizeof(struct http_canned_response) + buffer.length + 1);
+    if (canned == NULL) {
+        destruct_http_output_buffer(&buffer);
         return NULL;
     }
 
-    snprintf(response_string, required_len + 1, "%s %d %s\r\n%s\r\n%s",
-             version_string,
-             http_response.status_code,
-             status_code_string,
-             header_string != NULL ? header_string : "",
-             body);
+    memcpy(canned->data, buffer.data, buffer.length + 1);
+    canned->length = buffer.length;
+    canned->head_length = buffer.head_length;
+    canned->status_line_length = strstr(buffer.data, "\r\n") + 2 - buffer.data;
+    atomic_init(&canned->references, 1);
+
+    destruct_http_output_buffer(&buffer);
+    return canned;
+}
+
+struct http_canned_response *retain_http_canned_response(struct http_canned_response *canned) {
+    if (canned)
+        atomic_fetch_add_explicit(&canned->references, 1, memory_order_relaxed);
+    return canned;
+}
+
+void release_http_canned_response(struct http_canned_response *canned) {
+    if (canned && atomic_fetch_sub_explicit(&canned->references, 1, memory_order_acq_rel) == 1)
+        free(canned);
+}
+
+char* http_response_stringify(struct http_response http_response) {
+    struct http_output_buffer buffer = {};
+
+    if (build_http_response(&buffer, &http_response) == -1) {
+        destruct_http_output_buffer(&buffer);
+        return NULL;
+    }
+    return buffer.data;
+}
+
+struct http_header_set *create_http_header_set(const struct http_headers *headers) {
+    const size_t length = http_headers_length(headers);
+
+    struct http_header_set *header_set = (struct http_header_set *)malloc(sizeof(struct http_header_set) + length + 1);
+    if (header_set == NULL)
+        return NULL;
+
+    *write_http_headers(header_set->data, headers) = '\0';
+
+    header_set->length = length;
+    atomic_init(&header_set->references, 1);
+
+    return header_set;
+}
+
+struct http_header_set *retain_http_header_set(struct http_header_set *header_set) {
+    if (header_set)
+        atomic_fetch_add_explicit(&header_set->references, 1, memory_order_relaxed);
+    return header_set;
+}
+
+void release_http_header_set(struct http_header_set *header_set) {
+    if (header_set && atomic_fetch_sub_explicit(&header_set->references, 1, memory_order_acq_rel) == 1)
+        free(header_set);
+}
+
+/**
+ * @brief Character classes of RFC 9112 request line, indexed by byte value.
+ */
+enum http_char_class {
+    HTTP_CHAR_TOKEN     = 1 << 0,   // tchar of `token`
+    HTTP_CHAR_TARGET    = 1 << 1    // pchar, '/', '?' of `origin-form` (includes '%' of pct-encoded)
+};
+
+static const unsigned char http_char_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 3, 0, 1, 3, 3, 3, 3, 2, 2, 3, 3, 2, 3, 3, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 0, 2, 0, 2,
+    2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 1, 3,
+    1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 1, 0, 3, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+/**
+ * @brief Load 4 bytes as little-endian word. Compilers fold this into a single load on little-endian machines.
+ */
+static inline uint32_t load_word4(const char *p) {
+    const unsigned char *u = (const unsigned char *)p;
+    return (uint32_t)u[0] | (uint32_t)u[1] << 8 | (uint32_t)u[2] << 16 | (uint32_t)u[3] << 24;
+}
+
+/**
+ * @brief Load 8 bytes as little-endian word.
+ */
+static inline uint64_t load_word8(const char *p) {
+    return (uint64_t)load_word4(p) | (uint64_t)load_word4(p + 4) << 32;
+}
+
+#define WORD4(a, b, c, d) \
+    ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+#define WORD8(a, b, c, d, e, f, g, h) \
+    ((uint64_t)WORD4(a, b, c, d) | (uint64_t)WORD4(e, f, g, h) << 32)
+
+/**
+ * @brief Multiplier of perfect hash from the first 4 bytes of a method to `method_table` slot.
+ */
+#define METHOD_HASH_MULTIPLIER 0x2265b1f5u
+#define METHOD_HASH(word4) ((uint32_t)((word4) * METHOD_HASH_MULTIPLIER) >> 29)
+
+/**
+ * @brief Slot of `method_table`. A method matches when `(first 8 bytes & mask) == word`.
+ * `word` includes the SP which follows the method.
+ */
+struct method_entry {
+    uint64_t            mask;
+    uint64_t            word;
+    enum http_method    method;
+    int                 length;
+};
+
+static const struct method_entry method_table[8] = {
+    [0] = { 0x0000FFFFFFFFFFFFull, WORD8('P', 'A', 'T', 'C', 'H', ' ', 0, 0),     HTTP_PATCH,     5 },
+    [1] = { 0x000000FFFFFFFFFFull, WORD8('P', 'O', 'S', 'T', ' ', 0, 0, 0),       HTTP_POST,      4 },
+    [2] = { 0x000000FFFFFFFFFFull, WORD8('H', 'E', 'A', 'D', ' ', 0, 0, 0),       HTTP_HEAD,      4 },
+    [3] = { 0x00FFFFFFFFFFFFFFull, WORD8('D', 'E', 'L', 'E', 'T', 'E', ' ', 0),   HTTP_DELETE,    6 },
+    [4] = { 0x00000000FFFFFFFFull, WORD8('P', 'U', 'T', ' ', 0, 0, 0, 0),         HTTP_PUT,       3 },
+    [5] = { 0xFFFFFFFFFFFFFFFFull, WORD8('O', 'P', 'T', 'I', 'O', 'N', 'S', ' '), HTTP_OPTIONS,   7 },
+    [6] = { 0, 1, HTTP_METHOD_UNKNOWN, 0 }, /* never matches */
+    [7] = { 0x00000000FFFFFFFFull, WORD8('G', 'E', 'T', ' ', 0, 0, 0, 0),         HTTP_GET,       3 },
+};
+
+/**
+ * @brief Match method at the start of `word` (first 8 bytes of request line) without branching.
+ *
+ * @param length out parameter, set to length of matched method. 0 if no match.
+ */
+static inline enum http_method match_method_word(uint64_t word, int *length) {
+    const struct method_entry *entry = &method_table[METHOD_HASH((uint32_t)word)];
+    const int matched = (word & entry->mask) == entry->word;
+
+    *length = entry->length & -matched;
+    return matched ? entry->method : HTTP_METHOD_UNKNOWN;
+}
+
+/**
+ * @brief Match `HTTP/x.y` packed in `word`.
+ */
+static inline enum http_version match_version_word(uint64_t word) {
+    /* HTTP/?.? with the two digits masked out */
+    const uint64_t mask = 0x00FF00FFFFFFFFFFull;
+    const uint64_t prefix = WORD8('H', 'T', 'T', 'P', '/', 0, '.', 0);
+    static const enum http_version versions[4][2] = {
+        { HTTP_VERSION_UNKNOWN, HTTP_VERSION_UNKNOWN },
+        { HTTP_1_0,             HTTP_1_1 },
+        { HTTP_2_0,             HTTP_VERSION_UNKNOWN },
+        { HTTP_3_0,             HTTP_VERSION_UNKNOWN },
+    };
+    const unsigned major = (unsigned)((word >> 40) & 0xFF) - '0';
+    const unsigned minor = (unsigned)((word >> 56) & 0xFF) - '0';
 
-    if (header_string != NULL) {
-        free(header_string);
+    if ((word & mask) != prefix || major > 3 || minor > 1)
+        return HTTP_VERSION_UNKNOWN;
+    return versions[major][minor];
+}
+
+int parse_http_request_line(const char *line, size_t length, struct http_request_line *request_line) {
+    /* shortest possible request line is `GET / HTTP/1.1\r\n` */
+    if (length < sizeof("GET / HTTP/1.1\r\n") - 1)
+        return -1;
+
+    size_t  offset;
+    int     method_length;
+    enum http_method method = match_method_word(load_word8(line), &method_length);
+
+    /* state: method. Unregistered methods are still valid `token`s */
+    offset = (size_t)method_length;
+    if (method_length == 0) {
+        while (offset < length && (http_char_class[(unsigned char)line[offset]] & HTTP_CHAR_TOKEN))
+            offset++;
+        if (offset == 0)
+            return -1;
+    }
+    if (offset >= length || line[offset] != ' ')
+        return -1;
+    offset++;
+
+    /* state: request-target */
+    const size_t target_start = offset;
+    size_t path_length = SIZE_MAX;
+    while (offset < length && (http_char_class[(unsigned char)line[offset]] & HTTP_CHAR_TARGET)) {
+        if (line[offset] == '?' && path_length == SIZE_MAX)
+            path_length = offset - target_start;
+        offset++;
     }
+    if (offset == target_start || offset >= length || line[offset] != ' ')
+        return -1;
+    if (path_length == SIZE_MAX)
+        path_length = offset - target_start;
+    const size_t target_length = offset - target_start;
+    offset++;
+
+    /* state: HTTP-version CRLF */
+    if (length - offset < 10 || line[offset + 8] != '\r' || line[offset + 9] != '\n')
+        return -1;
+    enum http_version version = match_version_word(load_word8(line + offset));
+    if (version == HTTP_VERSION_UNKNOWN)
+        return -1;
 
-    return response_string;
+    *request_line = (struct http_request_line) {
+        .method = method,
+        .version = version,
+        .target = line + target_start,
+        .target_length = target_length,
+        .path_length = path_length,
+        .length = offset + 10
+    };
+    return 0;
 }
 
 enum http_method parse_http_method(const char *method) {
-    if (strcmp(method, "GET") == 0) return HTTP_GET;
-    if (strcmp(method, "POST") == 0) return HTTP_POST;
-    if (strcmp(method, "PUT") == 0) return HTTP_PUT;
-    if (strcmp(method, "DELETE") == 0) return HTTP_DELETE;
-    if (strcmp(method, "OPTIONS") == 0) return HTTP_OPTIONS;
-    return HTTP_METHOD_UNKNOWN;
+    /* pad with SP and NULs to the packed form used by `method_table` */
+    char    padded[8] = {0};
+    size_t  length = strnlen(method, sizeof(padded));
+    int     method_length;
+
+    if (length == sizeof(padded))
+        return HTTP_METHOD_UNKNOWN;
+    memcpy(padded, method, length);
+    padded[length] = ' ';
+
+    enum http_method parsed = match_method_word(load_word8(padded), &method_length);
+    return (size_t)method_length == length ? parsed : HTTP_METHOD_UNKNOWN;
 }
 
 char* http_method_stringify(const enum http_method method) {
-    if (method == HTTP_GET) return "GET";
-    if (method == HTTP_POST) return "POST";
-    if (method == HTTP_PUT) return "PUT";
-    if (method == HTTP_DELETE) return "DELETE";
-    if (method == HTTP_OPTIONS) return "OPTIONS";
+    static char *names[] = {
+        [HTTP_GET]      = "GET",
+        [HTTP_POST]     = "POST",
+        [HTTP_PUT]      = "PUT",
+        [HTTP_DELETE]   = "DELETE",
+        [HTTP_OPTIONS]  = "OPTIONS",
+        [HTTP_PATCH]    = "PATCH",
+        [HTTP_HEAD]     = "HEAD"
+    };
+    if ((unsigned)method < HTTP_METHOD_UNKNOWN)
+        return names[method];
     return "UNKNOWN";
 }
 
 enum http_version parse_http_version(const char *version) {
-    if (strcmp(version, "HTTP/1.0") == 0) return HTTP_1_0;
-    if (strcmp(version, "HTTP/1.1") == 0) return HTTP_1_1;
-    if (strcmp(version, "HTTP/2.0") == 0) return HTTP_2_0;
-    if (strcmp(version, "HTTP/3.0") == 0) return HTTP_3_0;
-    return HTTP_VERSION_UNKNOWN;
+    if (strnlen(version, 9) != 8)
+        return HTTP_VERSION_UNKNOWN;
+    return match_version_word(load_word8(version));
 }
 
 char* http_version_stringify(const enum http_version version) {
@@ -649,174 +1607,303 @@ char* http_version_stringify(const enum http_version version) {
 }
 
 char* http_status_code_stringify(const enum http_status_code code) {
-    // 2xx Success
-    if (code == HTTP_OK) return "OK";
-    if (code == HTTP_CREATED) return "Created";
-    if (code == HTTP_ACCEPTED) return "Accepted";
-    if (code == HTTP_NO_CONTENT) return "No Content";
-
-    // 3xx Redirection
-    if (code == HTTP_MOVED_PERMANENTLY) return "Moved Permanently";
-    if (code == HTTP_FOUND) return "Found";
-    if (code == HTTP_NOT_MODIFIED) return "Not Modified";
-    if (code == HTTP_TEMPORARY_REDIRECT) return "Temporary Redirect";
-    if (code == HTTP_PERMANENT_REDIRECT) return "Permanent Redirect";
-
-    // 4xx Client Errors
-    if (code == HTTP_BAD_REQUEST) return "Bad Request";
-    if (code == HTTP_UNAUTHORIZED) return "Unauthorized";
-    if (code == HTTP_FORBIDDEN) return "Forbidden";
-    if (code == HTTP_NOT_FOUND) return "Not Found";
-    if (code == HTTP_METHOD_NOT_ALLOWED) return "Method Not Allowed";
-    if (code == HTTP_REQUEST_TIMEOUT) return "Request Timeout";
-    if (code == HTTP_CONFLICT) return "Conflict";
-    if (code == HTTP_GONE) return "Gone";
-    if (code == HTTP_LENGTH_REQUIRED) return "Length Required";
-    if (code == HTTP_PAYLOAD_TOO_LARGE) return "Payload Too Large";
-    if (code == HTTP_URI_TOO_LONG) return "URI Too Long";
-    if (code == HTTP_UNSUPPORTED_MEDIA_TYPE) return "Unsupported Media Type";
-    if (code == HTTP_TOO_MANY_REQUESTS) return "Too Many Requests";
-
-    // 5xx Server Errors
-    if (code == HTTP_INTERNAL_SERVER_ERROR) return "Internal Server Error";
-    if (code == HTTP_NOT_IMPLEMENTED) return "Not Implemented";
-    if (code == HTTP_BAD_GATEWAY) return "Bad Gateway";
-    if (code == HTTP_SERVICE_UNAVAILABLE) return "Service Unavailable";
-    if (code == HTTP_GATEWAY_TIMEOUT) return "Gateway Timeout";
-    if (code == HTTP_HTTP_VERSION_NOT_SUPPORTED) return "HTTP Version Not Supported";
+    if (code >= 0 && code < 600 && http_status_lines[code].reason)
+        return (char *)http_status_lines[code].reason;
 
     return "Unknown Status";
 }
 
-int init_http_request(
-    struct http_request             *request,
-    struct http_headers             headers,
-    enum http_method                method,
-    enum http_version               version,
-    char                            *body,
-    char                            *path,
-    struct http_query_parameters    query_parameters
-) {
-    // 요청 구조체가 NULL이면 실패
-    if (request == NULL) {
-        return -1;
-    }
-
-    request->headers = headers;
-    request->method = method;
-    request->version = version;
-    request->body = body ? strdup(body) : NULL;
-    request->path = path ? strdup(path) : NULL;
-    request->query_parameters = query_parameters;
-
-    return 0; // 성공
-}
-
 struct http_request *parse_http_request(const char *request) {
-    struct http_request *http_request = (struct http_request *)malloc(sizeof(struct http_request));
-    struct http_headers http_headers = {};
-    struct http_query_parameters http_query_parameters = {};
-
-    memset(http_request, 0, sizeof(struct http_request));
+    return parse_http_request_bytes(request, strlen(request));
+}
 
-    char *request_buffer = strdup(request);
-    const char *header_start;
+struct http_request *parse_http_request_bytes(const char *request, size_t length) {
+    struct http_request_line request_line;
 
     /* end of http start line */
-    char *request_line = strstr(request_buffer, "\r\n");
-    if (request_line == NULL) {
-        free(http_request);
+    const char *end_of_request_line = strstr(request, "\r\n");
+    if (end_of_request_line == NULL)
         return NULL;
-    }
-    *request_line = '\0';
-    header_start = request + (int)(request_line - request_buffer);
 
-    char *method = request_buffer;
-    if (!method) {
-        free(http_request);
+    if (parse_http_request_line(request, (size_t)(end_of_request_line - request) + 2, &request_line) == -1)
         return NULL;
-    }
-    char *path_with_query = strstr(request_buffer, " ");
-    if (!path_with_query) {
-        free(http_request);
+
+    /* search from CRLF of request line, so that a request without headers is handled */
+    const char *end_of_headers = strstr(end_of_request_line, "\r\n\r\n");
+    if (end_of_headers == NULL || (size_t)(end_of_headers - request) + 4 > length)
+        return NULL;
+
+    /* request and its cache are allocated at once */
+    struct http_request *http_request = (struct http_request *)malloc(sizeof(struct http_request) + sizeof(struct http_request_cache));
+    if (http_request == NULL)
         return NULL;
-    }
-    *path_with_query = '\0';
-    path_with_query++;
 
-    char *version = strstr(path_with_query, " ");
-    if (!version) {
+    char *path = strndup(request_line.target, request_line.path_length);
+    if (path == NULL) {
         free(http_request);
         return NULL;
     }
-    *version = '\0';
-    version++;
 
+    const size_t header_offset = request_line.length;
+    const size_t body_offset = (size_t)(end_of_headers - request) + 4;
+    const bool has_query = request_line.path_length < request_line.target_length;
+
+    *http_request = (struct http_request) {
+        .method = request_line.method,
+        .version = request_line.version,
+        .path = path,
+        .raw = request,
+        .header_offset = header_offset,
+        /* include CRLF of last header line */
+        .header_length = end_of_headers == end_of_request_line ? 0 : body_offset - 2 - header_offset,
+        .query_offset = has_query ? (size_t)(request_line.target - request) + request_line.path_length + 1 : 0,
+        .query_length = has_query ? request_line.target_length - request_line.path_length - 1 : 0,
+        .body_offset = body_offset,
+        .body_length = length - body_offset,
+        .cache = (struct http_request_cache *)(http_request + 1)
+    };
+    *http_request->cache = (struct http_request_cache) {
+        .decoded = 0
+    };
 
-    enum http_method parsed_method = parse_http_method(method);
-    enum http_version parsed_version = parse_http_version(version);
+    return http_request;
+}
 
-    // 경로와 쿼리 파라미터 분리
-    char *query = NULL;
-    char *query_start = strchr(path_with_query + 1, '?');
+struct http_headers *get_http_request_headers(const struct http_request *request) {
+    struct http_request_cache *cache = request->cache;
 
-    if (query_start) {
-        *query_start = '\0'; // '?'를 '\0'으로 변경하여 경로와 쿼리 분리
-        query = strdup(query_start + 1);
+    if (!(cache->decoded & HTTP_REQUEST_HEADERS)) {
+        /* `parse_http_headers` stops at the empty line, so raw request can be parsed without copying */
+        cache->headers = request->header_length
+            ? parse_http_headers((char *)request->raw + request->header_offset)
+            : (struct http_headers) {};
+        cache->decoded |= HTTP_REQUEST_HEADERS;
     }
+    return &cache->headers;
+}
 
-    char *path = strdup(path_with_query);
+struct http_header *find_http_request_header(const struct http_request *request, const char *key) {
+    struct http_headers *headers = get_http_request_headers(request);
 
-    // 헤더와 본문 파싱
-    char *header = NULL;
-    char *body = NULL;
+    for (int i = 0; i < headers->size; i++) {
+        if (strcasecmp(headers->items[i]->key, key) == 0)
+            return headers->items[i];
+    }
+    return NULL;
+}
 
-    if (header_start) {
-        header_start += 2; // "\r\n" 건너뛰기
-        char *body_start = strstr(header_start, "\r\n\r\n");
-        if (!body_start) {
-            free(http_request);
-            return NULL;
+struct http_query_parameters *get_http_request_query_parameters(const struct http_request *request) {
+    struct http_request_cache *cache = request->cache;
+
+    if (!(cache->decoded & HTTP_REQUEST_QUERY_PARAMETERS)) {
+        cache->query_parameters = (struct http_query_parameters) {};
+        if (request->query_length) {
+            char *query = strndup(request->raw + request->query_offset, request->query_length);
+            if (query) {
+                cache->query_parameters = parse_query_parameters(query);
+                free(query);
+            }
         }
+        cache->decoded |= HTTP_REQUEST_QUERY_PARAMETERS;
+    }
+    return &cache->query_parameters;
+}
 
-        size_t header_len = body_start - header_start + 2;
-        header = malloc(header_len + 1);
+struct http_query_parameter *find_http_request_query_parameter(const struct http_request *request, const char *key) {
+    return find_query_parameter(get_http_request_query_parameters(request), (char *)key);
+}
 
-        if (header) {
-            memcpy(header, header_start, header_len); // 헤더 복사
-            header[header_len] = '\0';
-        }
+const char *get_http_request_body(const struct http_request *request) {
+    return request->raw + request->body_offset;
+}
+
+size_t get_http_request_body_length(const struct http_request *request) {
+    return request->body_length;
+}
 
-        body_start += 4;
-        body = strdup(body_start); // 내용 복사
+const char *find_http_request_path_parameter(const struct http_request *request, const char *name, size_t *length) {
+    const struct http_path_parameters *parameters = &request->cache->path_parameters;
+    const size_t name_length = strlen(name);
+
+    for (int i = 0; i < parameters->size; i++) {
+        const struct http_path_parameter *parameter = &parameters->items[i];
+
+        if (parameter->name_length == name_length && memcmp(parameter->name, name, name_length) == 0) {
+            if (length)
+                *length = parameter->value_length;
+            return parameter->value;
+        }
     }
+    return NULL;
+}
 
-    http_headers = header != NULL
-        ? parse_http_headers(header)
-        : http_headers;
+const char *scan_http_header(const char *headers, size_t length, const char *key, size_t *value_length) {
+    const size_t key_length = strlen(key);
+    const char *line = headers;
+    const char *end = headers + length;
 
+    while (line < end) {
+        const char *end_of_line = memmem(line, end - line, "\r\n", 2);
+        if (end_of_line == NULL || end_of_line == line)
+            break;
 
-    http_query_parameters = query != NULL
-        ? parse_query_parameters(query)
-        : http_query_parameters;
+        if ((size_t)(end_of_line - line) > key_length
+            && line[key_length] == ':'
+            && strncasecmp(line, key, key_length) == 0) {
+            const char *value = line + key_length + 1;
+            const char *end_of_value = end_of_line;
 
-    // Http Request 초기화
-    init_http_request(
-        http_request,
-        http_headers,
-        parsed_method,
-        parsed_version,
-        body,
-        path,
-        http_query_parameters
-    );
+            /* trim prefix and suffix (OWS) */
+            while (value < end_of_value && (*value == ' ' || *value == '\t'))
+                value++;
+            while (end_of_value > value && (end_of_value[-1] == ' ' || end_of_value[-1] == '\t'))
+                end_of_value--;
 
-    // 동적 메모리 해제
-    free(request_buffer);
-    free(query);
-    free(header);
-    free(path);
-    free(body);
+            *value_length = (size_t)(end_of_value - value);
+            return value;
+        }
+        line = end_of_line + 2;
+    }
+    return NULL;
+}
 
-    return http_request;
-}
\ No newline at end of file
+void init_http_chunked_decoder(struct http_chunked_decoder *decoder) {
+    *decoder = (struct http_chunked_decoder) {
+        .state = HTTP_CHUNKED_SIZE
+    };
+}
+
+static inline int hex_digit_value(char ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+ssize_t decode_http_chunked(
+    struct http_chunked_decoder *decoder,
+    char                        *dst,
+    const char                  *src,
+    size_t                      length,
+    size_t                      *consumed
+) {
+    size_t read_len = 0;
+    size_t written = 0;
+
+    while (read_len < length
+        && decoder->state != HTTP_CHUNKED_DONE
+        && decoder->state != HTTP_CHUNKED_ERROR) {
+        const char ch = src[read_len];
+
+        switch (decoder->state) {
+        case HTTP_CHUNKED_SIZE: {
+            int digit = hex_digit_value(ch);
+            if (digit >= 0) {
+                /* chunk size overflows size_t */
+                if (decoder->chunk_remaining > (SIZE_MAX >> 4)) {
+                    decoder->state = HTTP_CHUNKED_ERROR;
+                    break;
+                }
+                decoder->chunk_remaining = (decoder->chunk_remaining << 4) | (size_t)digit;
+                decoder->size_digits++;
+            } else if (decoder->size_digits == 0) {
+                decoder->state = HTTP_CHUNKED_ERROR;
+                break;
+            } else if (ch == ';' || ch == ' ' || ch == '\t') {
+                decoder->state = HTTP_CHUNKED_SIZE_EXT;
+            } else if (ch == '\r') {
+                decoder->state = HTTP_CHUNKED_SIZE_LF;
+            } else {
+                decoder->state = HTTP_CHUNKED_ERROR;
+                break;
+            }
+            read_len++;
+            break;
+        }
+        case HTTP_CHUNKED_SIZE_EXT:
+            /* chunk extensions are ignored */
+            if (ch == '\r')
+                decoder->state = HTTP_CHUNKED_SIZE_LF;
+            read_len++;
+            break;
+        case HTTP_CHUNKED_SIZE_LF:
+            if (ch != '\n') {
+                decoder->state = HTTP_CHUNKED_ERROR;
+                break;
+            }
+            read_len++;
+            if (decoder->chunk_remaining == 0) {
+                /* last-chunk */
+                decoder->trailer_line_length = 0;
+                decoder->state = HTTP_CHUNKED_TRAILER;
+            } else {
+                decoder->state = HTTP_CHUNKED_DATA;
+            }
+            break;
+        case HTTP_CHUNKED_DATA: {
+            size_t n = length - read_len;
+            if (n > decoder->chunk_remaining)
+                n = decoder->chunk_remaining;
+
+            /* `dst + written` never passes `src + read_len`, so memmove is enough to decode in place */
+            memmove(dst + written, src + read_len, n);
+            written += n;
+            read_len += n;
+            decoder->chunk_remaining -= n;
+            decoder->decoded_length += n;
+
+            if (decoder->chunk_remaining == 0)
+                decoder->state = HTTP_CHUNKED_DATA_CR;
+            break;
+        }
+        case HTTP_CHUNKED_DATA_CR:
+            if (ch != '\r') {
+                decoder->state = HTTP_CHUNKED_ERROR;
+                break;
+            }
+            read_len++;
+            decoder->state = HTTP_CHUNKED_DATA_LF;
+            break;
+        case HTTP_CHUNKED_DATA_LF:
+            if (ch != '\n') {
+                decoder->state = HTTP_CHUNKED_ERROR;
+                break;
+            }
+            read_len++;
+            decoder->size_digits = 0;
+            decoder->state = HTTP_CHUNKED_SIZE;
+            break;
+        case HTTP_CHUNKED_TRAILER:
+            /* trailer fields are ignored */
+            if (ch == '\r')
+                decoder->state = HTTP_CHUNKED_TRAILER_LF;
+            else
+                decoder->trailer_line_length++;
+            read_len++;
+            break;
+        case HTTP_CHUNKED_TRAILER_LF:
+            if (ch != '\n') {
+                decoder->state = HTTP_CHUNKED_ERROR;
+                break;
+            }
+            read_len++;
+            if (decoder->trailer_line_length == 0) {
+                decoder->state = HTTP_CHUNKED_DONE;
+            } else {
+                decoder->trailer_line_length = 0;
+                decoder->state = HTTP_CHUNKED_TRAILER;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    *consumed = read_len;
+    if (decoder->state == HTTP_CHUNKED_ERROR)
+        return -1;
+    return (ssize_t)written;
+}
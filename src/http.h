@@ -13,6 +13,7 @@
 #include <fcntl.h>
 #include <sys/times.h>
 #include <sys/time.h>
+#include <time.h>
 #include <limits.h>
 #include <spawn.h>
 #include <pthread.h>
@@ -21,23 +22,39 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 enum http_status_code;
 enum http_method;
 enum http_version; 
+enum http_body_type;
 
 struct web_server;
 struct route;
 struct routes;
+struct route_node;
 struct http_header;
 struct http_headers;
 struct http_query_parameters;
 struct http_request;
 struct http_response;
+struct http_chunked_decoder;
+struct http_request_line;
+struct http_request_cache;
+struct http_header_set;
+struct http_output_buffer;
+struct http_canned_response;
+struct http_response_writer;
+struct websocket;
+struct http_byte_range;
+struct http_byte_ranges;
 
 
 /**
  * @brief Find the route correspond to path and http method.
+ * Lookup walks the radix tree of `routes`, so its cost is proportional to the length of `path`, not to the number of routes.
+ * A single trailing '/' is ignored as `url_path_cmp` does.
  * 
  * @param routes route table to search
  * @param path URL path to find
@@ -46,15 +63,31 @@ struct http_response;
  */
 struct route *find_route(const struct routes* routes, const char *path, enum http_method method);
 
+/**
+ * @brief Find the route correspond to path of `request` and `method`, and store path parameters captured by the route into `request`.
+ * Static segments take precedence over `:name` segments, and `:name` segments over `*` segments.
+ * 
+ * @param routes route table to search
+ * @param request request made by `parse_http_request`. Captured values point into `http_request::path`.
+ * @param method HTTP method to find. It may differ from `request->method`, e.g. GET route for HEAD request.
+ * @return Route matched by path and `method`. Returns NULL if not found, and no path parameter is stored.
+ */
+struct route *match_route(const struct routes *routes, const struct http_request *request, enum http_method method);
+
 /**
  * @brief Insert new route into `sturct routes`. `path` must start with '/'.   
- * If you pass a route with same path and method as the route that already exists in `route_table`, it will be failed.
+ * If you pass a route with same path and method as the route that already exists in `route_table`, it will be failed.   
+ * A segment starting with ':' (e.g. `/program/:pid`) matches any single non-empty segment, and a last segment starting with '*'
+ * (such as `*` or `*file`) matches the rest of path. Captured values are found by `find_http_request_path_parameter`.
+ * Two routes cannot use different names for a parameter at the same position.
  * 
  * @param route_table `struct routes` to be inserted with a new route
  * @param path URL path of route
  * @param method HTTP method accepted by the new route
  * @param callback function to execute when HTTP request reaches the route
  * @return The `struct routes*` given as `route_table`. In any situation, failing to store new header, return **NULL**. 
+ * @note `callback` allocates a response per request, which the server frees. Prefer `insert_route_handler`,
+ * which fills a response owned by the server.
  */
 struct routes* insert_route(
 		struct routes       *route_table,
@@ -63,6 +96,54 @@ struct routes* insert_route(
 		struct http_response *(*callback)(struct http_request request)
 );
 
+/**
+ * @brief Insert new route answered by `handler`, which fills in a response owned and reused by the server.   
+ * The response given to `handler` is reset: 200, HTTP/1.1, no header and no body. Headers inserted into it keep
+ * their array allocated for the next request. Otherwise same as `insert_route`.
+ * 
+ * @param route_table `struct routes` to be inserted with a new route
+ * @param path URL path of route
+ * @param method HTTP method accepted by the new route
+ * @param handler function to execute when HTTP request reaches the route. Returns 0 on success, or -1 to answer 500.
+ * @return The `struct routes*` given as `route_table`. In any situation, failing to store new route, return **NULL**. 
+ */
+struct routes* insert_route_handler(
+		struct routes       *route_table,
+		const char          *path,
+		enum http_method    method,
+		int                 (*handler)(const struct http_request *request, struct http_response *response)
+);
+
+/**
+ * @brief Insert new route answered always with `response`, such as a health check. `response` is serialized once here,
+ * and the server writes the bytes as they are, without calling any callback or allocating.
+ * Otherwise same as `insert_route`.
+ * 
+ * @param route_table `struct routes` to be inserted with a new route
+ * @param path URL path of route
+ * @param method HTTP method accepted by the new route
+ * @param response constant response. Not referenced after return.
+ * @return The `struct routes*` given as `route_table`. In any situation, failing to store new route, return **NULL**. 
+ */
+struct routes* insert_canned_route(
+		struct routes               *route_table,
+		const char                  *path,
+		enum http_method            method,
+		const struct http_response  *response
+);
+
+/**
+ * @brief Remove the route with same path and method from `sturct routes`, and free it.   
+ * Path is compared as `url_path_cmp` does, and parameter segments must have the same names as inserted.
+ * 
+ * @param route_table `struct routes` from which the route is removed
+ * @param path URL path of route, as passed to `insert_route`
+ * @param method HTTP method of route
+ * @return The `struct routes*` given as `route_table`. Returns **NULL** if there is no such route or failed to rebuild the tree.
+ * @note Running server is not affected until `update_web_server_routes` is called.
+ */
+struct routes* remove_route(struct routes *route_table, const char *path, enum http_method method);
+
 /**
  * @brief Initialize members of `sturct routes`.
  * 
@@ -71,20 +152,143 @@ struct routes* insert_route(
  */
 struct routes* init_routes(struct routes *route_table);
 
-int init_http_request(
-    struct http_request             *request,
-    struct http_headers             headers,
-    enum http_method                method,
-    enum http_version               version,
-    char                            *body,
-    char                            *path,
-    struct http_query_parameters    query_parameters
+/**
+ * @brief Parse an HTTP request string into a struct http_request.   
+ * Only the request line is parsed here. Headers, query parameters and body are recorded as offsets into `request`,
+ * and decoded on first access through `get_http_request_headers`, `get_http_request_query_parameters`
+ * and `get_http_request_body`.
+ *
+ * @param request whole HTTP request as NUL-terminated string
+ * @return Parsed request allocated with `malloc`. Returns **NULL** if request line is malformed.
+ * @warning `request` is borrowed, not copied. It must outlive the returned request.
+ */
+struct http_request *parse_http_request(const char *request);
+
+/**
+ * @brief Parse an HTTP request of `length` bytes, same as `parse_http_request`. Body may contain NUL.
+ *
+ * @param request whole HTTP request. `request[length]` must be NUL.
+ * @param length byte length of `request`
+ * @return Parsed request allocated with `malloc`. Returns **NULL** if request line is malformed.
+ * @warning `request` is borrowed, not copied. It must outlive the returned request.
+ */
+struct http_request *parse_http_request_bytes(const char *request, size_t length);
+
+/**
+ * @brief Get headers of `request`. They are parsed on first call and cached.
+ *
+ * @param request request made by `parse_http_request`
+ * @return Headers of `request`. If `struct http_headers::capacity` is **zero**, it means parsing **failed**.
+ */
+struct http_headers *get_http_request_headers(const struct http_request *request);
+
+/**
+ * @brief Find a header of `request` by `key`, case-insensitively. Headers are parsed on first call and cached.
+ *
+ * @param request request made by `parse_http_request`
+ * @param key key of header
+ * @return Header matched by `key`. Returns NULL if not found.
+ */
+struct http_header *find_http_request_header(const struct http_request *request, const char *key);
+
+/**
+ * @brief Get query parameters of `request`. They are parsed on first call and cached.
+ *
+ * @param request request made by `parse_http_request`
+ * @return Query parameters of `request`. Empty if request has no query or failed to parse.
+ */
+struct http_query_parameters *get_http_request_query_parameters(const struct http_request *request);
+
+/**
+ * @brief Find a query parameter of `request` by `key`. Query parameters are parsed on first call and cached.
+ *
+ * @param request request made by `parse_http_request`
+ * @param key key of query parameter
+ * @return Query parameter matched by `key`. Returns NULL if not found.
+ */
+struct http_query_parameter *find_http_request_query_parameter(const struct http_request *request, const char *key);
+
+/**
+ * @brief Get content body of `request`, without copying.
+ *
+ * @param request request made by `parse_http_request`
+ * @return NUL-terminated body. Empty string if request has no body.
+ * @note Binary body may contain NUL. Use `get_http_request_body_length` for its length.
+ */
+const char *get_http_request_body(const struct http_request *request);
+
+/**
+ * @brief Get byte length of content body of `request`.
+ *
+ * @param request request made by `parse_http_request`
+ * @return Length of body. 0 if request has no body.
+ */
+size_t get_http_request_body_length(const struct http_request *request);
+
+/**
+ * @brief Find a path parameter captured by the route matched with `request`, without copying.
+ *
+ * @param request request passed to route callback
+ * @param name name of parameter, without leading ':'. `*` for an unnamed wildcard.
+ * @param length length of returned value is stored. May be **NULL**.
+ * @return Captured value, not NUL-terminated. Returns NULL if not found.
+ * @note Captured parameters are valid only while the route callback runs, as their names point into the route table of the server.
+ */
+const char *find_http_request_path_parameter(const struct http_request *request, const char *name, size_t *length);
+
+/**
+ * @brief Find a header field in raw (not yet parsed) HTTP headers without allocating.
+ *
+ * @param headers start of the first header line, right after the request line's CRLF
+ * @param length byte length of `headers`. Scanning stops at the empty line or at `length`.
+ * @param key header name to find. Compared case-insensitively.
+ * @param value_length out parameter, set to the byte length of the returned value
+ * @return Pointer to the first non-whitespace byte of the value inside `headers`. Returns **NULL** if not found.
+ * @note The returned value is not NUL-terminated.
+ */
+const char *scan_http_header(const char *headers, size_t length, const char *key, size_t *value_length);
+
+/**
+ * @brief Initialize a decoder for a `Transfer-Encoding: chunked` message body.
+ *
+ * @param decoder decoder to initialize
+ */
+void init_http_chunked_decoder(struct http_chunked_decoder *decoder);
+
+/**
+ * @brief Decode a piece of a chunked message body. The decoder keeps its state between calls,
+ * so the body can be fed as it arrives from the socket, split at any byte.
+ *
+ * @param decoder decoder initialized by `init_http_chunked_decoder`
+ * @param dst where decoded bytes are written. It may alias `src` as long as `dst <= src`, which allows decoding in place.
+ * @param src encoded bytes
+ * @param length byte length of `src`
+ * @param consumed out parameter, set to the number of bytes read from `src`
+ * @return The number of decoded bytes written to `dst`.
+ * @retval -1 body is malformed
+ * @note Bytes after the last chunk and trailer section are not consumed.
+ * Check `http_chunked_decoder::state` for `HTTP_CHUNKED_DONE` to know the body is complete.
+ */
+ssize_t decode_http_chunked(
+    struct http_chunked_decoder *decoder,
+    char                        *dst,
+    const char                  *src,
+    size_t                      length,
+    size_t                      *consumed
 );
 
 /**
- * @brief Parse an HTTP request string into a struct http_request.
+ * @brief Tokenize an HTTP request line (`method SP request-target SP HTTP-version CRLF`) in a single pass.
+ * Method and version are recognized by comparing packed words, and each character is validated against
+ * RFC 9112 `token` and `origin-form` grammar with a lookup table. This function does not allocate.
+ *
+ * @param line start of request line
+ * @param length byte length of `line`, including the terminating CRLF
+ * @param request_line out parameter to store the result
+ * @return 0 on success, -1 if the request line is malformed.
+ * @note A method which is a valid `token` but not registered in `enum http_method` is parsed as `HTTP_METHOD_UNKNOWN`.
  */
-struct http_request *parse_http_request(const char *request);
+int parse_http_request_line(const char *line, size_t length, struct http_request_line *request_line);
 
 /**
  * @brief Parse the HTTP method string and return its enum representation.
@@ -114,7 +318,7 @@ char* http_status_code_stringify(const enum http_status_code code);
 /**
  * @brief Cleanup `struct http_headers` instance.
  * 
- * @param headers target to cleanup
+ * @param headers target to cleanup. It is left empty, and can be inserted again.
  */
 void destruct_http_headers(struct http_headers *headers);
 
@@ -291,8 +495,264 @@ int init_http_response(
     char                    *body
 );
 
+/**
+ * @brief Release body, ranges, headers and header set of `response`, and reset it to 200, HTTP/1.1, no header and no body.
+ * The array of headers is kept, so that `response` can be reused without allocating.
+ * 
+ * @param response response to reset. Zero-initialized response is accepted.
+ */
+void reset_http_response(struct http_response *response);
+
+/**
+ * @brief Length of `Date` header line, e.g. "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+ */
+#define HTTP_DATE_LINE_LENGTH 37
+
+/**
+ * @brief Format `now` into the cached `Date` header line. Called once per second by a timer thread of the server.
+ * Line is guarded by a sequence counter, which is odd while the line is written, so readers never take a lock.
+ * 
+ * @param now current time
+ * @note Only one thread may update.
+ */
+void update_http_date(time_t now);
+
+/**
+ * @brief Copy the cached `Date` header line, `HTTP_DATE_LINE_LENGTH` bytes including CRLF, into `line`.
+ * A copy overlapped by `update_http_date` is detected by the sequence counter, and retried.
+ * 
+ * @param line buffer to store the line. Not NUL-terminated.
+ * @return true if copied. false if `update_http_date` has never been called.
+ */
+bool copy_http_date_line(char line[HTTP_DATE_LINE_LENGTH]);
+
+/**
+ * @brief Length of HTTP-date in IMF-fixdate format, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+ */
+#define HTTP_DATE_LENGTH 29
+
+/**
+ * @brief Maximum length of an ETag made by `format_http_etag`, including quotes and NUL
+ */
+#define HTTP_ETAG_MAX_LENGTH 56
+
+/**
+ * @brief Format `time` as HTTP-date in IMF-fixdate format, for `Date` and `Last-Modified`.
+ * 
+ * @param time time to format
+ * @param date out parameter, `HTTP_DATE_LENGTH` characters and NUL are stored
+ */
+void format_http_date(time_t time, char date[HTTP_DATE_LENGTH + 1]);
+
+/**
+ * @brief Parse HTTP-date in IMF-fixdate format, e.g. the value of `If-Modified-Since`.
+ * Obsolete formats (RFC 850, asctime) are not accepted, and a condition with them is ignored as an invalid date.
+ * 
+ * @param value value to parse
+ * @param time out parameter, parsed time
+ * @return 0 on success, -1 if `value` is not an IMF-fixdate
+ */
+int parse_http_date(const char *value, time_t *time);
+
+/**
+ * @brief Format a strong ETag of a file from its inode, size and modification time, without reading the file.
+ * A file replaced or modified gets another ETag, as long as the file system keeps modification time.
+ * 
+ * @param file_stat metadata of the file
+ * @param etag out parameter, which must hold `HTTP_ETAG_MAX_LENGTH` bytes. Quoted and NUL-terminated.
+ */
+void format_http_etag(const struct stat *file_stat, char etag[HTTP_ETAG_MAX_LENGTH]);
+
+/**
+ * @brief Check `If-None-Match` value matches `etag` by weak comparison (RFC 9110), i.e. `W/` prefix is ignored.
+ * Quotes of tags are optional, since `parse_http_headers` drops quotes around a whole value.
+ * 
+ * @param if_none_match value of `If-None-Match`: `*`, or comma separated entity tags
+ * @param etag quoted entity tag of the current representation
+ * @return true if `*` or any tag matches
+ */
+bool match_http_etag(const char *if_none_match, const char *etag);
+
+/**
+ * @brief Check a conditional GET or HEAD may be answered with 304, i.e. the copy of the client is still fresh.
+ * `If-None-Match` is evaluated if present, and `If-Modified-Since` only otherwise.
+ * 
+ * @param request request to check
+ * @param etag quoted entity tag of the current representation
+ * @param last_modified modification time of the current representation
+ * @return true if `request` is GET or HEAD and its condition says the representation was not modified
+ */
+bool is_http_not_modified(const struct http_request *request, const char *etag, time_t last_modified);
+
+/**
+ * @brief the number of slots of MIME type table. Empty slots have no type.
+ */
+#define HTTP_MIME_TABLE_SIZE 128
+
+/**
+ * @brief Find the slot of MIME type table for the extension of `path`, e.g. `js` of `/static/app.js`.
+ * Table is a perfect hash laid out at compile time. Slot is computed from the length and three characters of the extension,
+ * and one comparison confirms it, without probing or allocating.
+ * 
+ * @param path URL path or file name. Extension is case-insensitive.
+ * @return slot from 0 to `HTTP_MIME_TABLE_SIZE - 1`. -1 if there is no extension or it is not known.
+ */
+int find_http_mime_type(const char *path);
+
+/**
+ * @brief Get `Content-Type` value of a slot of MIME type table, e.g. `text/javascript; charset=utf-8`.
+ * 
+ * @param slot slot returned by `find_http_mime_type`
+ * @return Type of the slot. **NULL** if `slot` is out of range or empty.
+ */
+const char *get_http_mime_type(int slot);
+
+/**
+ * @brief Maximum number of ranges served from one `Range` header. A request with more is answered with the whole representation,
+ * so that many tiny ranges do not turn one request into many writes.
+ */
+#define HTTP_MAX_RANGES 16
+
+/**
+ * @brief Maximum length of a delimiter formatted by `format_http_range_delimiter`, including NUL
+ */
+#define HTTP_RANGE_DELIMITER_MAX_LENGTH 256
+
+/**
+ * @brief Parse `Range` value of bytes unit, e.g. `bytes=0-499, -500`, against a representation of `size` bytes.
+ * Last positions beyond the end are clamped, suffix ranges longer than `size` mean the whole, and unsatisfiable ranges are dropped.
+ * 
+ * @param value value of `Range`
+ * @param size length of the representation
+ * @param ranges out parameter, satisfiable ranges in the order requested
+ * @param max_ranges the number of elements of `ranges`
+ * @return The number of satisfiable ranges stored in `ranges`.
+ * @retval 0 No range is satisfiable, which is answered with 416.
+ * @retval -1 `value` is malformed, not of bytes unit, or has more than `max_ranges` ranges. The header is ignored (200 with the whole).
+ */
+int parse_http_range(const char *value, off_t size, struct http_byte_range *ranges, int max_ranges);
+
+/**
+ * @brief Check `If-Range` of `request` allows serving ranges of the current representation.
+ * A date must equal `last_modified`, and an entity tag must match `etag` by strong comparison.
+ * 
+ * @param request request having `Range`
+ * @param etag quoted strong entity tag of the current representation
+ * @param last_modified modification time of the current representation
+ * @return true if `request` has no `If-Range` or it matches. false if the whole representation must be sent.
+ */
+bool match_http_if_range(const struct http_request *request, const char *etag, time_t last_modified);
+
+/**
+ * @brief Format the delimiter and headers (`Content-Type` if known, and `Content-Range`) preceding part `index`
+ * of `multipart/byteranges` body, or the closing delimiter if `index` is `ranges->count`.
+ * 
+ * @param buffer out parameter, which must hold `HTTP_RANGE_DELIMITER_MAX_LENGTH` bytes. NUL-terminated.
+ * @param ranges ranges of the response
+ * @param index index of part, from 0 to `ranges->count`
+ * @return Length of the delimiter
+ */
+size_t format_http_range_delimiter(char *buffer, const struct http_byte_ranges *ranges, int index);
+
+/**
+ * @brief Serialize `http_response` into a new string.
+ * 
+ * @return NUL-terminated response allocated by `malloc`. **NULL** if allocation failed.
+ * @note Server writes heads of responses with `build_http_response_head` into a reused buffer instead.
+ */
 char* http_response_stringify(struct http_response http_response);
 
+/**
+ * @brief Serialize `response` once into an immutable, reference-counted byte buffer, to be written as is for every request.
+ * `Date` line is not included. Server writes the cached line after `status_line_length` bytes.
+ * 
+ * @param response response to serialize. Not referenced after return.
+ * @return Canned response with one reference, allocated by `malloc`.
+ * **NULL** if allocation failed, `response->stream` or `response->websocket` is set, or body is `HTTP_BODY_FILE`.
+ */
+struct http_canned_response *create_http_canned_response(const struct http_response *response);
+
+/**
+ * @brief Add a reference to `canned`. Thread-safe.
+ * 
+ * @param canned canned response made by `create_http_canned_response`. May be **NULL**.
+ * @return `canned` given
+ */
+struct http_canned_response *retain_http_canned_response(struct http_canned_response *canned);
+
+/**
+ * @brief Drop a reference to `canned`, and free it when no reference remains. Thread-safe.
+ * 
+ * @param canned canned response made by `create_http_canned_response`. May be **NULL**.
+ */
+void release_http_canned_response(struct http_canned_response *canned);
+
+/**
+ * @brief Initialize `buffer` with `capacity` bytes.
+ * 
+ * @return 0 on success, -1 if allocation failed
+ */
+int init_http_output_buffer(struct http_output_buffer *buffer, size_t capacity);
+
+/**
+ * @brief Free memory of `buffer`. It can be initialized again.
+ */
+void destruct_http_output_buffer(struct http_output_buffer *buffer);
+
+/**
+ * @brief Write status line, headers, empty line and body of `response` into `buffer`, replacing its contents.
+ * Status line is copied from a table precomputed per `enum http_status_code`. Length of every part is measured first,
+ * so that `buffer` grows at most once and each part is copied once.   
+ * `Date` line from `copy_http_date_line` follows the status line, if the cache has been updated.
+ * `Content-Length` is added from the measured body length, unless `response->headers` has one
+ * or the status must not have a body (1xx, 204, 304). If `response->stream` is set, only status line and headers are written,
+ * with `Transfer-Encoding: chunked` unless `response->http_version` is HTTP/1.0. `HTTP_BODY_FILE` body is not written, but counted in `Content-Length`.
+ * 
+ * @param buffer output buffer, reused across responses. Grows on demand.
+ * @param response response to serialize
+ * @return Length of serialized response, also stored in `buffer->length`. -1 if allocation failed.
+ * @note `buffer->data` is NUL-terminated after success.
+ */
+ssize_t build_http_response(struct http_output_buffer *buffer, const struct http_response *response);
+
+/**
+ * @brief Write status line, headers and empty line of `response` into `buffer`, same as `build_http_response` but without the body.
+ * Body in memory is not copied, so that the server sends it from `response->body` right after the head, in the same `sendmsg`.
+ * A streamed body is framed by the version of the request, not of the response. An HTTP/1.0 client does not know chunked coding,
+ * so its streamed body is not chunked but ends when the connection is closed.
+ * 
+ * @param buffer output buffer, reused across responses. Grows on demand.
+ * @param response response to serialize
+ * @param request_version `http_request::version` of the request answered. HTTP/1.1 if unknown, e.g. the request was malformed.
+ * @return Length of the head, also stored in `buffer->length` and `buffer->head_length`. -1 if allocation failed.
+ */
+ssize_t build_http_response_head(struct http_output_buffer *buffer, const struct http_response *response, enum http_version request_version);
+
+/**
+ * @brief Serialize `headers` once into an immutable, reference-counted header set.
+ * The set can be attached to any number of responses by pointer (`http_response::header_set`),
+ * so that common headers such as CORS headers are not copied per response.
+ * 
+ * @param headers headers to serialize. Not referenced after return.
+ * @return Header set with one reference, allocated by `malloc`. **NULL** if allocation failed.
+ */
+struct http_header_set *create_http_header_set(const struct http_headers *headers);
+
+/**
+ * @brief Add a reference to `header_set`. Thread-safe.
+ * 
+ * @param header_set header set made by `create_http_header_set`. May be **NULL**.
+ * @return `header_set` given
+ */
+struct http_header_set *retain_http_header_set(struct http_header_set *header_set);
+
+/**
+ * @brief Drop a reference to `header_set`, and free it when no reference remains. Thread-safe.
+ * 
+ * @param header_set header set made by `create_http_header_set`. May be **NULL**.
+ */
+void release_http_header_set(struct http_header_set *header_set);
+
 /* http 웹서버 라이브러리 구조체 */
 
 /**
@@ -300,11 +760,15 @@ char* http_response_stringify(struct http_response http_response);
  * @note enum value has `int` type
  */
 enum http_status_code {
+    // 1xx Informational
+    HTTP_SWITCHING_PROTOCOLS = 101,
+
     // 2xx Success
     HTTP_OK = 200,
     HTTP_CREATED = 201,
     HTTP_ACCEPTED = 202,
     HTTP_NO_CONTENT = 204,
+    HTTP_PARTIAL_CONTENT = 206,
 
     // 3xx Redirection
     HTTP_MOVED_PERMANENTLY = 301,
@@ -326,7 +790,10 @@ enum http_status_code {
     HTTP_PAYLOAD_TOO_LARGE = 413,
     HTTP_URI_TOO_LONG = 414,
     HTTP_UNSUPPORTED_MEDIA_TYPE = 415,
+    HTTP_RANGE_NOT_SATISFIABLE = 416,
+    HTTP_UPGRADE_REQUIRED = 426,
     HTTP_TOO_MANY_REQUESTS = 429,
+    HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE = 431,
 
     // 5xx Server Errors
     HTTP_INTERNAL_SERVER_ERROR = 500,
@@ -347,6 +814,8 @@ enum http_method {
     HTTP_PUT,
     HTTP_DELETE,
     HTTP_OPTIONS,
+    HTTP_PATCH,
+    HTTP_HEAD,
     HTTP_METHOD_UNKNOWN, // Unknown method handling
 };
 
@@ -362,6 +831,15 @@ enum http_version {
     HTTP_VERSION_UNKNOWN // Unknown version handling
 };
 
+/**
+ * @brief how `http_response::body` is owned and sent
+ */
+enum http_body_type {
+    HTTP_BODY_OWNED,    // allocated by `malloc`, and freed by the server after sending (default)
+    HTTP_BODY_BORROWED, // not freed, e.g. a string literal. It must outlive the response.
+    HTTP_BODY_FILE      // `body_length` bytes of `body_fd` sent by `sendfile`, and closed by the server. `body` is ignored.
+};
+
 /**
  * @brief route struct to define each route, mapped by URL path.
  *       Each path doesn't include parameter (such as ?param1=5&param2=6 or /{docs id})
@@ -380,6 +858,14 @@ struct route {
      * allocated by `malloc`.
      */
     struct http_response *(*callback)(struct http_request request);
+    /**
+     * @brief function filling a response owned by the server. Made by `insert_route_handler`, and used instead of `callback` if not NULL.
+     */
+    int (*handler)(const struct http_request *request, struct http_response *response);
+    /**
+     * @brief If not NULL, the route is answered with these bytes without calling `callback`. Made by `insert_canned_route`.
+     */
+    struct http_canned_response *canned;
 };
 
 
@@ -400,6 +886,10 @@ struct routes {
      * @brief the array of `struct route*`
      */
     struct route    **items;
+    /**
+     * @brief radix tree of `items` keyed by path, used by `find_route`. Built by `insert_route`.
+     */
+    struct route_node *tree;
 };
 
 /**
@@ -471,13 +961,50 @@ struct http_query_parameters {
 };
 
 /**
- * @brief a http request struct
+ * @brief Maximum number of `:name` and `*` segments in a route path
  */
-struct http_request {
+#define HTTP_MAX_PATH_PARAMETERS 8
+
+/**
+ * @brief Path segment captured by `:name` or `*` segment of a route. Both name and value are slices, not NUL-terminated.
+ */
+struct http_path_parameter {
     /**
-     * @brief headers of http reqeust
+     * @brief name of parameter, pointing into the route table. `*` for an unnamed wildcard.
      */
-    struct http_headers headers;
+    const char *name;
+    /**
+     * @brief length of `name`
+     */
+    size_t name_length;
+    /**
+     * @brief captured value, pointing into `http_request::path`
+     */
+    const char *value;
+    /**
+     * @brief length of `value`
+     */
+    size_t value_length;
+};
+
+/**
+ * @brief Path parameters captured by the matched route, stored without allocation.
+ */
+struct http_path_parameters {
+    /**
+     * @brief the number of captured parameters
+     */
+    int size;
+    /**
+     * @brief captured parameters, in order of appearance in the path
+     */
+    struct http_path_parameter items[HTTP_MAX_PATH_PARAMETERS];
+};
+
+/**
+ * @brief a http request struct
+ */
+struct http_request {
     /**
      * @brief http request method, such as GET, POST.
      */
@@ -486,18 +1013,73 @@ struct http_request {
      * @brief http version.
      */
     enum http_version version;
-    /**
-     * @brief content body of http request. If content body is empty, body is NULL.
-     */
-    char *body;
     /**
      * @brief path of http request, excluding parameters
      */
     char *path;
+    /**
+     * @brief whole request which was parsed. Borrowed from caller of `parse_http_request`.
+     */
+    const char *raw;
+    /**
+     * @brief offset of first header line in `raw`
+     */
+    size_t header_offset;
+    /**
+     * @brief byte length of header lines, excluding the empty line which ends headers
+     */
+    size_t header_length;
+    /**
+     * @brief offset of query in `raw`, right after `?`
+     */
+    size_t query_offset;
+    /**
+     * @brief byte length of query. 0 if there is no query.
+     */
+    size_t query_length;
+    /**
+     * @brief offset of content body in `raw`
+     */
+    size_t body_offset;
+    /**
+     * @brief byte length of content body
+     */
+    size_t body_length;
+    /**
+     * @brief headers and query parameters decoded on first access.
+     * @note It is shared by copies of this request, so that decoding through a copy is not lost.
+     */
+    struct http_request_cache *cache;
+};
+
+/**
+ * @brief Parts of `struct http_request` which are decoded lazily.
+ */
+struct http_request_cache {
+    /**
+     * @brief bit flags of `enum http_request_part`, set when the part is decoded
+     */
+    int decoded;
+    /**
+     * @brief headers of http request
+     */
+    struct http_headers headers;
     /**
      * @brief query_parameters in URL
      */
     struct http_query_parameters query_parameters;
+    /**
+     * @brief path parameters captured by `match_route`
+     */
+    struct http_path_parameters path_parameters;
+};
+
+/**
+ * @brief Parts of http request decoded lazily, used as flags of `http_request_cache::decoded`
+ */
+enum http_request_part {
+    HTTP_REQUEST_HEADERS = 1 << 0,
+    HTTP_REQUEST_QUERY_PARAMETERS = 1 << 1
 };
 
 /**
@@ -520,5 +1102,231 @@ struct http_response {
      * @brief content body of http response. If content body is empty, body is NULL.
      */
     char* body;
+    /**
+     * @brief byte length of `body`, which may contain NUL. 0 means `strlen(body)`, for NUL-terminated text.
+     * For `HTTP_BODY_FILE`, the number of bytes to send from `body_fd`.
+     */
+    size_t                  body_length;
+    /**
+     * @brief how `body` is owned. `HTTP_BODY_OWNED` if zero-initialized.
+     */
+    enum http_body_type     body_type;
+    /**
+     * @brief file descriptor of a regular file sent as body, when `body_type` is `HTTP_BODY_FILE`. Sent from `body_offset`.
+     */
+    int                     body_fd;
+    /**
+     * @brief offset in `body_fd` of the first byte sent, e.g. the first position of a range
+     */
+    off_t                   body_offset;
+    /**
+     * @brief If not NULL, ranges of `body_fd` sent as parts of `multipart/byteranges`, instead of `body_offset` and `body_length`.
+     * Allocated by `malloc`, and freed with the response.
+     */
+    struct http_byte_ranges *ranges;
+    /**
+     * @brief shared headers written before `headers`. NULL if none.
+     * The response holds a reference, which is released by the server after the response is sent.
+     */
+    struct http_header_set  *header_set;
+    /**
+     * @brief If not NULL, body is produced by this function instead of `body`, which is ignored.
+     * It is called once after status line and headers are sent, and writes the body with `write_http_chunk`,
+     * sent as `Transfer-Encoding: chunked` (HTTP/1.0: until the connection is closed).   
+     * It is called even for HEAD or when the client has gone, where writes fail, so that it can always release `stream_data`.
+     */
+    void                    (*stream)(struct http_response_writer *writer, void *data);
+    /**
+     * @brief user data passed to `stream`
+     */
+    void                    *stream_data;
+    /**
+     * @brief If not NULL, the connection is handed over to this function after the head is sent, e.g. 101 made by `accept_websocket`.
+     * It runs on the worker until it returns, and the connection is closed after that.   
+     * It is called even when the head was not sent, with a closed socket, so that it can always release `websocket_data`.
+     */
+    void                    (*websocket)(struct websocket *socket, void *data);
+    /**
+     * @brief user data passed to `websocket`
+     */
+    void                    *websocket_data;
+};
+
+/**
+ * @brief Range of bytes, inclusive at both ends as in `Range` and `Content-Range`
+ */
+struct http_byte_range {
+    /**
+     * @brief position of the first byte
+     */
+    off_t   first;
+    /**
+     * @brief position of the last byte
+     */
+    off_t   last;
+};
+
+/**
+ * @brief Ranges of a file sent as `multipart/byteranges`
+ */
+struct http_byte_ranges {
+    /**
+     * @brief length of the whole file, written in `Content-Range` of each part
+     */
+    off_t                   size;
+    /**
+     * @brief boundary of parts, also written in `Content-Type` of the response
+     */
+    char                    boundary[32];
+    /**
+     * @brief `Content-Type` of each part, i.e. type of the file. NULL if unknown.
+     */
+    const char              *content_type;
+    /**
+     * @brief the number of `items`
+     */
+    int                     count;
+    /**
+     * @brief ranges in the order sent
+     */
+    struct http_byte_range  items[];
+};
+
+/**
+ * @brief Response serialized once by `create_http_canned_response`, shared by every request answered with it.
+ */
+struct http_canned_response {
+    /**
+     * @brief the number of references
+     */
+    atomic_int  references;
+    /**
+     * @brief length of `data`
+     */
+    size_t      length;
+    /**
+     * @brief length of status line and headers including the empty line, i.e. `data` without body. Used for HEAD.
+     */
+    size_t      head_length;
+    /**
+     * @brief length of status line. `Date` line is not serialized, but written after the status line per request.
+     */
+    size_t      status_line_length;
+    /**
+     * @brief serialized response
+     */
+    char        data[];
+};
+
+/**
+ * @brief Growable buffer to which responses are serialized, reused across responses
+ */
+struct http_output_buffer {
+    /**
+     * @brief serialized bytes
+     */
+    char    *data;
+    /**
+     * @brief the number of bytes used in `data`
+     */
+    size_t  length;
+    /**
+     * @brief the number of bytes before body, i.e. what is written for HEAD
+     */
+    size_t  head_length;
+    /**
+     * @brief allocated size of `data`
+     */
+    size_t  capacity;
+};
+
+/**
+ * @brief Immutable header lines serialized once by `create_http_header_set`, shared by responses.
+ */
+struct http_header_set {
+    /**
+     * @brief the number of references
+     */
+    atomic_int  references;
+    /**
+     * @brief length of `data`
+     */
+    size_t      length;
+    /**
+     * @brief serialized header lines, each ended by CRLF. NUL-terminated.
+     */
+    char        data[];
 };
 
+/**
+ * @brief Tokens of HTTP request line, produced by `parse_http_request_line`.
+ * @note `target` points into the parsed line and is not NUL-terminated.
+ */
+struct http_request_line {
+    /**
+     * @brief http request method
+     */
+    enum http_method method;
+    /**
+     * @brief http version
+     */
+    enum http_version version;
+    /**
+     * @brief start of request-target
+     */
+    const char *target;
+    /**
+     * @brief byte length of request-target
+     */
+    size_t target_length;
+    /**
+     * @brief byte length of path part of request-target, excluding `?` and query
+     */
+    size_t path_length;
+    /**
+     * @brief byte length of whole request line, including CRLF
+     */
+    size_t length;
+};
+
+/**
+ * @brief state of `struct http_chunked_decoder`
+ */
+enum http_chunked_state {
+    HTTP_CHUNKED_SIZE,          // reading hex digits of chunk size
+    HTTP_CHUNKED_SIZE_EXT,      // skipping chunk extensions until CR
+    HTTP_CHUNKED_SIZE_LF,       // expecting LF after chunk size line
+    HTTP_CHUNKED_DATA,          // copying chunk data
+    HTTP_CHUNKED_DATA_CR,       // expecting CR after chunk data
+    HTTP_CHUNKED_DATA_LF,       // expecting LF after chunk data
+    HTTP_CHUNKED_TRAILER,       // reading (and ignoring) trailer fields
+    HTTP_CHUNKED_TRAILER_LF,    // expecting LF of trailer line
+    HTTP_CHUNKED_DONE,          // last chunk and trailers are consumed
+    HTTP_CHUNKED_ERROR          // malformed body
+};
+
+/**
+ * @brief Incremental decoder of `Transfer-Encoding: chunked` body.
+ */
+struct http_chunked_decoder {
+    /**
+     * @brief current state of decoder
+     */
+    enum http_chunked_state state;
+    /**
+     * @brief bytes left in current chunk, or chunk size being read
+     */
+    size_t chunk_remaining;
+    /**
+     * @brief the number of hex digits read for current chunk size
+     */
+    int size_digits;
+    /**
+     * @brief length of current trailer line. Empty line ends the body.
+     */
+    size_t trailer_line_length;
+    /**
+     * @brief total number of decoded body bytes
+     */
+    size_t decoded_length;
+};
@@ -1,43 +1,465 @@
-#include <ctype.h>
 #include <stdio.h>
-#include <assert.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "utility.h"
 #include "json.h"
 
-// @TODO Need to meet standard json requirements
+/**
+ * @brief Alignment of every allocation in arena, enough for `struct json_element`
+ */
+#define JSON_ARENA_ALIGNMENT 8
 
-static inline int is_hex_digit(char ch) {
-    switch (ch) {
-    case 'a':    
-    case 'b':
-    case 'c':
-    case 'd':
-    case 'e':
-    case 'f':
-    case 'A':
-    case 'B':
-    case 'C':
-    case 'D':
-    case 'E':
-    case 'F':        
-        return 1;    
-    default:
-        return isdigit(ch);
+/**
+ * @brief The number of elements that `parse_json` keeps on its own stack before moving them to heap
+ */
+#define JSON_PARSER_STACK_SIZE 32
+
+/**
+ * @brief The number of bytes of <string> inspected at once by `find_json_string_specials`
+ */
+#define JSON_SCAN_BLOCK_SIZE 32
+
+struct json_arena {
+    /**
+     * @brief older chunk, **NULL** for the first one
+     */
+    struct json_arena *next;
+    /**
+     * @brief size of `data`
+     */
+    size_t size;
+    /**
+     * @brief allocated bytes of `data`
+     */
+    size_t used;
+    /**
+     * @brief memory to allocate from. The first chunk starts with `struct json_object`.
+     */
+    unsigned char data[];
+};
+
+/**
+ * @brief slot of `struct json_index`
+ */
+struct json_index_slot {
+    /**
+     * @brief hash of key, compared before keys
+     */
+    uint32_t hash;
+    /**
+     * @brief index of the member plus 1. 0 if the slot is empty.
+     */
+    uint32_t position;
+};
+
+/**
+ * @brief Open addressing hash index of keys of a large object, stored in arena right before its members.
+ * Slots are at least 1.5 times as many as members, and probed linearly.
+ */
+struct json_index {
+    /**
+     * @brief slots, whose number is a power of 2. **NULL** until the object has `JSON_INDEX_THRESHOLD` members.
+     */
+    struct json_index_slot *slots;
+    /**
+     * @brief the number of slots minus 1
+     */
+    uint32_t mask;
+};
+
+/**
+ * @brief State of recursive descent parsing
+ */
+struct json_parser {
+    /**
+     * @brief next character to read
+     */
+    const char *cursor;
+    /**
+     * @brief terminating NUL of input. Blocks of <string> are not read beyond it.
+     */
+    const char *end;
+    /**
+     * @brief json object whose arena stores parsed elements
+     */
+    struct json_object *object;
+    /**
+     * @brief items of objects and arrays not closed yet. Items of a container are copied into arena at once when it is closed,
+     * so that they are stored contiguously.
+     */
+    struct json_element *stack;
+    /**
+     * @brief the number of elements in `stack`
+     */
+    int stack_size;
+    /**
+     * @brief capacity of `stack`
+     */
+    int stack_capacity;
+    /**
+     * @brief whether `stack` was allocated with `malloc`
+     */
+    bool stack_allocated;
+    /**
+     * @brief nesting depth of the container being parsed
+     */
+    int depth;
+};
+
+static inline int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+static inline const char *skip_json_whitespace(const char *cursor) {
+    /* ECMA-404 whitespaces. Differ from `is_non_space`, which includes '\f' and '\v' */
+    while (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r')
+        cursor++;
+    return cursor;
+}
+
+static struct json_object *allocate_json_object(size_t arena_size) {
+    if (arena_size < JSON_ARENA_MIN_SIZE)
+        arena_size = JSON_ARENA_MIN_SIZE;
+    struct json_arena *arena = malloc(sizeof(struct json_arena) + arena_size);
+    if (arena == NULL)
+        return NULL;
+    arena->next = NULL;
+    arena->size = arena_size;
+    arena->used = (sizeof(struct json_object) + JSON_ARENA_ALIGNMENT - 1) & ~(size_t)(JSON_ARENA_ALIGNMENT - 1);
+
+    struct json_object *object = (struct json_object *)arena->data;
+    object->size = 0;
+    object->capacity = 0;
+    object->items = NULL;
+    object->arena = arena;
+    return object;
+}
+
+/**
+ * @brief Allocate `size` bytes from arena of `object`. If the newest chunk is full, a new chunk twice as large is linked.
+ * @return allocated memory, or **NULL** if failed
+ */
+static void *allocate_json_arena(struct json_object *object, size_t size) {
+    struct json_arena *arena = object->arena;
+    size = (size + JSON_ARENA_ALIGNMENT - 1) & ~(size_t)(JSON_ARENA_ALIGNMENT - 1);
+
+    if (arena->size - arena->used < size) {
+        size_t new_size = arena->size * 2;
+        if (new_size < size)
+            new_size = size;
+        struct json_arena *new_arena = malloc(sizeof(struct json_arena) + new_size);
+        if (new_arena == NULL) {
+            DLOGV("malloc failed\n");
+            return NULL;
+        }
+        new_arena->next = arena;
+        new_arena->size = new_size;
+        new_arena->used = 0;
+        object->arena = arena = new_arena;
+    }
+
+    void *ret = arena->data + arena->used;
+    arena->used += size;
+    return ret;
+}
+
+static char *copy_json_text(struct json_object *object, const char *text, size_t length) {
+    char *ret = allocate_json_arena(object, length + 1);
+    if (ret == NULL)
+        return NULL;
+    memcpy(ret, text, length);
+    ret[length] = '\0';
+    return ret;
+}
+
+static inline struct json_index *json_index_of(const struct json_element *items) {
+    return (struct json_index *)((char *)items - sizeof(struct json_index));
+}
+
+/**
+ * @brief Hash a key 8 bytes at a time, multiplying by the golden ratio as Fibonacci hashing does.
+ */
+static inline uint32_t hash_json_key(const char *key) {
+    size_t length = strlen(key);
+    uint64_t hash = length;
+    uint64_t word;
+
+    for (; length >= 8; key += 8, length -= 8) {
+        memcpy(&word, key, 8);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15u;
+        hash ^= hash >> 29;
     }
+    word = 0;
+    for (size_t i = 0; i < length; i++)
+        word |= (uint64_t)(unsigned char)key[i] << (i * 8);
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15u;
+    /* multiplication moves bits only upward, so mix upper bits into lower ones used for slots */
+    hash ^= hash >> 32;
+    hash *= 0x9E3779B97F4A7C15u;
+    return (uint32_t)(hash >> 32);
+}
+
+static void add_json_index(struct json_index *index, const struct json_element *items, int position) {
+    struct json_index_slot *slots = index->slots;
+    const uint32_t mask = index->mask;
+    const uint32_t hash = hash_json_key(items[position].key);
+    uint32_t slot = hash & mask;
+
+    while (slots[slot].position) {
+        /* keep the first one of duplicate keys */
+        if (slots[slot].hash == hash && strcmp(items[slots[slot].position - 1].key, items[position].key) == 0)
+            return;
+        slot = (slot + 1) & mask;
+    }
+    slots[slot].hash = hash;
+    slots[slot].position = position + 1;
+}
+
+/**
+ * @brief Build hash index of `items`, allocated with `struct json_index` right before them.
+ * @param capacity the number of members the index will hold, before it is built again
+ * @return 0 on success, -1 if allocation failed
+ */
+static int build_json_index(struct json_object *object, struct json_element *items, int size, int capacity) {
+    struct json_index *index = json_index_of(items);
+    uint32_t slot_count = 1;
+    while (slot_count < (uint32_t)capacity + (uint32_t)capacity / 2)
+        slot_count <<= 1;
+
+    index->slots = allocate_json_arena(object, slot_count * sizeof(struct json_index_slot));
+    if (index->slots == NULL)
+        return -1;
+    memset(index->slots, 0, slot_count * sizeof(struct json_index_slot));
+    index->mask = slot_count - 1;
+
+    for (int i = 0; i < size; i++)
+        add_json_index(index, items, i);
+    return 0;
 }
 
 void destruct_json_object(struct json_object* json_object) {
-    for (int i = 0; i < json_object->size; i++) {
-        struct json_element *element = json_object->items[i];
-        free(element->key);
-        free(element->value);
-        free(element);
-    }        
-    free(json_object->items);
-    json_object->capacity = 0;
-    json_object->size = 0;
+    /* `json_object` itself lives in the first chunk, so read the list before releasing */
+    struct json_arena *arena = json_object->arena;
+    while (arena) {
+        struct json_arena *next = arena->next;
+        free(arena);
+        arena = next;
+    }
+}
+
+static inline bool is_json_string_special(char ch) {
+    return ch == '"' || ch == '\\' || (unsigned char)ch < 0x20;
+}
+
+#if !defined(__AVX2__) && defined(__SSE2__)
+static inline uint32_t find_json_string_specials_sse2(const char *block) {
+    const __m128i chunk = _mm_loadu_si128((const __m128i *)block);
+    const __m128i quote = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'));
+    const __m128i backslash = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'));
+    /* unsigned `ch < 0x20` as `min(ch, 0x1F) == ch` */
+    const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, _mm_set1_epi8(0x1F)), chunk);
+    return (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, backslash), control));
+}
+#endif
+
+/**
+ * @brief Find characters which end a run of plain characters in <string>: quotation mark, backslash and control characters.
+ * Uses AVX2 if enabled at compile time, otherwise SSE2 (every x86-64 has it) on two halves.
+ * @param block `JSON_SCAN_BLOCK_SIZE` bytes to inspect
+ * @return Bit mask whose n-th bit is set if `block[n]` is one of them
+ */
+static inline uint32_t find_json_string_specials(const char *block) {
+#if defined(__AVX2__)
+    const __m256i chunk = _mm256_loadu_si256((const __m256i *)block);
+    const __m256i quote = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"'));
+    const __m256i backslash = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'));
+    const __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, _mm256_set1_epi8(0x1F)), chunk);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(quote, backslash), control));
+#elif defined(__SSE2__)
+    return find_json_string_specials_sse2(block) | find_json_string_specials_sse2(block + 16) << 16;
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < JSON_SCAN_BLOCK_SIZE; i++) {
+        if (is_json_string_special(block[i]))
+            mask |= (uint32_t)1 << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief Skip plain characters of <string>, a block at a time while a whole block is left before `end`.
+ * @return The first special character (see `find_json_string_specials`), or `end`
+ */
+static inline const char *skip_json_string_plain(const char *cursor, const char *end) {
+    while (end - cursor >= JSON_SCAN_BLOCK_SIZE) {
+        uint32_t mask = find_json_string_specials(cursor);
+        if (mask)
+            return cursor + __builtin_ctz(mask);
+        cursor += JSON_SCAN_BLOCK_SIZE;
+    }
+    while (cursor < end && !is_json_string_special(*cursor))
+        cursor++;
+    return cursor;
+}
+
+/**
+ * @brief Find closing quotation mark of <string>, validating escapes.
+ * @param string_token <string> starting with quotation mark
+ * @param end terminating NUL of the input holding `string_token`
+ * @param escaped out parameter, set if <string> has any escape
+ * @return Length of <string> including both quotation marks, or -1 if not valid
+ * @note An escaped character is consumed with its backslash, so `\\"` closes <string>.
+ */
+static ssize_t scan_json_string(const char *string_token, const char *end, bool *escaped) {
+    const char *cursor = string_token + 1;
+    *escaped = false;
+
+    for (;;) {
+        cursor = skip_json_string_plain(cursor, end);
+        unsigned char ch = (unsigned char)*cursor;
+        if (ch == '"')
+            return cursor - string_token + 1;
+        /* control characters must be escaped, and NUL means not closed */
+        if (ch < 0x20) {
+            DLOGV("parse failed: control character 0x%02x in string\n", ch);
+            return -1;
+        }
+
+        /* backslash */
+        *escaped = true;
+        cursor++;
+        switch (*cursor) {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            break;
+        case 'u':
+            /* <UTF-16> := u<hex><hex><hex><hex>, stops at NUL since it is not a hex digit */
+            for (int i = 1; i <= 4; i++) {
+                if (hex_value(cursor[i]) < 0) {
+                    DLOGV("parse failed: invalid \\u escape\n");
+                    return -1;
+                }
+            }
+            cursor += 4;
+            break;
+        default:
+            DLOGV("parse failed: invalid escape\n");
+            return -1;
+        }
+        cursor++;
+    }
+}
+
+static inline unsigned read_utf16_unit(const char *hex) {
+    return (unsigned)(hex_value(hex[0]) << 12 | hex_value(hex[1]) << 8 | hex_value(hex[2]) << 4 | hex_value(hex[3]));
+}
+
+static inline int encode_utf8(uint32_t code_point, char *out) {
+    if (code_point < 0x80) {
+        out[0] = (char)code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = (char)(0xC0 | code_point >> 6);
+        out[1] = (char)(0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = (char)(0xE0 | code_point >> 12);
+        out[1] = (char)(0x80 | (code_point >> 6 & 0x3F));
+        out[2] = (char)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | code_point >> 18);
+    out[1] = (char)(0x80 | (code_point >> 12 & 0x3F));
+    out[2] = (char)(0x80 | (code_point >> 6 & 0x3F));
+    out[3] = (char)(0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+/**
+ * @brief Unescape contents of <string> validated by `scan_json_string`.
+ * @param content characters between quotation marks
+ * @param length length of `content`
+ * @param decoded out parameter, which must hold `length + 1` bytes. Unescaped string is never longer than escaped one.
+ * @return Length of `decoded`, excluding NUL
+ */
+static size_t decode_json_string(const char *content, size_t length, char *decoded) {
+    size_t decoded_length = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        /* copy a run without escapes at once */
+        const char *backslash = memchr(content + i, '\\', length - i);
+        size_t run = backslash ? (size_t)(backslash - content) - i : length - i;
+        memcpy(decoded + decoded_length, content + i, run);
+        decoded_length += run;
+        i += run;
+        if (i == length)
+            break;
+        i++;
+        switch (content[i]) {
+        case 'b':
+            decoded[decoded_length++] = '\b';
+            break;
+        case 'f':
+            decoded[decoded_length++] = '\f';
+            break;
+        case 'n':
+            decoded[decoded_length++] = '\n';
+            break;
+        case 'r':
+            decoded[decoded_length++] = '\r';
+            break;
+        case 't':
+            decoded[decoded_length++] = '\t';
+            break;
+        case 'u': {
+            uint32_t code_point = read_utf16_unit(content + i + 1);
+            i += 4;
+            if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+                /* high surrogate followed by low surrogate makes a pair. Escapes were validated, so 4 hex digits follow `\u` */
+                if (code_point <= 0xDBFF && i + 2 < length && content[i + 1] == '\\' && content[i + 2] == 'u') {
+                    uint32_t low = read_utf16_unit(content + i + 3);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    } else {
+                        code_point = 0xFFFD;
+                    }
+                } else {
+                    code_point = 0xFFFD;
+                }
+            }
+            decoded_length += encode_utf8(code_point, decoded + decoded_length);
+            break;
+        }
+        default:
+            /* '"', '\\' and '/' */
+            decoded[decoded_length++] = content[i];
+        }
+    }
+
+    decoded[decoded_length] = '\0';
+    return decoded_length;
 }
 
 optional_t parse_string_token(const char *string_token) {
@@ -46,453 +468,620 @@ optional_t parse_string_token(const char *string_token) {
         DLOGV("not valud\n");
         return (optional_t) {.stat = 0, .value = NULL};
     }
-    int i = 1;
-    int len = 1;
-    while ((string_token[len - 1] == '\\' || string_token[len] != '"') && string_token[len] != '\0') {        
-        len++;
-    }
-    /* parse failed */
-    if (string_token[len] == '\0') {
-        DLOGV("parse failed\n");
+    bool escaped;
+    ssize_t len = scan_json_string(string_token, string_token + strlen(string_token), &escaped);
+    if (len < 0) {
         return (optional_t) {.stat = 0, .value = NULL};
     }
-    len++;
 
     /* At least, parsed string is shoter than `len` */
-    char *ret = malloc(len);
-    int ret_len = 0;
-
-    for (i = 1; i < len - 1; i++) {
-        if (string_token[i] == '\\') {
-            i++;
-            if (string_token[i] == '"') {
-                ret[ret_len++] = '"';
-            } else if (string_token[i] == '\\') {
-                ret[ret_len++] = '\\';
-            } else if (string_token[i] == '/') {
-                ret[ret_len++] = '/';
-            } else if (string_token[i] == 'b') {
-                ret[ret_len++] = '\b';
-            } else if (string_token[i] == 'f') {
-                ret[ret_len++] = '\f';
-            } else if (string_token[i] == 'n') {
-                ret[ret_len++] = '\n';
-            } else if (string_token[i] == 'r') {
-                ret[ret_len++] = '\r';
-            } else if (string_token[i] == 't') {
-                ret[ret_len++] = '\t';
-            } else if (string_token[i] == 'u') {
-                int is_valid_unicode = 1;
-                /* <UTF-16> := u<hex><hex><hex><hex> */
-
-                i++;
-                if (!is_hex_digit(string_token[i])) {
-                    is_valid_unicode = 0;
-                }
-                i++;
-                if (!is_hex_digit(string_token[i])) {
-                    is_valid_unicode = 0;
-                }
-                i++;
-                if (!is_hex_digit(string_token[i])) {
-                    is_valid_unicode = 0;
-                }
-                i++;
-                if (!is_hex_digit(string_token[i])) {
-                    is_valid_unicode = 0;
-                }
-                if (!is_valid_unicode) {
-                    DLOGV("not valud\n");
-                    free(ret);
-                    return (optional_t) {.stat = 0, .value = NULL};
-                }
-                
-                // @TODO At now UTF-16 is parsed into whitespace.
-                ret[ret_len++] = ' ';
-            } else {
-                DLOGV("not valud\n");
-                    free(ret);
-                    return (optional_t) {.stat = 0, .value = NULL};
-            }
-            continue;
-        }
-
-        /* All characters are allowed (different from standard json) */
-        ret[ret_len++] = string_token[i];
+    char *ret = malloc(len - 1);
+    if (ret == NULL) {
+        return (optional_t) {.stat = 0, .value = NULL};
     }
-
-    ret[ret_len] = '\0';
+    decode_json_string(string_token + 1, len - 2, ret);
 
     return (optional_t) {
-        .stat = len,
+        .stat = (int)len,
         .value = (void *)ret
     };
 }
 
-optional_t parse_json_element(const char *json_element_string) {
-   
-    int offset = 0;
-    struct json_element *json_element = (struct json_element*)malloc(sizeof(struct json_element));
-    char *start_of_key;
-    char *start_of_value;
-
-    json_element->key = NULL;
-    json_element->value = NULL;
-
-    /* trim prefix */
-    start_of_key = find_non_space(json_element_string);  
-    offset = (int)(start_of_key - json_element_string);
-
-    optional_t name_str = parse_string_token(start_of_key);
-    if (!name_str.stat) {
-        goto parse_json_element_error;
-    }
-    json_element->key = name_str.value;
-    offset += name_str.stat;
-    
-    
-    /* trim suffix */
-    start_of_value = find_non_space(json_element_string + offset);
-    if (!start_of_value || *start_of_value != ':') {
-        DLOGV("parse failed");
-        goto parse_json_element_error;
-    }
-
-    /* trim prefix */
-    start_of_value = find_non_space(start_of_value + 1);
-
-    /* step to parse value */
-    offset = (int)(start_of_value - json_element_string);
-
-    /* if not <string> */
-    if (json_element_string[offset] != '\"') { 
-        json_element->value_type = JSON_NUMBER;
-        char *end_of_value = start_of_value;
-        int length;
-        while (*end_of_value && *end_of_value != ',' && *end_of_value != '}')
-            end_of_value++;
-        offset += (int)(end_of_value - start_of_value);
-        end_of_value--;
-        /* trim suffix */
-        while (is_non_space(*end_of_value)) 
-            end_of_value--;
-        length = (int)(end_of_value - start_of_value) + 1;
-        
-        json_element->value = (char*)malloc(length + 1);
-        strncpy(json_element->value, start_of_value, length);
-        json_element->value[length] = '\0';
-    } else {              
-        optional_t value_str = parse_string_token(start_of_value);
-        if (!value_str.stat) {
-            goto parse_json_element_error;
-        }
-        json_element->value_type = JSON_STRING;
-        json_element->value = value_str.value;
-        offset += value_str.stat;
-    }
- 
-    return (optional_t) { .stat = offset, .value = (void *)json_element };
-    
-parse_json_element_error:
-    if (json_element->key)
-        free(json_element->key);
-    if (json_element->value)
-        free(json_element->value);
-    free(json_element);
-    return (optional_t) { .stat = 0, .value = NULL };
-}
-
-struct json_object *parse_json(const char *json_string) {    
-    if (json_string[0] != '{') {
-        return NULL;
+/**
+ * @brief Scan <number> := -? (0 | [1-9][0-9]*) (. [0-9]+)? ([eE] [+-]? [0-9]+)?
+ * @return Length of <number>, or -1 if not valid
+ */
+static int scan_json_number(const char *token) {
+    const char *cursor = token;
+
+    if (*cursor == '-')
+        cursor++;
+    if (*cursor == '0') {
+        cursor++;
+    } else if (*cursor >= '1' && *cursor <= '9') {
+        while (*cursor >= '0' && *cursor <= '9')
+            cursor++;
+    } else {
+        return -1;
     }
-    const int INITIAL_CAPACITTY = 8;
-    struct json_object *json_object_ret = (struct json_object *)malloc(sizeof(struct json_object));
-    json_object_ret->size = 0;
-    json_object_ret->capacity = INITIAL_CAPACITTY;
-    json_object_ret->items = (struct json_element **)malloc(INITIAL_CAPACITTY * sizeof(struct json_element*));
-    
-    int offset = 1;
-    while (json_string[offset] != '\0') {
-        const char *first_non_space = find_non_space(json_string + offset);
-        if (first_non_space == NULL) { /* parse failed */
-            DLOGV("parse failed: No Contents\n");
-            destruct_json_object(json_object_ret);
-            break;
-        }     
-        
-        /* json end */
-        if (*first_non_space == '}') {            
-            break;
-        }
 
-        /* parse failed: key needs to be <string> */
-        if (*first_non_space != '"') {
-            DLOGV("parse failed\n");
-            destruct_json_object(json_object_ret);
-            break;
-        }
+    if (*cursor == '.') {
+        cursor++;
+        if (!(*cursor >= '0' && *cursor <= '9'))
+            return -1;
+        while (*cursor >= '0' && *cursor <= '9')
+            cursor++;
+    }
 
-        // get a `<string>:<value>` pair
-        optional_t parse_ret = parse_json_element(first_non_space);
-        struct json_element *parsed_element = parse_ret.value;
-        
-        if (parsed_element == NULL) { /* parse failed */
-            DLOGV("parse failed: from parse_element\n");
-            destruct_json_object(json_object_ret);
-            break;
-        }
+    if (*cursor == 'e' || *cursor == 'E') {
+        cursor++;
+        if (*cursor == '+' || *cursor == '-')
+            cursor++;
+        if (!(*cursor >= '0' && *cursor <= '9'))
+            return -1;
+        while (*cursor >= '0' && *cursor <= '9')
+            cursor++;
+    }
+
+    return (int)(cursor - token);
+}
+
+/**
+ * @brief Parse <string> at the cursor into arena.
+ */
+static int parse_json_string(struct json_parser *parser, char **string, int *size) {
+    bool escaped;
+    ssize_t length = scan_json_string(parser->cursor, parser->end, &escaped);
+    if (length < 0)
+        return -1;
+
+    *string = allocate_json_arena(parser->object, length - 1);
+    if (*string == NULL)
+        return -1;
+    if (escaped) {
+        *size = (int)decode_json_string(parser->cursor + 1, length - 2, *string);
+    } else {
+        *size = (int)(length - 2);
+        memcpy(*string, parser->cursor + 1, length - 2);
+        (*string)[length - 2] = '\0';
+    }
+    parser->cursor += length;
+    return 0;
+}
 
-        /* insert parsed_element into json_object::items */
-        if (json_object_ret->capacity == json_object_ret->size) {
-            int new_capacity = json_object_ret->capacity * 2;
-            struct json_element** new_headers = realloc(json_object_ret->items, new_capacity * sizeof(struct json_element*));
-            json_object_ret->items = new_headers;
-            json_object_ret->capacity = new_capacity;
+static int push_json_element(struct json_parser *parser, const struct json_element *element) {
+    if (parser->stack_size == parser->stack_capacity) {
+        int new_capacity = parser->stack_capacity * 2;
+        struct json_element *new_stack;
+
+        if (parser->stack_allocated) {
+            new_stack = realloc(parser->stack, new_capacity * sizeof(struct json_element));
+        } else {
+            new_stack = malloc(new_capacity * sizeof(struct json_element));
+            if (new_stack)
+                memcpy(new_stack, parser->stack, parser->stack_size * sizeof(struct json_element));
         }
+        if (new_stack == NULL) {
+            DLOGV("malloc failed\n");
+            return -1;
+        }
+        parser->stack = new_stack;
+        parser->stack_capacity = new_capacity;
+        parser->stack_allocated = true;
+    }
+    parser->stack[parser->stack_size++] = *element;
+    return 0;
+}
+
+static int parse_json_value(struct json_parser *parser, struct json_element *element);
+
+/**
+ * @brief Parse <object> or <array> at the cursor. Items are pushed to the stack of parser while parsing,
+ * and then copied into arena contiguously.
+ */
+static int parse_json_container(struct json_parser *parser, struct json_element *element, enum json_value_type type) {
+    const char close = type == JSON_OBJECT ? '}' : ']';
+    const int base = parser->stack_size;
+
+    if (parser->depth == JSON_MAX_DEPTH) {
+        DLOGV("parse failed: nested too deep\n");
+        return -1;
+    }
+    parser->depth++;
+
+    parser->cursor = skip_json_whitespace(parser->cursor + 1);
+    if (*parser->cursor != close) {
+        for (;;) {
+            struct json_element item = {.key = NULL};
+
+            if (type == JSON_OBJECT) {
+                /* key needs to be <string> */
+                if (*parser->cursor != '"') {
+                    DLOGV("parse failed: key is expected but %c found\n", *parser->cursor);
+                    return -1;
+                }
+                int key_size;
+                if (parse_json_string(parser, &item.key, &key_size) == -1)
+                    return -1;
 
-        json_object_ret->items[json_object_ret->size++] = parsed_element;
-        offset = (int)(first_non_space - json_string) + parse_ret.stat;
+                parser->cursor = skip_json_whitespace(parser->cursor);
+                if (*parser->cursor != ':') {
+                    DLOGV("parse failed: : is expected but %c found\n", *parser->cursor);
+                    return -1;
+                }
+                parser->cursor++;
+            }
 
-        offset = (int)(find_non_space(json_string + offset) - json_string);
-        /* If no more json name-value pair, then '}' is expected. */
-        if (json_string[offset] != ',') {
-            char last_ch_expected = *find_non_space(json_string + offset);
-            if (last_ch_expected != '}') {
-                DLOGV("parse failed: } is expected but %c found\n", last_ch_expected);
-                destruct_json_object(json_object_ret);
+            if (parse_json_value(parser, &item) == -1 || push_json_element(parser, &item) == -1)
+                return -1;
+
+            parser->cursor = skip_json_whitespace(parser->cursor);
+            if (*parser->cursor == close)
                 break;
+            if (*parser->cursor != ',') {
+                DLOGV("parse failed: %c is expected but %c found\n", close, *parser->cursor);
+                return -1;
             }
-            break;
+            parser->cursor = skip_json_whitespace(parser->cursor + 1);
         }
-        // else
-        offset++;
     }
-        
-    if (json_object_ret->capacity == 0) {
-        free(json_object_ret);
+    parser->cursor++;
+
+    element->value_type = type;
+    element->size = parser->stack_size - base;
+    element->items = NULL;
+    if (element->size > 0) {
+        /* large object has hash index before its members */
+        const size_t index_size = type == JSON_OBJECT && element->size >= JSON_INDEX_THRESHOLD ? sizeof(struct json_index) : 0;
+        char *memory = allocate_json_arena(parser->object, index_size + element->size * sizeof(struct json_element));
+        if (memory == NULL)
+            return -1;
+        element->items = (struct json_element *)(memory + index_size);
+        memcpy(element->items, parser->stack + base, element->size * sizeof(struct json_element));
+        if (index_size && build_json_index(parser->object, element->items, element->size, element->size) == -1)
+            return -1;
+    }
+    parser->stack_size = base;
+    parser->depth--;
+    return 0;
+}
+
+/**
+ * @brief Parse <value> at the cursor, skipping whitespaces before. `element->key` is not touched.
+ * @return 0 on success, -1 on error
+ */
+static int parse_json_value(struct json_parser *parser, struct json_element *element) {
+    const char *token = parser->cursor = skip_json_whitespace(parser->cursor);
+    int length;
+
+    switch (*token) {
+    case '{':
+        return parse_json_container(parser, element, JSON_OBJECT);
+    case '[':
+        return parse_json_container(parser, element, JSON_ARRAY);
+    case '"':
+        element->value_type = JSON_STRING;
+        return parse_json_string(parser, &element->value, &element->size);
+    case 't':
+        element->value_type = JSON_BOOLEAN;
+        length = strncmp(token, "true", 4) == 0 ? 4 : -1;
+        break;
+    case 'f':
+        element->value_type = JSON_BOOLEAN;
+        length = strncmp(token, "false", 5) == 0 ? 5 : -1;
+        break;
+    case 'n':
+        element->value_type = JSON_NULL;
+        length = strncmp(token, "null", 4) == 0 ? 4 : -1;
+        break;
+    default:
+        element->value_type = JSON_NUMBER;
+        length = scan_json_number(token);
+    }
+
+    if (length < 0) {
+        DLOGV("parse failed: value is expected\n");
+        return -1;
+    }
+    element->value = copy_json_text(parser->object, token, length);
+    if (element->value == NULL)
+        return -1;
+    element->size = length;
+    parser->cursor += length;
+    return 0;
+}
+
+struct json_object *parse_json(const char *json_string) {
+    /* most of payload is usually <string> which is decoded into as many bytes, so reserve it ahead */
+    size_t length = strlen(json_string);
+    struct json_object *json_object_ret = allocate_json_object(length + length / 2 + JSON_ARENA_MIN_SIZE);
+    if (json_object_ret == NULL) {
         return NULL;
     }
+
+    struct json_element stack[JSON_PARSER_STACK_SIZE];
+    struct json_parser parser = {
+        .cursor = skip_json_whitespace(json_string),
+        .end = json_string + length,
+        .object = json_object_ret,
+        .stack = stack,
+        .stack_size = 0,
+        .stack_capacity = JSON_PARSER_STACK_SIZE,
+        .stack_allocated = false,
+        .depth = 0
+    };
+    struct json_element root = {.key = NULL};
+
+    if (*parser.cursor != '{') {
+        DLOGV("parse failed: { is expected\n");
+        goto parse_json_error;
+    }
+    if (parse_json_value(&parser, &root) == -1) {
+        goto parse_json_error;
+    }
+    if (*skip_json_whitespace(parser.cursor) != '\0') {
+        DLOGV("parse failed: trailing characters after object\n");
+        goto parse_json_error;
+    }
+
+    if (parser.stack_allocated)
+        free(parser.stack);
+    json_object_ret->size = root.size;
+    json_object_ret->capacity = root.size;
+    json_object_ret->items = root.items;
     return json_object_ret;
+
+parse_json_error:
+    if (parser.stack_allocated)
+        free(parser.stack);
+    destruct_json_object(json_object_ret);
+    return NULL;
+}
+
+struct json_object *create_json_object(void) {
+    return allocate_json_object(JSON_ARENA_MIN_SIZE);
 }
 
 struct json_object* insert_json_element(struct json_object *json_object, const char *key, const char *value, enum json_value_type value_type) {
-    for (int i = 0; i < json_object->size; i++) {
-        if (strcmp(json_object->items[i]->key, key) == 0) {
-            return NULL;
-        }
+    if (value_type == JSON_OBJECT || value_type == JSON_ARRAY) {
+        return NULL;
+    }
+    if (find_json_element(json_object, key) != NULL) {
+        return NULL;
     }
 
     if (json_object->capacity == json_object->size) {
-        int new_capacity = json_object->capacity * 2;
+        int new_capacity = json_object->capacity ? json_object->capacity * 2 : 8;
 
-        struct json_element** new_headers = realloc(json_object->items, new_capacity * sizeof(struct json_element*));
+        /* the old array is left in arena, and released together. Room for hash index is always reserved, which is built when needed. */
+        char *memory = allocate_json_arena(json_object, sizeof(struct json_index) + new_capacity * sizeof(struct json_element));
+        if (memory == NULL)
+            return NULL;
+        struct json_element *new_items = (struct json_element *)(memory + sizeof(struct json_index));
+        json_index_of(new_items)->slots = NULL;
+        if (json_object->size > 0)
+            memcpy(new_items, json_object->items, json_object->size * sizeof(struct json_element));
 
-        json_object->items = new_headers;
-        json_object->capacity = new_capacity;            
+        json_object->items = new_items;
+        json_object->capacity = new_capacity;
     }
 
-    struct json_element *element = (struct json_element *)malloc(sizeof(struct json_element));
-    if (element == NULL)
-        return NULL;
-
-    char *new_key = strdup(key);
-    char *new_value = strdup(value);
+    size_t value_length = strlen(value);
+    char *new_key = copy_json_text(json_object, key, strlen(key));
+    char *new_value = copy_json_text(json_object, value, value_length);
 
     if (!new_key || !new_value) {
-        if (!new_key)
-            free(new_key);
-        if (!new_value)
-            free(new_value);
-        free(element);
         return NULL;
     }
-    
+
+    struct json_element *element = &json_object->items[json_object->size++];
     element->value_type = value_type;
+    element->size = (int)value_length;
     element->key = new_key;
     element->value = new_value;
 
-    json_object->items[json_object->size++] = element;
-    
+    if (json_object->size >= JSON_INDEX_THRESHOLD) {
+        struct json_index *index = json_index_of(json_object->items);
+        if (index->slots == NULL) {
+            if (build_json_index(json_object, json_object->items, json_object->size, json_object->capacity) == -1) {
+                json_object->size--;
+                return NULL;
+            }
+        } else {
+            add_json_index(index, json_object->items, json_object->size - 1);
+        }
+    }
+
     return json_object;
 }
 
-struct json_element* find_json_element(const struct json_object *object, const char *key) {
-    for (int i = 0; i < object->size; i++) {
-        if (strcmp(object->items[i]->key, key) == 0) 
-            return object->items[i];
+static struct json_element *find_json_item(struct json_element *items, int size, const char *key) {
+    if (size >= JSON_INDEX_THRESHOLD) {
+        const struct json_index *index = json_index_of(items);
+        const uint32_t hash = hash_json_key(key);
+
+        for (uint32_t slot = hash & index->mask; index->slots[slot].position; slot = (slot + 1) & index->mask) {
+            const struct json_index_slot *entry = &index->slots[slot];
+            if (entry->hash == hash && strcmp(items[entry->position - 1].key, key) == 0)
+                return &items[entry->position - 1];
+        }
+        return NULL;
+    }
+
+    for (int i = 0; i < size; i++) {
+        if (strcmp(items[i].key, key) == 0)
+            return &items[i];
     }
     return NULL;
 }
 
-char *json_object_stringify(const struct json_object *object) {
-    char *ret = NULL;
-    int ret_len = 0;
+struct json_element* find_json_element(const struct json_object *object, const char *key) {
+    return find_json_item(object->items, object->size, key);
+}
 
-    for (int idx = 0; idx < object->size; idx++) {
-        const struct json_element *item = object->items[idx];
-        for (int i = 0; item->key[i]; i++) {
-            /* Excluding UTF-16, characters that require escape processing 
-             * should be stored as 2 bytes, including the escape character. 
-             */
-            switch (item->key[i]) {            
-            case '"':
-            case '\\':
-            case '/':
-            case '\b':
-            case '\f':
-            case '\n':
-            case '\r':
-            case '\t':            
-                ret_len++;
-            default:
-                ret_len++;
+struct json_element* find_json_member(const struct json_element *object, const char *key) {
+    if (object->value_type != JSON_OBJECT)
+        return NULL;
+    return find_json_item(object->items, object->size, key);
+}
+
+struct json_writer *init_json_writer(struct json_writer *writer, int (*flush)(void *data, const void *bytes, size_t length), void *data) {
+    writer->buffer = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+    writer->flush = flush;
+    writer->flush_data = data;
+    writer->has_value = false;
+    writer->failed = false;
+    return writer;
+}
+
+static int flush_json_writer_buffer(struct json_writer *writer) {
+    if (writer->length > 0 && writer->flush(writer->flush_data, writer->buffer, writer->length) == -1) {
+        DLOGV("flush failed\n");
+        writer->failed = true;
+        return -1;
+    }
+    writer->length = 0;
+    return 0;
+}
+
+/**
+ * @brief Append bytes to `writer`. One byte of `json_writer::buffer` is always left for NUL.
+ */
+static void append_json_writer(struct json_writer *writer, const void *bytes, size_t length) {
+    if (writer->failed)
+        return;
+
+    if (writer->capacity - writer->length <= length) {
+        if (writer->flush) {
+            if (writer->buffer == NULL) {
+                writer->buffer = malloc(JSON_WRITER_BUFFER_SIZE);
+                if (writer->buffer == NULL) {
+                    writer->failed = true;
+                    return;
+                }
+                writer->capacity = JSON_WRITER_BUFFER_SIZE;
+            } else if (flush_json_writer_buffer(writer) == -1) {
+                return;
             }
-        }
-        /* need to wrap with quotation marks */
-        ret_len += 2;
-
-        /* need to insert a colon */
-        ret_len += 1;
-        
-        if (item->value_type == JSON_STRING) {
-            for (int i = 0; item->value[i]; i++) {
-                /* Excluding UTF-16, characters that require escape processing 
-                * should be stored as 2 bytes, including the escape character. 
-                */
-                switch (item->value[i]) {            
-                case '"':
-                case '\\':
-                case '/':
-                case '\b':
-                case '\f':
-                case '\n':
-                case '\r':
-                case '\t':            
-                    ret_len++;
-                default:
-                    ret_len++;
+            /* a long run is flushed as it is, without copying */
+            if (length >= writer->capacity) {
+                if (writer->flush(writer->flush_data, bytes, length) == -1) {
+                    DLOGV("flush failed\n");
+                    writer->failed = true;
                 }
+                return;
             }
-            /* need to wrap with quotation marks */
-            ret_len += 2;
         } else {
-            ret_len += strlen(item->value);
-        }            
+            size_t new_capacity = writer->capacity ? writer->capacity * 2 : JSON_WRITER_BUFFER_SIZE;
+            while (new_capacity - writer->length <= length)
+                new_capacity *= 2;
+            char *new_buffer = realloc(writer->buffer, new_capacity);
+            if (new_buffer == NULL) {
+                DLOGV("realloc failed\n");
+                writer->failed = true;
+                return;
+            }
+            writer->buffer = new_buffer;
+            writer->capacity = new_capacity;
+        }
     }
 
-    /* two culry brackets and commas for seperating each name/value pair */
-    ret_len += 2 + (object->size - 1);
+    memcpy(writer->buffer + writer->length, bytes, length);
+    writer->length += length;
+}
 
+static inline void write_json_separator(struct json_writer *writer) {
+    if (writer->has_value)
+        append_json_writer(writer, ",", 1);
+}
 
-    /* actual serializing step */
-    ret = malloc(ret_len + 1);
-    int reti = 0;
-    ret[reti++] = '{';
-    
-    for (int idx = 0; idx < object->size; idx++) {
-        const struct json_element *item = object->items[idx];
-
-        /* name */
-        ret[reti++] = '"';
-        for (int i = 0; item->key[i]; i++) {
-            /* if needed, do escaping */
-            switch (item->key[i]) {            
-            case '"':
-                ret[reti++] = '\\';
-                ret[reti++] = '"';
-                break;
-            case '\\':
-                ret[reti++] = '\\';
-                ret[reti++] = '\\';
-                break;
-            case '/':
-                ret[reti++] = '\\';
-                ret[reti++] = '/';
-                break;
-            case '\b':
-                ret[reti++] = '\\';
-                ret[reti++] = 'b';
-                break;
-            case '\f':
-                ret[reti++] = '\\';
-                ret[reti++] = 'f';
-                break;
-            case '\n':
-                ret[reti++] = '\\';
-                ret[reti++] = 'n';
-                break;
-            case '\r':
-                ret[reti++] = '\\';
-                ret[reti++] = 'r';
-                break;
-            case '\t':            
-                ret[reti++] = '\\';
-                ret[reti++] = 't';
-                break;
-            default:
-                ret[reti++] = item->key[i];
-            }            
-        }
-        ret[reti++] = '"';
-        ret[reti++] = ':';
-
-        /* value */
-        if (item->value_type == JSON_STRING) {
-            ret[reti++] = '"';
-            for (int i = 0; item->value[i]; i++) {
-                /* if needed, do escaping */
-                switch (item->value[i]) {            
-                case '"':
-                    ret[reti++] = '\\';
-                    ret[reti++] = '"';
-                    break;
-                case '\\':
-                    ret[reti++] = '\\';
-                    ret[reti++] = '\\';
-                    break;
-                case '/':
-                    ret[reti++] = '\\';
-                    ret[reti++] = '/';
-                    break;
-                case '\b':
-                    ret[reti++] = '\\';
-                    ret[reti++] = 'b';
-                    break;
-                case '\f':
-                    ret[reti++] = '\\';
-                    ret[reti++] = 'f';
-                    break;
-                case '\n':
-                    ret[reti++] = '\\';
-                    ret[reti++] = 'n';
-                    break;
-                case '\r':
-                    ret[reti++] = '\\';
-                    ret[reti++] = 'r';
-                    break;
-                case '\t':            
-                    ret[reti++] = '\\';
-                    ret[reti++] = 't';
-                    break;
-                default:
-                    ret[reti++] = item->value[i];
-                }            
-            }
-            ret[reti++] = '"';
-        } else {
-            for (int i = 0; item->value[i]; i++) {
-                ret[reti++] = item->value[i];
-            }
+/**
+ * @brief Write `string` wrapped with quotation marks. Runs of plain characters are found by `skip_json_string_plain` and copied at once.
+ */
+static void write_json_quoted(struct json_writer *writer, const char *string, size_t length) {
+    const char *cursor = string;
+    const char *end = string + length;
+
+    append_json_writer(writer, "\"", 1);
+    for (;;) {
+        const char *special = skip_json_string_plain(cursor, end);
+        if (special > cursor)
+            append_json_writer(writer, cursor, special - cursor);
+        if (special == end)
+            break;
+
+        char escape[8];
+        switch (*special) {
+        case '"':
+            append_json_writer(writer, "\\\"", 2);
+            break;
+        case '\\':
+            append_json_writer(writer, "\\\\", 2);
+            break;
+        case '\b':
+            append_json_writer(writer, "\\b", 2);
+            break;
+        case '\f':
+            append_json_writer(writer, "\\f", 2);
+            break;
+        case '\n':
+            append_json_writer(writer, "\\n", 2);
+            break;
+        case '\r':
+            append_json_writer(writer, "\\r", 2);
+            break;
+        case '\t':
+            append_json_writer(writer, "\\t", 2);
+            break;
+        default:
+            /* the other control characters */
+            snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)*special);
+            append_json_writer(writer, escape, 6);
         }
+        cursor = special + 1;
+    }
+    append_json_writer(writer, "\"", 1);
+}
+
+void begin_json_object(struct json_writer *writer) {
+    write_json_separator(writer);
+    append_json_writer(writer, "{", 1);
+    writer->has_value = false;
+}
+
+void end_json_object(struct json_writer *writer) {
+    append_json_writer(writer, "}", 1);
+    writer->has_value = true;
+}
+
+void begin_json_array(struct json_writer *writer) {
+    write_json_separator(writer);
+    append_json_writer(writer, "[", 1);
+    writer->has_value = false;
+}
+
+void end_json_array(struct json_writer *writer) {
+    append_json_writer(writer, "]", 1);
+    writer->has_value = true;
+}
+
+void write_json_key(struct json_writer *writer, const char *key) {
+    write_json_separator(writer);
+    write_json_quoted(writer, key, strlen(key));
+    append_json_writer(writer, ":", 1);
+    writer->has_value = false;
+}
 
-        if (idx < object->size - 1) {
-            ret[reti++] = ',';
+void write_json_string(struct json_writer *writer, const char *string, size_t length) {
+    write_json_separator(writer);
+    write_json_quoted(writer, string, length);
+    writer->has_value = true;
+}
+
+static void write_json_text(struct json_writer *writer, const char *text, size_t length) {
+    write_json_separator(writer);
+    append_json_writer(writer, text, length);
+    writer->has_value = true;
+}
+
+void write_json_integer(struct json_writer *writer, long long value) {
+    char text[24];
+    int length = snprintf(text, sizeof(text), "%lld", value);
+    write_json_text(writer, text, length);
+}
+
+void write_json_number(struct json_writer *writer, double value) {
+    char text[32];
+    int length;
+
+    if (!isfinite(value)) {
+        write_json_null(writer);
+        return;
+    }
+    /* 15 digits are enough for most values, and 17 digits always read back as the same value */
+    length = snprintf(text, sizeof(text), "%.15g", value);
+    if (strtod(text, NULL) != value)
+        length = snprintf(text, sizeof(text), "%.17g", value);
+    write_json_text(writer, text, length);
+}
+
+void write_json_boolean(struct json_writer *writer, bool value) {
+    if (value)
+        write_json_text(writer, "true", 4);
+    else
+        write_json_text(writer, "false", 5);
+}
+
+void write_json_null(struct json_writer *writer) {
+    write_json_text(writer, "null", 4);
+}
+
+void write_json_element(struct json_writer *writer, const struct json_element *element) {
+    switch (element->value_type) {
+    case JSON_OBJECT:
+        begin_json_object(writer);
+        for (int i = 0; i < element->size; i++) {
+            write_json_key(writer, element->items[i].key);
+            write_json_element(writer, &element->items[i]);
         }
+        end_json_object(writer);
+        break;
+    case JSON_ARRAY:
+        begin_json_array(writer);
+        for (int i = 0; i < element->size; i++) {
+            write_json_element(writer, &element->items[i]);
+        }
+        end_json_array(writer);
+        break;
+    case JSON_STRING:
+        write_json_string(writer, element->value, element->size);
+        break;
+    default:
+        /* <number>, true, false and null are kept as they were written */
+        write_json_text(writer, element->value, element->size);
     }
-    ret[reti++] = '}';
-    ret[reti] = '\0';
+}
 
-    assert(reti == ret_len);
-    return ret;
-}
\ No newline at end of file
+int finish_json_writer(struct json_writer *writer) {
+    if (writer->failed)
+        return -1;
+    if (writer->flush)
+        return flush_json_writer_buffer(writer);
+
+    /* nothing was written */
+    if (writer->buffer == NULL) {
+        writer->buffer = malloc(1);
+        if (writer->buffer == NULL)
+            return -1;
+        writer->capacity = 1;
+    }
+    writer->buffer[writer->length] = '\0';
+    return 0;
+}
+
+void destruct_json_writer(struct json_writer *writer) {
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+}
+
+char *json_object_stringify(const struct json_object *object) {
+    struct json_writer writer;
+    init_json_writer(&writer, NULL, NULL);
+
+    begin_json_object(&writer);
+    for (int idx = 0; idx < object->size; idx++) {
+        write_json_key(&writer, object->items[idx].key);
+        write_json_element(&writer, &object->items[idx]);
+    }
+    end_json_object(&writer);
+
+    if (finish_json_writer(&writer) == -1) {
+        destruct_json_writer(&writer);
+        return NULL;
+    }
+    return writer.buffer;
+}
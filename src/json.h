@@ -27,8 +27,33 @@ enum json_value_type {
 };
 
 /**
- * @brief element in json
- * @note key-value pair
+ * @brief Maximum nesting depth of objects and arrays. A deeper input is rejected, so that the recursive parser cannot exhaust the stack.
+ */
+#define JSON_MAX_DEPTH 256
+
+/**
+ * @brief Minimum size of a memory chunk of `struct json_object`, in bytes
+ */
+#define JSON_ARENA_MIN_SIZE 1024
+
+/**
+ * @brief Objects having this number of members or more are indexed by hash of keys, while smaller ones are scanned linearly.
+ */
+#define JSON_INDEX_THRESHOLD 16
+
+/**
+ * @brief chunk of memory in which a json object and all its elements are allocated
+ */
+struct json_arena;
+
+/**
+ * @brief Size of buffer of `struct json_writer` with `flush`, in which small writes are gathered
+ */
+#define JSON_WRITER_BUFFER_SIZE 4096
+
+/**
+ * @brief element in json, tagged by `value_type`
+ * @note key-value pair of an object, or an item of an array
  */
 struct json_element {
     /**
@@ -36,17 +61,30 @@ struct json_element {
      */
     enum json_value_type value_type;
     /**
-    * @brief key of a json_element to value
+     * @brief the number of `items` if the value is <object> or <array>, otherwise length of `value` in bytes excluding NUL.
+     * `value` of <string> may contain NUL if it was escaped as `\u0000`.
+     */
+    int size;
+    /**
+    * @brief key of a json_element to value. **NULL** for items of <array>.
     */
     char *key; 
-    /**
-     * @brief value of a json_element by key
-     */
-    char *value;
+    union {
+        /**
+         * @brief value of a json_element by key, if it is not <object> or <array>. NUL-terminated.   
+         * <string> is stored unescaped, and the others are stored as they were written, e.g. `-1.5e3`, `true` or `null`.
+         */
+        char *value;
+        /**
+         * @brief members of <object> or items of <array>, stored contiguously in order of input. **NULL** if empty.
+         * An <object> having `JSON_INDEX_THRESHOLD` members or more has a hash index of keys right before them, so keys must not be modified.
+         */
+        struct json_element *items;
+    };
 };
 /**
  * @brief json_object
- * @note size is the number of json_element
+ * @note It lives in its own arena with all elements, keys and values, which is released at once by `destruct_json_object`.
  * 
  */
 struct json_object {
@@ -59,16 +97,58 @@ struct json_object {
      */
     int capacity;
     /**
-     * @brief the array of json_elemnts
+     * @brief the array of json_elemnts, stored contiguously in order of insertion.
+     * Indexed by hash of keys as `json_element::items` of <object>.
      */
-    struct json_element **items;
+    struct json_element *items;
+    /**
+     * @brief the newest chunk of arena. Chunks are linked to older ones.
+     */
+    struct json_arena *arena;
 };
 
+/**
+ * @brief Serializer writing json in a single pass, as values are given, e.g. `begin_json_object`, `write_json_key` and `write_json_string`.   
+ * Without `flush`, json is written into `buffer` growing as needed, which can be taken as a response body as it is.
+ * With `flush`, small writes are gathered into `buffer` and flushed, and a long run of a string is flushed as it is without copying.
+ * @note Errors are sticky, so check only the result of `finish_json_writer`. Calls must make valid json, which is not checked:
+ * inside an object, each value must follow `write_json_key`.
+ */
+struct json_writer {
+    /**
+     * @brief written json. Without `flush`, it is NUL-terminated by `finish_json_writer`, and the caller takes it.
+     */
+    char *buffer;
+    /**
+     * @brief the number of bytes in `buffer`, excluding NUL
+     */
+    size_t length;
+    /**
+     * @brief allocated size of `buffer`
+     */
+    size_t capacity;
+    /**
+     * @brief function which consumes written bytes, e.g. a wrapper of `write_http_chunk`. Returns 0 on success, -1 on error. **NULL** to write into `buffer` only.
+     */
+    int (*flush)(void *data, const void *bytes, size_t length);
+    /**
+     * @brief user data passed to `flush`
+     */
+    void *flush_data;
+    /**
+     * @brief whether a value was written in the current object or array, so the next one needs a comma
+     */
+    bool has_value;
+    /**
+     * @brief set when allocation or `flush` failed. Later writes are ignored.
+     */
+    bool failed;
+};
 
 /**
- * @brief Cleanup `struct json_object` instance.
+ * @brief Release `struct json_object` instance and all its elements at once.
  * 
- * @param headers target to cleanup
+ * @param json_object target to release, created by `parse_json` or `create_json_object`. It must not be used after.
  */
 void destruct_json_object(struct json_object* json_object);
 
@@ -76,45 +156,44 @@ void destruct_json_object(struct json_object* json_object);
  * @brief Parse given string as <string> of json, and then return actual content string.   
  * After closing quotation mark, left chracters are ignored.    
  * ex) `"na"me` is parsed into `na`
- * At now, UTF-16 is parsed as whitespace.   
+ * `\uXXXX` is decoded into UTF-8, with surrogate pairs combined. A lone surrogate is decoded into U+FFFD.
  * 
  * @param string_token given
- * @return Read length and actual string which was wrapped with quotation marks.
+ * @return Read length and actual string which was wrapped with quotation marks, allocated with `malloc`.
+ * If it is not valid, e.g. not closed or has a control character not escaped, `stat` is 0.
  */
 optional_t parse_string_token(const char *string_token);
 
-/**
- * @brief Parse <string>:<value>    
- * At now, parsable value only can be an <number>, <string>, true, false, or null, while cannot be <object> or <array>.   
- * And, it cannot determine if <number>, true, false, or null tokens is malformed.
- * 
- * @param json_element_string `<string>:<value>` string
- * @return Read length and `struct json_element *`.
- * @note <string> is stored as return value from `parse_string_token`.
- */
-optional_t parse_json_element(const char *json_element_string);
-
 /**
  * @brief Parse serialized json object
  * 
- * @param json_string serialized json object
- * @return Json obejct as struct alloctaed with malloc. If parsed failed in any situation, return NULL.
+ * @param json_string serialized json object. Whitespaces may surround it, but any other trailing character is rejected.
+ * @return Json obejct whose values can be nested objects and arrays. Release it with `destruct_json_object`.
  * @retval **NULL** Failed to parse in any situation.
  * @note By default, this function meets the standards in that document.   
  * https://www.ecma-international.org/wp-content/uploads/ECMA-404_2nd_edition_december_2017.pdf
- * @warning Some values are not permitted even though it meets json grammer. Note `parse_json_element()`
+ * @note The top-level value must be <object>. Nesting deeper than `JSON_MAX_DEPTH` is rejected.
+ * Duplicate keys are kept, and `find_json_element` finds the first one.
  */
 struct json_object *parse_json(const char *json_string);
 
+/**
+ * @brief Create an empty json object, to be filled by `insert_json_element`.
+ * 
+ * @return Empty json object. Release it with `destruct_json_object`.
+ * @retval **NULL** Failed to allocate memory
+ */
+struct json_object *create_json_object(void);
+
 /**
  * @brief Insert new json name/value pair into `json_object`.
  * 
  * @param json_object a `struct json_object` where wants to store given name(key)/value pair.
  * @param key a key of new json element.
  * @param value a value of new json element.
- * @param value_type type of value to insert
+ * @param value_type type of value to insert. <object> and <array> cannot be inserted.
  * @return The `struct json_object` given as json_object. In any situation, failing to store new element, return **NULL**.
- * @note Internally, this function uses `malloc` and `strcpy` to store `key` and `value` into new element. (Actually, uses `strdup`)
+ * @note `key` and `value` are copied into the arena of `json_object`.
  */
 struct json_object* insert_json_element(struct json_object *json_object, const char *key, const char *value, enum json_value_type value_type);
 
@@ -125,14 +204,117 @@ struct json_object* insert_json_element(struct json_object *json_object, const c
  * @param key name to find
  * @return `json_element` matched by `key`. Returns **NULL** if not found.
  * @retval **NULL** Not found
+ * @note Objects having `JSON_INDEX_THRESHOLD` members or more are looked up by hash index built by `parse_json` or `insert_json_element`.
  */
 struct json_element* find_json_element(const struct json_object *object, const char *key);
 
+/**
+ * @brief Find a name/value pair having same `key` in a nested object.
+ * 
+ * @param object element whose value is <object>
+ * @param key name to find
+ * @return `json_element` matched by `key`. Returns **NULL** if not found.
+ * @retval **NULL** Not found, or `object` is not <object>
+ */
+struct json_element* find_json_member(const struct json_element *object, const char *key);
+
+/**
+ * @brief Initialize a json writer.
+ * 
+ * @param writer a `struct json_writer *` to init
+ * @param flush function which consumes written bytes, or **NULL** to write into `json_writer::buffer`
+ * @param data user data passed to `flush`
+ * @return always return `writer`
+ */
+struct json_writer *init_json_writer(struct json_writer *writer, int (*flush)(void *data, const void *bytes, size_t length), void *data);
+
+/**
+ * @brief Write `{`, starting an object as a value.
+ */
+void begin_json_object(struct json_writer *writer);
+
+/**
+ * @brief Write `}`, ending the object started last.
+ */
+void end_json_object(struct json_writer *writer);
+
+/**
+ * @brief Write `[`, starting an array as a value.
+ */
+void begin_json_array(struct json_writer *writer);
+
+/**
+ * @brief Write `]`, ending the array started last.
+ */
+void end_json_array(struct json_writer *writer);
+
+/**
+ * @brief Write a name of the next member of an object.
+ * 
+ * @param writer json writer
+ * @param key NUL-terminated name, escaped as <string>
+ */
+void write_json_key(struct json_writer *writer, const char *key);
+
+/**
+ * @brief Write a <string> value. `"`, `\` and control characters are escaped, while runs of other characters are copied at once.
+ * 
+ * @param writer json writer
+ * @param string characters to write, which may contain NUL (written as `\u0000`)
+ * @param length length of `string` in bytes
+ */
+void write_json_string(struct json_writer *writer, const char *string, size_t length);
+
+/**
+ * @brief Write a <number> value of an integer.
+ */
+void write_json_integer(struct json_writer *writer, long long value);
+
+/**
+ * @brief Write a <number> value, with the fewest digits read back as the same `double`. `null` if it is NaN or infinite, which json cannot represent.
+ */
+void write_json_number(struct json_writer *writer, double value);
+
+/**
+ * @brief Write `true` or `false`.
+ */
+void write_json_boolean(struct json_writer *writer, bool value);
+
+/**
+ * @brief Write `null`.
+ */
+void write_json_null(struct json_writer *writer);
+
+/**
+ * @brief Write the value of `element`, e.g. one found in a parsed object. Nested objects and arrays are written with their members.
+ * 
+ * @param writer json writer
+ * @param element element whose value to write. Its key is not written.
+ */
+void write_json_element(struct json_writer *writer, const struct json_element *element);
+
+/**
+ * @brief Finish writing. With `flush`, gathered bytes are flushed. Without `flush`, `json_writer::buffer` is NUL-terminated,
+ * and the caller takes it with `json_writer::length`, to be freed with `free`.
+ * 
+ * @param writer json writer
+ * @return 0 on success, -1 if any write failed. On failure, release `writer` with `destruct_json_writer`.
+ */
+int finish_json_writer(struct json_writer *writer);
+
+/**
+ * @brief Release `json_writer::buffer`, e.g. when writing failed or was abandoned.
+ * 
+ * @param writer target to cleanup
+ */
+void destruct_json_writer(struct json_writer *writer);
+
 /**
  * @brief Serialize json object and return string.
  * 
  * @param object json object to serialize
- * @return serialized json object
- * @note if there is value as json object, you need to make it serialized string before call this.
+ * @return serialized json object, allocated with `malloc`. Nested objects and arrays are serialized, too.
+ * @retval **NULL** Failed to allocate memory
+ * @note It is a shorthand of `write_json_element` for each member into a `struct json_writer` without `flush`.
  */
-char *json_object_stringify(const struct json_object *object);
\ No newline at end of file
+char *json_object_stringify(const struct json_object *object);
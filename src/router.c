@@ -0,0 +1,525 @@
+#include "router.h"
+
+/**
+ * @brief Length of path used as a key of the tree. A single trailing '/' is not a part of key.
+ */
+static size_t route_key_length(const char *path) {
+    size_t length = strlen(path);
+
+    /* even though the last '/' is omitted, it is the same path */
+    if (length > 0 && path[length - 1] == '/')
+        length--;
+    return length;
+}
+
+static struct route_node *create_route_node(const char *prefix, size_t prefix_length) {
+    struct route_node *node = (struct route_node *)calloc(1, sizeof(struct route_node));
+    if (node == NULL)
+        return NULL;
+
+    node->prefix = (char *)malloc(prefix_length + 1);
+    if (node->prefix == NULL) {
+        free(node);
+        return NULL;
+    }
+    memcpy(node->prefix, prefix, prefix_length);
+    node->prefix[prefix_length] = '\0';
+    node->prefix_length = prefix_length;
+
+    return node;
+}
+
+/**
+ * @brief Index of child whose prefix starts with `first`. -1 if there is no such child.
+ */
+static int find_child_index(const struct route_node *node, char first) {
+    if (node->child_count == 0)
+        return -1;
+
+    const char *found = memchr(node->indices, first, node->child_count);
+    return found ? (int)(found - node->indices) : -1;
+}
+
+static int append_child(struct route_node *node, struct route_node *child) {
+    char *indices = (char *)realloc(node->indices, node->child_count + 1);
+    if (indices == NULL)
+        return -1;
+    node->indices = indices;
+
+    struct route_node **children = (struct route_node **)realloc(node->children, (node->child_count + 1) * sizeof(struct route_node *));
+    if (children == NULL)
+        return -1;
+    node->children = children;
+
+    node->indices[node->child_count] = child->prefix[0];
+    node->children[node->child_count] = child;
+    node->child_count++;
+
+    return 0;
+}
+
+/**
+ * @brief Split `node->children[index]` at `at`. The child is replaced by a new node having first `at` bytes of its prefix,
+ * and the rest becomes the only child of the new node.
+ *
+ * @return New intermediate node. **NULL** if allocation failed.
+ */
+static struct route_node *split_child(struct route_node *node, int index, size_t at) {
+    struct route_node *child = node->children[index];
+    struct route_node *intermediate = create_route_node(child->prefix, at);
+    if (intermediate == NULL)
+        return NULL;
+
+    memmove(child->prefix, child->prefix + at, child->prefix_length - at + 1);
+    child->prefix_length -= at;
+
+    if (append_child(intermediate, child) == -1) {
+        /* restore child so that tree stays unchanged */
+        memmove(child->prefix + at, child->prefix, child->prefix_length + 1);
+        memcpy(child->prefix, intermediate->prefix, at);
+        child->prefix_length += at;
+        free_route_nodes(intermediate);
+        return NULL;
+    }
+
+    node->children[index] = intermediate;
+    return intermediate;
+}
+
+/**
+ * @brief Length of static part of `key`, up to (but not including) the next segment starting with ':' or '*'.
+ */
+static size_t static_part_length(const char *key, size_t key_length) {
+    for (size_t i = 1; i < key_length; i++) {
+        if (key[i - 1] == '/' && (key[i] == ':' || key[i] == '*'))
+            return i;
+    }
+    return key_length;
+}
+
+/**
+ * @brief Get or create the parameter (or wildcard) child of `node` named `name`.
+ * 
+ * @return The child. **NULL** if allocation failed or the child exists with another name.
+ */
+static struct route_node *parameter_child(struct route_node **slot, const char *name, size_t name_length) {
+    if (*slot == NULL) {
+        *slot = create_route_node(name, name_length);
+        return *slot;
+    }
+
+    if ((*slot)->prefix_length != name_length || memcmp((*slot)->prefix, name, name_length) != 0)
+        return NULL;
+    return *slot;
+}
+
+int insert_route_node(struct route_node **root, struct route *route) {
+    const char *key = route->path;
+    size_t key_length = route_key_length(route->path);
+    int parameter_count = 0;
+
+    if (route->method < 0 || route->method >= HTTP_METHOD_UNKNOWN)
+        return -1;
+
+    if (*root == NULL) {
+        *root = create_route_node("", 0);
+        if (*root == NULL)
+            return -1;
+    }
+
+    struct route_node *node = *root;
+
+    while (key_length > 0) {
+        /* parameter or wildcard segment, which starts right after '/' */
+        if ((key[0] == ':' || key[0] == '*') && key > route->path && key[-1] == '/') {
+            const char *end_of_segment = memchr(key, '/', key_length);
+            size_t segment_length = end_of_segment ? (size_t)(end_of_segment - key) : key_length;
+
+            if (++parameter_count > HTTP_MAX_PATH_PARAMETERS)
+                return -1;
+
+            if (key[0] == ':') {
+                if (segment_length == 1)
+                    return -1;
+                node = parameter_child(&node->parameter, key + 1, segment_length - 1);
+            } else {
+                /* wildcard takes the rest of path, so it must be the last segment */
+                if (segment_length != key_length)
+                    return -1;
+                node = segment_length == 1
+                    ? parameter_child(&node->wildcard, "*", 1)
+                    : parameter_child(&node->wildcard, key + 1, segment_length - 1);
+            }
+            if (node == NULL)
+                return -1;
+
+            key += segment_length;
+            key_length -= segment_length;
+            continue;
+        }
+
+        const size_t static_length = static_part_length(key, key_length);
+        int index = find_child_index(node, key[0]);
+
+        if (index == -1) {
+            struct route_node *leaf = create_route_node(key, static_length);
+            if (leaf == NULL)
+                return -1;
+            if (append_child(node, leaf) == -1) {
+                free_route_nodes(leaf);
+                return -1;
+            }
+            node = leaf;
+            key += static_length;
+            key_length -= static_length;
+            continue;
+        }
+
+        struct route_node *child = node->children[index];
+        size_t common = 0;
+        while (common < child->prefix_length && common < static_length && child->prefix[common] == key[common])
+            common++;
+
+        if (common < child->prefix_length) {
+            child = split_child(node, index, common);
+            if (child == NULL)
+                return -1;
+        }
+
+        node = child;
+        key += common;
+        key_length -= common;
+    }
+
+    if (node->routes[route->method] != NULL)
+        return -1;
+
+    node->routes[route->method] = route;
+    node->methods |= 1u << route->method;
+
+    return 0;
+}
+
+static void push_path_parameter(struct http_path_parameters *parameters, const char *name, size_t name_length, const char *value, size_t value_length) {
+    if (parameters == NULL || parameters->size == HTTP_MAX_PATH_PARAMETERS)
+        return;
+
+    parameters->items[parameters->size++] = (struct http_path_parameter) {
+        .name = name,
+        .name_length = name_length,
+        .value = value,
+        .value_length = value_length
+    };
+}
+
+/**
+ * @brief Match the rest of path from `node`, whose prefix is already matched. Backtracks when a static child does not lead to a route.
+ */
+static const struct route_node *match_route_node(const struct route_node *node, const char *path, size_t length, struct http_path_parameters *parameters) {
+    /* even though the last '/' is omitted, it is the same path */
+    if ((length == 0 || (length == 1 && path[0] == '/')) && node->methods != 0)
+        return node;
+
+    if (length > 0) {
+        int index = find_child_index(node, path[0]);
+
+        if (index != -1) {
+            const struct route_node *child = node->children[index];
+
+            if (length >= child->prefix_length && memcmp(path, child->prefix, child->prefix_length) == 0) {
+                const struct route_node *found = match_route_node(child, path + child->prefix_length, length - child->prefix_length, parameters);
+                if (found)
+                    return found;
+            }
+        }
+    }
+
+    if (node->parameter != NULL && length > 0 && path[0] != '/') {
+        const char *end_of_segment = memchr(path, '/', length);
+        size_t segment_length = end_of_segment ? (size_t)(end_of_segment - path) : length;
+        int saved_size = parameters ? parameters->size : 0;
+
+        push_path_parameter(parameters, node->parameter->prefix, node->parameter->prefix_length, path, segment_length);
+
+        const struct route_node *found = match_route_node(node->parameter, path + segment_length, length - segment_length, parameters);
+        if (found)
+            return found;
+
+        if (parameters)
+            parameters->size = saved_size;
+    }
+
+    if (node->wildcard != NULL) {
+        push_path_parameter(parameters, node->wildcard->prefix, node->wildcard->prefix_length, path, length);
+        return node->wildcard;
+    }
+
+    return NULL;
+}
+
+const struct route_node *find_route_node(const struct route_node *root, const char *path, struct http_path_parameters *parameters) {
+    if (parameters)
+        parameters->size = 0;
+    if (root == NULL)
+        return NULL;
+
+    return match_route_node(root, path, strlen(path), parameters);
+}
+
+void free_route_nodes(struct route_node *root) {
+    if (root == NULL)
+        return;
+
+    for (int i = 0; i < root->child_count; i++)
+        free_route_nodes(root->children[i]);
+
+    free_route_nodes(root->parameter);
+    free_route_nodes(root->wildcard);
+    free(root->children);
+    free(root->indices);
+    free(root->prefix);
+    free(root);
+}
+
+/**
+ * @brief Format methods of `methods` bitmap as `Allow` header value, such as "GET, HEAD, POST, OPTIONS".
+ *
+ * @param buffer formatted string is written. If **NULL**, only its length is computed.
+ * @return Length of formatted string, excluding NUL
+ */
+static size_t format_allowed_methods(unsigned int methods, char *buffer) {
+    size_t length = 0;
+
+    if (methods == 0) {
+        if (buffer)
+            buffer[0] = '\0';
+        return 0;
+    }
+
+    /* HEAD is answered by GET route, and OPTIONS by preflight response */
+    if (methods & (1u << HTTP_GET))
+        methods |= 1u << HTTP_HEAD;
+    methods |= 1u << HTTP_OPTIONS;
+
+    static const enum http_method order[] = {
+        HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS
+    };
+
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        const enum http_method method = order[i];
+        if (!(methods & (1u << method)))
+            continue;
+
+        const char *name = http_method_stringify(method);
+        const size_t name_length = strlen(name);
+
+        if (length > 0) {
+            if (buffer)
+                memcpy(buffer + length, ", ", 2);
+            length += 2;
+        }
+        if (buffer)
+            memcpy(buffer + length, name, name_length);
+        length += name_length;
+    }
+
+    if (buffer)
+        buffer[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Count nodes, routes and bytes of strings (including NUL) in the tree.
+ */
+static void measure_route_nodes(const struct route_node *node, int *node_count, int *route_count, size_t *string_bytes) {
+    (*node_count)++;
+    *string_bytes += node->prefix_length + 1;
+    *string_bytes += format_allowed_methods(node->methods, NULL) + 1;
+
+    for (int method = 0; method < HTTP_METHOD_UNKNOWN; method++) {
+        if (node->routes[method]) {
+            (*route_count)++;
+            *string_bytes += strlen(node->routes[method]->path) + 1;
+        }
+    }
+
+    for (int i = 0; i < node->child_count; i++)
+        measure_route_nodes(node->children[i], node_count, route_count, string_bytes);
+    if (node->parameter)
+        measure_route_nodes(node->parameter, node_count, route_count, string_bytes);
+    if (node->wildcard)
+        measure_route_nodes(node->wildcard, node_count, route_count, string_bytes);
+}
+
+struct route_table *compile_route_table(const struct routes *routes) {
+    int node_count = 0;
+    int route_count = 0;
+    size_t string_bytes = 0;
+
+    if (routes->tree)
+        measure_route_nodes(routes->tree, &node_count, &route_count, &string_bytes);
+
+    const size_t nodes_size = node_count * sizeof(struct route_table_node);
+    const size_t routes_size = route_count * sizeof(struct route);
+
+    /* nodes and routes come first to keep their alignment, and bytes follow */
+    struct route_table *table = (struct route_table *)malloc(sizeof(struct route_table) + nodes_size + routes_size + node_count + string_bytes);
+    /* source node of each compiled node, also used as the queue of breadth-first traversal */
+    const struct route_node **sources = (const struct route_node **)malloc((node_count ? node_count : 1) * sizeof(struct route_node *));
+
+    if (table == NULL || sources == NULL) {
+        free(table);
+        free(sources);
+        return NULL;
+    }
+
+    char *cursor = (char *)(table + 1);
+    *table = (struct route_table) {
+        .node_count = node_count,
+        .route_count = route_count,
+        .nodes = (struct route_table_node *)cursor,
+        .routes = (struct route *)(cursor + nodes_size),
+        .indices = cursor + nodes_size + routes_size
+    };
+    char *strings = table->indices + node_count;
+
+    int tail = 0;
+    int route_index = 0;
+
+    if (node_count > 0)
+        sources[tail++] = routes->tree;
+
+    for (int i = 0; i < node_count; i++) {
+        const struct route_node *source = sources[i];
+        struct route_table_node *node = &table->nodes[i];
+
+        memcpy(strings, source->prefix, source->prefix_length + 1);
+        *node = (struct route_table_node) {
+            .prefix = strings,
+            .prefix_length = (uint32_t)source->prefix_length,
+            .methods = source->methods,
+            .first_child = (uint32_t)tail,
+            .child_count = (uint32_t)source->child_count
+        };
+        strings += source->prefix_length + 1;
+        table->indices[i] = source->prefix[0];
+
+        node->allow = strings;
+        strings += format_allowed_methods(source->methods, strings) + 1;
+
+        for (int k = 0; k < source->child_count; k++)
+            sources[tail++] = source->children[k];
+        if (source->parameter) {
+            node->parameter = (uint32_t)tail;
+            sources[tail++] = source->parameter;
+        }
+        if (source->wildcard) {
+            node->wildcard = (uint32_t)tail;
+            sources[tail++] = source->wildcard;
+        }
+
+        for (int method = 0; method < HTTP_METHOD_UNKNOWN; method++) {
+            if (source->routes[method] == NULL)
+                continue;
+
+            struct route *route = &table->routes[route_index++];
+            const size_t path_size = strlen(source->routes[method]->path) + 1;
+
+            memcpy(strings, source->routes[method]->path, path_size);
+            *route = *source->routes[method];
+            route->path = strings;
+            /* canned response is shared with `routes`, and lives until both release it */
+            retain_http_canned_response(route->canned);
+            strings += path_size;
+            node->routes[method] = route;
+        }
+    }
+
+    free(sources);
+    return table;
+}
+
+void free_route_table(struct route_table *table) {
+    if (table == NULL)
+        return;
+
+    for (int i = 0; i < table->route_count; i++)
+        release_http_canned_response(table->routes[i].canned);
+
+    /* table is a single allocation */
+    free(table);
+}
+
+/**
+ * @brief `match_route_node` for compiled table.
+ */
+static const struct route_table_node *match_route_table_node(const struct route_table *table, const struct route_table_node *node,
+        const char *path, size_t length, struct http_path_parameters *parameters) {
+    /* even though the last '/' is omitted, it is the same path */
+    if ((length == 0 || (length == 1 && path[0] == '/')) && node->methods != 0)
+        return node;
+
+    if (length > 0 && node->child_count > 0) {
+        const char *found_index = memchr(table->indices + node->first_child, path[0], node->child_count);
+
+        if (found_index) {
+            const struct route_table_node *child = &table->nodes[found_index - table->indices];
+
+            if (length >= child->prefix_length && memcmp(path, child->prefix, child->prefix_length) == 0) {
+                const struct route_table_node *found = match_route_table_node(table, child, path + child->prefix_length, length - child->prefix_length, parameters);
+                if (found)
+                    return found;
+            }
+        }
+    }
+
+    if (node->parameter != 0 && length > 0 && path[0] != '/') {
+        const struct route_table_node *parameter = &table->nodes[node->parameter];
+        const char *end_of_segment = memchr(path, '/', length);
+        size_t segment_length = end_of_segment ? (size_t)(end_of_segment - path) : length;
+        int saved_size = parameters ? parameters->size : 0;
+
+        push_path_parameter(parameters, parameter->prefix, parameter->prefix_length, path, segment_length);
+
+        const struct route_table_node *found = match_route_table_node(table, parameter, path + segment_length, length - segment_length, parameters);
+        if (found)
+            return found;
+
+        if (parameters)
+            parameters->size = saved_size;
+    }
+
+    if (node->wildcard != 0) {
+        const struct route_table_node *wildcard = &table->nodes[node->wildcard];
+
+        push_path_parameter(parameters, wildcard->prefix, wildcard->prefix_length, path, length);
+        return wildcard;
+    }
+
+    return NULL;
+}
+
+const struct route_table_node *find_route_table_node(const struct route_table *table, const char *path, struct http_path_parameters *parameters) {
+    if (parameters)
+        parameters->size = 0;
+    if (table == NULL || table->node_count == 0)
+        return NULL;
+
+    return match_route_table_node(table, &table->nodes[0], path, strlen(path), parameters);
+}
+
+struct route *match_route_table(const struct route_table *table, const struct http_request *request, enum http_method method) {
+    struct http_path_parameters *parameters = &request->cache->path_parameters;
+
+    if (method < 0 || method >= HTTP_METHOD_UNKNOWN) {
+        parameters->size = 0;
+        return NULL;
+    }
+
+    const struct route_table_node *node = find_route_table_node(table, request->path, parameters);
+    if (node == NULL || node->routes[method] == NULL) {
+        parameters->size = 0;
+        return NULL;
+    }
+    return node->routes[method];
+}
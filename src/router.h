@@ -0,0 +1,192 @@
+#pragma once
+
+#include "http.h"
+
+struct route_node;
+struct route_table;
+struct route_table_node;
+
+/**
+ * @brief Insert `route` into the radix tree of routes, keyed by `route->path`.
+ * A single trailing '/' of the path is ignored, so that `/path/to/api` and `/path/to/api/` share a node
+ * (same equivalence as `url_path_cmp`).   
+ * A segment starting with ':' becomes a parameter node, and a last segment starting with '*' becomes a wildcard node.
+ *
+ * @param root address of the root node. If `*root` is **NULL**, root node is created.
+ * @param route route to be inserted. Tree does not own `route`.
+ * @return 0 on success, -1 on failure
+ * @retval -1 If allocation failed, a route with same path and method already exists, or the path has an invalid parameter segment
+ * (empty name, '*' not at the last segment, different name at the same position, or more than `HTTP_MAX_PATH_PARAMETERS` parameters)
+ */
+int insert_route_node(struct route_node **root, struct route *route);
+
+/**
+ * @brief Find the node matching `path`. A single trailing '/' of the path is ignored.
+ * Lookup cost is proportional to the length of `path`, not to the number of routes.
+ * Static children are tried first, then the parameter child, then the wildcard child.
+ *
+ * @param root root node of the tree. May be **NULL**.
+ * @param path URL path without query string
+ * @param parameters segments captured by parameter and wildcard nodes are stored. May be **NULL**.
+ * @return Node having any route and matching `path`. **NULL** if there is no such node.
+ * @note Returned node may have no route for some methods. Check `route_node::routes[method]`.
+ */
+const struct route_node *find_route_node(const struct route_node *root, const char *path, struct http_path_parameters *parameters);
+
+/**
+ * @brief Free every node of the tree. Routes referenced by nodes are not freed.
+ *
+ * @param root root node of the tree. May be **NULL**.
+ */
+void free_route_nodes(struct route_node *root);
+
+/**
+ * @brief Freeze `routes` into an immutable `struct route_table`.
+ * The table is a single allocation holding nodes in breadth-first order (children of a node are contiguous),
+ * copies of routes and all strings, so it does not refer to `routes` after return. Canned responses of routes are shared by reference.   
+ * `allow` of each node is formatted here, so that preflight and 405 responses do not compute it per request.
+ *
+ * @param routes routes to be compiled
+ * @return Compiled table allocated by `malloc`. Free it with `free_route_table`. **NULL** if allocation failed.
+ */
+struct route_table *compile_route_table(const struct routes *routes);
+
+/**
+ * @brief Free a table made by `compile_route_table`.
+ *
+ * @param table table to be freed. May be **NULL**.
+ */
+void free_route_table(struct route_table *table);
+
+/**
+ * @brief Find the node of compiled table matching `path`, in the same way as `find_route_node`.
+ *
+ * @param table compiled table. May be **NULL**.
+ * @param path URL path without query string
+ * @param parameters segments captured by parameter and wildcard nodes are stored. Names point into `table`. May be **NULL**.
+ * @return Node having any route and matching `path`. **NULL** if there is no such node.
+ */
+const struct route_table_node *find_route_table_node(const struct route_table *table, const char *path, struct http_path_parameters *parameters);
+
+/**
+ * @brief Find the route of compiled table correspond to path of `request` and `method`, and store captured path parameters into `request`.
+ *
+ * @param table compiled table. May be **NULL**.
+ * @param request request made by `parse_http_request`
+ * @param method HTTP method to find
+ * @return Route matched by path and `method`, pointing into `table`. Returns NULL if not found, and no path parameter is stored.
+ */
+struct route *match_route_table(const struct route_table *table, const struct http_request *request, enum http_method method);
+
+/**
+ * @brief Node of compressed radix tree of URL paths.
+ * Each node owns a path fragment, and the path of a node is concatenation of fragments from the root.
+ * `prefix` of parameter and wildcard nodes is the name of parameter, matched against a segment of any content.
+ */
+struct route_node {
+    /**
+     * @brief path fragment of this node, not NUL-terminated
+     */
+    char                *prefix;
+    /**
+     * @brief length of `prefix`
+     */
+    size_t              prefix_length;
+    /**
+     * @brief bitmap of methods which have a route. bit `1 << method` is set if `routes[method]` is not **NULL**.
+     */
+    unsigned int        methods;
+    /**
+     * @brief route of each method, indexed by `enum http_method`
+     */
+    struct route        *routes[HTTP_METHOD_UNKNOWN];
+    /**
+     * @brief the number of children
+     */
+    int                 child_count;
+    /**
+     * @brief first byte of `prefix` of each child. Children never share their first byte.
+     */
+    char                *indices;
+    /**
+     * @brief the array of child nodes, in the same order as `indices`
+     */
+    struct route_node   **children;
+    /**
+     * @brief child matching a single segment, created by `:name` segment
+     */
+    struct route_node   *parameter;
+    /**
+     * @brief child matching the rest of path, created by `*name` segment. It has no child.
+     */
+    struct route_node   *wildcard;
+};
+
+/**
+ * @brief Node of `struct route_table`. Node 0 is the root, and index 0 in `parameter` and `wildcard` means no child.
+ */
+struct route_table_node {
+    /**
+     * @brief path fragment of this node (or name of parameter), pointing into the table
+     */
+    const char          *prefix;
+    /**
+     * @brief length of `prefix`
+     */
+    uint32_t            prefix_length;
+    /**
+     * @brief bitmap of methods which have a route, same as `route_node::methods`
+     */
+    uint32_t            methods;
+    /**
+     * @brief index of the first static child. Static children are `nodes[first_child .. first_child + child_count)`.
+     */
+    uint32_t            first_child;
+    /**
+     * @brief the number of static children
+     */
+    uint32_t            child_count;
+    /**
+     * @brief index of the parameter child. 0 if none.
+     */
+    uint32_t            parameter;
+    /**
+     * @brief index of the wildcard child. 0 if none.
+     */
+    uint32_t            wildcard;
+    /**
+     * @brief route of each method, indexed by `enum http_method`, pointing into the table
+     */
+    struct route        *routes[HTTP_METHOD_UNKNOWN];
+    /**
+     * @brief comma separated methods answered at this node, for `Allow` and `Access-Control-Allow-Methods`.
+     * HEAD is included if GET is, and OPTIONS always is. Empty if the node has no route.
+     */
+    const char          *allow;
+};
+
+/**
+ * @brief Immutable route table compiled from `struct routes`. Safe to read from any number of threads without locks.
+ */
+struct route_table {
+    /**
+     * @brief the number of nodes
+     */
+    int                     node_count;
+    /**
+     * @brief the number of routes
+     */
+    int                     route_count;
+    /**
+     * @brief nodes in breadth-first order. Empty if `node_count` is 0.
+     */
+    struct route_table_node *nodes;
+    /**
+     * @brief first byte of prefix of each node, indexed like `nodes`. Static children of a node are looked up with one `memchr`.
+     */
+    char                    *indices;
+    /**
+     * @brief copies of routes, whose `path` points into the table
+     */
+    struct route            *routes;
+};
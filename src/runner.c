@@ -1,9 +1,17 @@
+#define _GNU_SOURCE
 #include <stdbool.h>
+#include <sched.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <signal.h>
+#include <time.h>
 
 #include "http.h"
+#include "router.h"
 #include "utility.h"
 #include "threadpool.h"
 #include "runner.h"
+#include "websocket.h"
 
 static const size_t            KB      = 1024;
 static const int               N_KB    = 16;
@@ -14,203 +22,868 @@ static int                     server_fd;
 static int                     addrlen = sizeof(addr);
 
 
-static struct http_response    response_500;
-static struct http_response    response_404;
-static struct http_response    response_204;
+/* fixed responses, serialized once in `run_web_server` and written as they are */
+static struct http_canned_response  *canned_500;
+static struct http_canned_response  *canned_404;
+static struct http_canned_response  *canned_400;
+static struct http_canned_response  *canned_413;
+static struct http_canned_response  *canned_414;
+static struct http_canned_response  *canned_431;
+static struct http_canned_response  *canned_204;
 
-static struct routes           *route_table;
+/**
+ * @brief Compiled route table read by workers without locks. It is never modified, but replaced by `update_web_server_routes`.
+ */
+static _Atomic(struct route_table *)    active_route_table;
+/**
+ * @brief Incremented whenever `active_route_table` is replaced. Workers record it while they use the table.
+ */
+static atomic_ulong                     route_table_epoch = 1;
+static pthread_mutex_t                  route_table_update_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static struct threadpool       *pool;
 
-static char                    **buffer_list;
-static atomic_bool             *buffer_used;
+/**
+ * @brief Receive buffer owned by a worker. It grows on demand to hold a whole request,
+ * including a body reassembled from chunks.
+ */
+struct request_buffer {
+    char        *data;
+    size_t      capacity;
+    atomic_bool used;
+    /**
+     * @brief `route_table_epoch` observed when the worker using this buffer started to use route table. 0 if it does not use.
+     */
+    atomic_ulong route_table_epoch;
+    /**
+     * @brief Buffer into which the response is serialized, reused by every request handled with this slot
+     */
+    struct http_output_buffer output;
+    /**
+     * @brief Response filled by route handlers, reset and reused by every request handled with this slot
+     */
+    struct http_response response;
+};
+
+static struct request_buffer   *buffer_list;
 
 static char                    *static_files_dir;
 
+/**
+ * @brief CORS headers shared by canned responses and static files
+ */
+static struct http_header_set  *cors_header_set;
 
-static struct http_response *get_static_file(char *file_path) {
-    // 1. 응답 구조체 초기화
-    struct http_response *response = malloc(sizeof(struct http_response));
-    if (!response) return NULL;
+/**
+ * @brief CORS headers with `Content-Type` of each slot of MIME type table, shared by static files. NULL for empty slots.
+ */
+static struct http_header_set  *mime_header_sets[HTTP_MIME_TABLE_SIZE];
 
-    struct http_headers response_headers = {
-        .capacity = 4,
-        .size = 0,
-        .items = malloc(4 * sizeof(struct http_header *))
-    };
+/**
+ * @brief Middlewares run around every parsed request, copied from `web_server::middlewares`
+ */
+static const struct http_middleware *middlewares;
+static int                     middleware_count;
 
-    char *body = NULL;
-    long file_size = 0;
+/**
+ * @brief Value of `Access-Control-Max-Age` header of preflight responses, formatted from `web_server::cors_max_age`
+ */
+static char                    cors_max_age[16];
 
-    if (!response_headers.items) {
-        free(response);
-        return NULL;
+/**
+ * @brief Value of `Cache-Control` header of static files, formatted from `web_server::static_max_age`
+ */
+static char                    static_cache_control[40];
+
+/**
+ * @brief Size limits of a request. Copied from `struct web_server`, with defaults applied.
+ */
+static struct {
+    size_t  max_request_line_length;
+    int     max_header_count;
+    size_t  max_header_bytes;
+    size_t  max_body_size;
+} limits;
+
+
+/**
+ * @brief Narrow the file body of `response` to ranges requested by `Range`: 206 with one range of the file,
+ * 206 with `multipart/byteranges` for several ranges, or 416. Invalid `Range` is ignored, and the whole file is sent with 200.
+ * 
+ * @param size length of the file
+ * @param mime_type type of the file, written in each part of `multipart/byteranges`. NULL if unknown.
+ * @note If allocation for several ranges failed, the whole file is sent with 200.
+ */
+static void fill_range_response(struct http_response *response, const struct http_request *request, off_t size, const char *mime_type) {
+    static atomic_uint          boundary_count;
+    const struct http_header    *range = find_http_request_header(request, "Range");
+    struct http_byte_range      ranges[HTTP_MAX_RANGES];
+    char                        content_range[80];
+    int                         count;
+
+    if (range == NULL || (count = parse_http_range(range->value, size, ranges, HTTP_MAX_RANGES)) == -1)
+        return;
+
+    if (count == 0) {
+        snprintf(content_range, sizeof(content_range), "bytes */%lld", (long long)size);
+        insert_header(&response->headers, "Content-Range", content_range);
+        response->status_code = HTTP_RANGE_NOT_SATISFIABLE;
+        response->body_length = 0;
+        return;
     }
-    
-    insert_header(&response_headers, "Access-Control-Allow-Origin", "*");
-    insert_header(&response_headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-    insert_header(&response_headers, "Access-Control-Allow-Headers", "*");
 
+    if (count == 1) {
+        snprintf(content_range, sizeof(content_range), "bytes %lld-%lld/%lld",
+                 (long long)ranges[0].first, (long long)ranges[0].last, (long long)size);
+        insert_header(&response->headers, "Content-Range", content_range);
+        response->body_offset = ranges[0].first;
+        response->body_length = (size_t)(ranges[0].last - ranges[0].first + 1);
+        response->status_code = HTTP_PARTIAL_CONTENT;
+        return;
+    }
+
+    struct http_byte_ranges *parts = malloc(sizeof(struct http_byte_ranges) + count * sizeof(struct http_byte_range));
+    if (parts == NULL)
+        return;
+    parts->size = size;
+    parts->content_type = mime_type;
+    parts->count = count;
+    memcpy(parts->items, ranges, count * sizeof(struct http_byte_range));
+    snprintf(parts->boundary, sizeof(parts->boundary), "%016llx%08x",
+             (unsigned long long)time(NULL), atomic_fetch_add(&boundary_count, 1));
+    response->ranges = parts;
+
+    /* type of the file moves into parts, and the response itself is multipart */
+    release_http_header_set(response->header_set);
+    response->header_set = retain_http_header_set(cors_header_set);
 
-    FILE *file_fp = fopen(file_path, "r");
-    if (file_fp == NULL) {
-        response->status_code = HTTP_NOT_FOUND;    
-        response->headers = response_headers;
-        response->http_version = HTTP_1_1;
-        response->body = NULL;
-        return response;
+    char content_type[sizeof("multipart/byteranges; boundary=") + sizeof(parts->boundary)];
+    snprintf(content_type, sizeof(content_type), "multipart/byteranges; boundary=%s", parts->boundary);
+    insert_header(&response->headers, "Content-Type", content_type);
+    response->status_code = HTTP_PARTIAL_CONTENT;
+}
+
+/**
+ * @brief Fill `response` with 200 whose body is the file at `file_path`, sent by `sendfile` without reading it into memory.
+ * `ETag`, `Last-Modified` and `Cache-Control` are attached, and a conditional request for an unchanged file is answered with 304
+ * from metadata, without opening the file. `Range` of GET is answered with 206 or 416 by `fill_range_response`.
+ * 
+ * @return 0 on success, -1 if the file cannot be opened, which is answered with `canned_404`.
+ */
+static int open_static_file(struct http_response *response, const struct http_request *request, const char *file_path) {
+    struct stat file_stat;
+    char        etag[HTTP_ETAG_MAX_LENGTH];
+    char        last_modified[HTTP_DATE_LENGTH + 1];
+    int         file_fd = -1;
+
+    /* directories and devices are not served */
+    if (stat(file_path, &file_stat) == -1 || !S_ISREG(file_stat.st_mode))
+        return -1;
+
+    format_http_etag(&file_stat, etag);
+    if (!is_http_not_modified(request, etag, file_stat.st_mtime)) {
+        file_fd = open(file_path, O_RDONLY);
+        if (file_fd == -1)
+            return -1;
+
+        /* validators describe the file actually sent, which may have been replaced after `stat` */
+        if (fstat(file_fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)) {
+            close(file_fd);
+            return -1;
+        }
+        format_http_etag(&file_stat, etag);
+    }
+    format_http_date(file_stat.st_mtime, last_modified);
+
+    insert_header(&response->headers, "ETag", etag);
+    insert_header(&response->headers, "Last-Modified", last_modified);
+    insert_header(&response->headers, "Cache-Control", static_cache_control);
+
+    /* `Content-Type` of the extension is a part of header set serialized when the server started */
+    const int mime_slot = find_http_mime_type(file_path);
+    response->header_set = retain_http_header_set(mime_slot >= 0 && mime_header_sets[mime_slot] ? mime_header_sets[mime_slot] : cors_header_set);
+
+    if (file_fd == -1) {
+        response->status_code = HTTP_NOT_MODIFIED;
+        return 0;
     }
 
-    fseek(file_fp, 0, SEEK_END);
-    file_size = ftell(file_fp);
-    fseek(file_fp, 0, SEEK_SET);
+    /* file is sent by `sendfile` as it is, so binary files such as favicon.ico are not cut at NUL */
+    insert_header(&response->headers, "Accept-Ranges", "bytes");
+    response->body_length = (size_t)file_stat.st_size;
+    response->body_type = HTTP_BODY_FILE;
+    response->body_fd = file_fd;
+
+    if (request->method == HTTP_GET && match_http_if_range(request, etag, file_stat.st_mtime))
+        fill_range_response(response, request, file_stat.st_size, get_http_mime_type(mime_slot));
+    return 0;
+}
+
+/**
+ * @brief Make sure `buffer` can hold `required` bytes and a NUL terminator.
+ *
+ * @return 0 on success, -1 if failed to allocate.
+ */
+static int reserve_request_buffer(struct request_buffer *buffer, size_t required) {
+    size_t new_capacity = buffer->capacity;
+
+    while (new_capacity < required + 1)
+        new_capacity *= 2;
+    if (new_capacity == buffer->capacity)
+        return 0;
 
-    fclose(file_fp);
+    char *new_data = realloc(buffer->data, new_capacity);
+    if (new_data == NULL)
+        return -1;
+    buffer->data = new_data;
+    buffer->capacity = new_capacity;
+    return 0;
+}
 
-    body = malloc(file_size + 1);    
-    int file_fd = open(file_path, O_RDONLY);
+/**
+ * @brief Read more bytes from `client_socket` and append them at `buffer->data[size]`.
+ * Grows the buffer if it is full.
+ *
+ * @return The number of bytes read. 0 if peer closed, -1 on error.
+ */
+static ssize_t receive_request_bytes(struct request_buffer *buffer, int client_socket, size_t size) {
+    if (size + 1 >= buffer->capacity && reserve_request_buffer(buffer, buffer->capacity) == -1)
+        return -1;
 
-    if (read(file_fd, body, file_size) == -1) {
+    ssize_t bytes_read;
+    do {
+        bytes_read = read(client_socket, buffer->data + size, buffer->capacity - size - 1);
+    } while (bytes_read == -1 && errno == EINTR);
+
+    if (bytes_read == -1)
         perror("read");
-        close(file_fd);
-        if (body) {
-            free(body);
+    return bytes_read;
+}
+
+/**
+ * @brief Check `Transfer-Encoding` value ends with `chunked` coding.
+ */
+static bool is_chunked_coding(const char *value, size_t value_length) {
+    const size_t len = sizeof("chunked") - 1;
+    if (value_length < len || strncasecmp(value + value_length - len, "chunked", len) != 0)
+        return false;
+    return value_length == len || value[value_length - len - 1] == ',' || value[value_length - len - 1] == ' ';
+}
+
+/**
+ * @brief Read a whole http request into `buffer`.   
+ * Body is framed by `Content-Length` or `Transfer-Encoding: chunked`. A chunked body is decoded in place
+ * as each piece arrives, so `buffer` ends up holding headers followed by the plain body.   
+ * Size limits in `limits` are checked as bytes arrive, so an oversized request is rejected before it is
+ * buffered or parsed.
+ *
+ * @param buffer receive buffer of the worker
+ * @param client_socket socket to read
+ * @param error_status out parameter, set to the status code to answer with when this function fails
+ * @return Length of request stored in `buffer->data`, which is NUL-terminated. -1 on failure.
+ */
+static ssize_t read_http_request(struct request_buffer *buffer, int client_socket, enum http_status_code *error_status) {
+    size_t      total = 0;
+    size_t      scanned = 0;
+    size_t      line_start = 0;
+    size_t      request_line_length = 0;
+    size_t      header_length = 0;
+    int         header_count = 0;
+    size_t      value_length;
+    const char  *first_header;
+    const char  *value;
+
+    *error_status = HTTP_INTERNAL_SERVER_ERROR;
+
+    /* 1. read until the end of headers, counting lines as they arrive */
+    while (header_length == 0) {
+        ssize_t bytes_read = receive_request_bytes(buffer, client_socket, total);
+        if (bytes_read <= 0)
+            return -1;
+        total += bytes_read;
+
+        const char *end_of_line;
+        while (header_length == 0
+            && (end_of_line = memchr(buffer->data + scanned, '\n', total - scanned)) != NULL) {
+            size_t line_end = (size_t)(end_of_line - buffer->data) + 1;
+
+            if (request_line_length == 0) {
+                request_line_length = line_end;
+            } else if (line_end - line_start == 2 && buffer->data[line_start] == '\r') {
+                header_length = line_end;
+            } else if (++header_count > limits.max_header_count) {
+                *error_status = HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE;
+                return -1;
+            }
+            line_start = scanned = line_end;
+        }
+        if (header_length == 0)
+            scanned = total;
+
+        if (request_line_length == 0 ? total > limits.max_request_line_length
+                                     : request_line_length > limits.max_request_line_length) {
+            *error_status = HTTP_URI_TOO_LONG;
+            return -1;
+        }
+        if (request_line_length != 0
+            && (header_length ? header_length : total) - request_line_length > limits.max_header_bytes) {
+            *error_status = HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE;
+            return -1;
+        }
+    }
+
+    first_header = buffer->data + request_line_length;
+
+    /* 2-1. chunked body: decode as it arrives */
+    value = scan_http_header(first_header, header_length - request_line_length, "Transfer-Encoding", &value_length);
+    if (value != NULL) {
+        struct http_chunked_decoder decoder;
+        size_t                      body_end = header_length;
+        size_t                      consumed;
+
+        if (!is_chunked_coding(value, value_length)) {
+            *error_status = HTTP_BAD_REQUEST;
+            return -1;
+        }
+
+        init_http_chunked_decoder(&decoder);
+        while (1) {
+            ssize_t decoded = decode_http_chunked(&decoder, buffer->data + body_end, buffer->data + body_end, total - body_end, &consumed);
+            if (decoded < 0) {
+                *error_status = HTTP_BAD_REQUEST;
+                return -1;
+            }
+            body_end += decoded;
+
+            /* reject as soon as a chunk size announces the body is going to be too large */
+            size_t announced = decoder.decoded_length;
+            if (decoder.state == HTTP_CHUNKED_DATA || decoder.state == HTTP_CHUNKED_SIZE_LF || decoder.state == HTTP_CHUNKED_SIZE_EXT)
+                announced += decoder.chunk_remaining;
+            if (announced > limits.max_body_size || announced < decoder.decoded_length) {
+                *error_status = HTTP_PAYLOAD_TOO_LARGE;
+                return -1;
+            }
+            if (decoder.state == HTTP_CHUNKED_DONE)
+                break;
+
+            /* everything after `body_end` is consumed, so next bytes can overwrite them */
+            total = body_end;
+            ssize_t bytes_read = receive_request_bytes(buffer, client_socket, total);
+            if (bytes_read <= 0)
+                return -1;
+            total += bytes_read;
         }
-        response->status_code = HTTP_NOT_FOUND;    
-        response->headers = response_headers;
-        response->http_version = HTTP_1_1;
-        response->body = NULL;
-        return response;
-    }
-    body[file_size] = '\0';
-
-    response->http_version = HTTP_1_1;
-    response->status_code = HTTP_OK;
-    response->headers = response_headers;
-    response->body = body;
-    close(file_fd);
+        buffer->data[body_end] = '\0';
+        return (ssize_t)body_end;
+    }
+
+    /* 2-2. body of fixed length */
+    value = scan_http_header(first_header, header_length - request_line_length, "Content-Length", &value_length);
+    if (value != NULL) {
+        char                *end_of_number;
+        unsigned long long  content_length = strtoull(value, &end_of_number, 10);
+        size_t              expected;
+
+        /* `strtoull` also accepts leading spaces and a sign, but Content-Length is digits only */
+        if (*value < '0' || *value > '9' || (size_t)(end_of_number - value) != value_length) {
+            *error_status = HTTP_BAD_REQUEST;
+            return -1;
+        }
+        if (content_length > limits.max_body_size) {
+            *error_status = HTTP_PAYLOAD_TOO_LARGE;
+            return -1;
+        }
+
+        expected = header_length + content_length;
+        if (reserve_request_buffer(buffer, expected) == -1)
+            return -1;
+
+        while (total < expected) {
+            ssize_t bytes_read = receive_request_bytes(buffer, client_socket, total);
+            if (bytes_read <= 0)
+                return -1;
+            total += bytes_read;
+        }
+        total = expected;
+    } else if (total > header_length) {
+        /* without framing, a request has no body */
+        total = header_length;
+    }
+
+    buffer->data[total] = '\0';
+    return (ssize_t)total;
+}
+
+/**
+ * @brief Serialize a response shared by every request, such as `canned_404`, with CORS headers and `headers`.
+ */
+static struct http_canned_response *create_canned_response(enum http_status_code status_code, struct http_headers headers) {
+    struct http_response response = {
+        .body = NULL,
+        .headers = headers,
+        .http_version = HTTP_1_1,
+        .status_code = status_code,
+        .header_set = cors_header_set
+    };
+    return create_http_canned_response(&response);
+}
+
+/**
+ * @brief Get a response shared by every request for the error status.
+ */
+static struct http_canned_response *canned_response_of(enum http_status_code status_code) {
+    switch (status_code) {
+    case HTTP_BAD_REQUEST:
+        return canned_400;
+    case HTTP_PAYLOAD_TOO_LARGE:
+        return canned_413;
+    case HTTP_URI_TOO_LONG:
+        return canned_414;
+    case HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE:
+        return canned_431;
+    default:
+        return canned_500;
+    }
+}
+
+/**
+ * @brief Fill `response` listing methods of `node` in `Allow` and CORS headers.
+ * 
+ * @param status_code `HTTP_NO_CONTENT` for preflight, which also has `Access-Control-Max-Age`. `HTTP_METHOD_NOT_ALLOWED` otherwise.
+ */
+static void fill_allowed_methods_response(struct http_response *response, const struct route_table_node *node, enum http_status_code status_code) {
+    response->status_code = status_code;
+
+    insert_header(&response->headers, "Allow", (char *)node->allow);
+    insert_header(&response->headers, "Access-Control-Allow-Origin", "*");
+    insert_header(&response->headers, "Access-Control-Allow-Methods", (char *)node->allow);
+    insert_header(&response->headers, "Access-Control-Allow-Headers", "*");
+    if (status_code == HTTP_NO_CONTENT)
+        insert_header(&response->headers, "Access-Control-Max-Age", cors_max_age);
+}
+
+/**
+ * @brief Move `allocated`, returned by a callback of the old ABI or a before hook, into `response` of the slot,
+ * and free the struct itself. Adapter from `malloc`ed responses to the response owned by the server.
+ * 
+ * @return `response`, or **NULL** if `allocated` is **NULL**
+ */
+static struct http_response *adopt_http_response(struct http_response *response, struct http_response *allocated) {
+    if (allocated == NULL)
+        return NULL;
+
+    /* array of headers kept by the slot is replaced by that of `allocated` */
+    destruct_http_headers(&response->headers);
+    *response = *allocated;
+    free(allocated);
     return response;
 }
 
+/**
+ * @brief Write all of `vectors` to `socket`, resuming after partial writes. Stops at the first error.
+ * A client that has gone does not raise `SIGPIPE`.
+ * 
+ * @return 0 on success, -1 on error
+ */
+static int write_vectors(int socket, struct iovec *vectors, int count) {
+    while (count > 0) {
+        struct msghdr message = {.msg_iov = vectors, .msg_iovlen = count};
+        ssize_t written = sendmsg(socket, &message, MSG_NOSIGNAL);
+        if (written <= 0) {
+            if (written == -1 && errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        while (count > 0 && (size_t)written >= vectors->iov_len) {
+            written -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char *)vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Send `length` bytes of `file_fd` from `offset` to `socket` with `sendfile`, without copying into user space.
+ * `SIGPIPE` raised by a client which has gone is blocked and discarded, without changing the signal disposition of the process.
+ * 
+ * @return 0 on success, -1 on error
+ */
+static int send_file_body(int socket, int file_fd, off_t offset, size_t length) {
+    sigset_t pipe_signal, previous_mask;
+    int result = 0;
+
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, &previous_mask);
+
+    while (length > 0) {
+        ssize_t sent = sendfile(socket, file_fd, &offset, length);
+        if (sent <= 0) {
+            if (sent == -1 && errno == EINTR)
+                continue;
+            result = -1;
+            break;
+        }
+        length -= (size_t)sent;
+    }
+
+    if (result == -1 && !sigismember(&previous_mask, SIGPIPE)) {
+        struct timespec no_wait = {0, 0};
+        sigtimedwait(&pipe_signal, NULL, &no_wait);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+    return result;
+}
+
+/**
+ * @brief Send ranges of `file_fd` as parts of `multipart/byteranges`. Each part is its delimiter followed by the range sent by `sendfile`.
+ * 
+ * @return 0 on success, -1 on error
+ */
+static int send_file_ranges(int socket, int file_fd, const struct http_byte_ranges *ranges) {
+    char delimiter[HTTP_RANGE_DELIMITER_MAX_LENGTH];
+
+    for (int i = 0; i <= ranges->count; i++) {
+        struct iovec vector = {delimiter, format_http_range_delimiter(delimiter, ranges, i)};
+        if (write_vectors(socket, &vector, 1) == -1)
+            return -1;
+        if (i < ranges->count
+                && send_file_body(socket, file_fd, ranges->items[i].first,
+                                  (size_t)(ranges->items[i].last - ranges->items[i].first + 1)) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Size of buffer in which small writes of a streamed body are gathered into one chunk
+ */
+#define HTTP_CHUNK_BUFFER_SIZE (4 * 1024)
+
+/**
+ * @brief Seconds for which a streamed body waits for the client to read, before giving up
+ */
+#define HTTP_STREAM_SEND_TIMEOUT 30
+
+/**
+ * @brief Writer of a streamed body, living on the stack of the worker during `http_response::stream`.
+ */
+struct http_response_writer {
+    /**
+     * @brief client socket
+     */
+    int     socket;
+    /**
+     * @brief whether writes are framed as chunks. false for HTTP/1.0.
+     */
+    bool    chunked;
+    /**
+     * @brief set when a write failed, or the body must not be sent (HEAD). Every later write fails.
+     */
+    bool    failed;
+    /**
+     * @brief the number of bytes gathered in `pending`
+     */
+    size_t  pending_length;
+    /**
+     * @brief small writes not sent yet
+     */
+    char    pending[HTTP_CHUNK_BUFFER_SIZE];
+};
+
+/**
+ * @brief Send `data` as one chunk, framed by its size line and CRLF, without copying it.
+ */
+static int send_http_chunk(struct http_response_writer *writer, const char *data, size_t length) {
+    char size_line[24];
+    struct iovec vectors[3];
+    int count = 0;
+
+    if (writer->chunked)
+        vectors[count++] = (struct iovec) {size_line, snprintf(size_line, sizeof(size_line), "%zx\r\n", length)};
+    vectors[count++] = (struct iovec) {(char *)data, length};
+    if (writer->chunked)
+        vectors[count++] = (struct iovec) {"\r\n", 2};
+
+    if (write_vectors(writer->socket, vectors, count) == -1) {
+        writer->failed = true;
+        return -1;
+    }
+    return 0;
+}
+
+int flush_http_chunks(struct http_response_writer *writer) {
+    if (writer->failed)
+        return -1;
+    if (writer->pending_length == 0)
+        return 0;
+
+    const int result = send_http_chunk(writer, writer->pending, writer->pending_length);
+    writer->pending_length = 0;
+    return result;
+}
+
+int write_http_chunk(struct http_response_writer *writer, const void *data, size_t length) {
+    if (writer->failed)
+        return -1;
+    /* empty chunk would end the body */
+    if (length == 0)
+        return 0;
+
+    if (writer->pending_length + length > sizeof(writer->pending) && flush_http_chunks(writer) == -1)
+        return -1;
+
+    if (length < sizeof(writer->pending)) {
+        memcpy(writer->pending + writer->pending_length, data, length);
+        writer->pending_length += length;
+        return 0;
+    }
+    return send_http_chunk(writer, data, length);
+}
+
+void run_http_stream(int socket, const struct http_response *response, enum http_version request_version, bool writable) {
+    struct http_response_writer writer = {
+        .socket = socket,
+        .chunked = request_version != HTTP_1_0,
+        .failed = !writable,
+        .pending_length = 0
+    };
+
+    /* blocked writes are the backpressure, but a client that stopped reading must not hold the worker forever */
+    struct timeval timeout = {.tv_sec = HTTP_STREAM_SEND_TIMEOUT, .tv_usec = 0};
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    response->stream(&writer, response->stream_data);
+
+    if (flush_http_chunks(&writer) == 0 && writer.chunked) {
+        struct iovec last_chunk = {"0\r\n\r\n", 5};
+        write_vectors(socket, &last_chunk, 1);
+    }
+}
+
+/**
+ * @brief Hand the upgraded connection over to `response->websocket`, and close it with 1000 if the session did not.
+ * 
+ * @param connected false if 101 was not sent. The session is called anyway with a closed connection.
+ */
+static void run_websocket_session(int socket, const struct http_response *response, bool connected) {
+    struct websocket websocket = {
+        .socket = socket,
+        .closed = !connected,
+        .close_sent = !connected
+    };
+
+    /* receives are bounded by `poll` in the codec, and sends by the socket */
+    struct timeval timeout = {.tv_sec = WEBSOCKET_IO_TIMEOUT, .tv_usec = 0};
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    response->websocket(&websocket, response->websocket_data);
+
+    close_websocket(&websocket, WEBSOCKET_CLOSE_NORMAL);
+}
+
+/**
+ * @brief Refresh the cached `Date` line at every second boundary.
+ */
+static void *refresh_http_date(void *arg) {
+    (void)arg;
+    for (;;) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        struct timespec until_next_second = {.tv_sec = 0, .tv_nsec = 1000000000L - now.tv_nsec};
+        nanosleep(&until_next_second, NULL);
+
+        update_http_date(time(NULL));
+    }
+    return NULL;
+}
+
 static void handle_http_request(void* arg) {
 
     struct route            *found_route;
+    struct route_table      *table;
+    const struct route_table_node *node;
     struct http_response    *response = NULL;
+    struct http_canned_response *canned = NULL;
     struct http_request     *request = NULL;
-    char                    *response_str;
+    struct http_output_buffer   one_off_output = {};
+    struct http_output_buffer   *output;
+    char                    date_line[HTTP_DATE_LINE_LENGTH];
+    struct iovec            vectors[3];
+    int                     vector_count = 0;
     int                     client_socket = (int)arg;
-    ssize_t                 bytes_read;
     ssize_t                 total_read;
-    char                    *buffer = NULL;
-    int                     buffer_idx;
+    struct request_buffer   *buffer = NULL;
+    enum http_status_code   error_status;
 
     for (int i = 0; i < pool->max_threads; i++) {
         bool expected = false;
-        if (atomic_compare_exchange_strong(&buffer_used[i], &expected, true)) {
-            buffer = buffer_list[i];
-            buffer_idx = i;
+        if (atomic_compare_exchange_strong(&buffer_list[i].used, &expected, true)) {
+            buffer = &buffer_list[i];
             break;
         }
     }
 
     if (buffer == NULL) {
         DLOGV("UNEXPECTED\n");
-        response = &response_500;
+        canned = canned_500;
         goto label_send_response;
     }
 
-    // @TODO need to handle long message    
-    total_read = 0;
-    bytes_read = read(client_socket, buffer, (size_t)KB * N_KB - 1);
-    total_read += bytes_read;
+    total_read = read_http_request(buffer, client_socket, &error_status);
 
-    if (total_read < 0) {
-        perror("read");
-        close(client_socket);
-        free(buffer);
+    if (total_read == -1) {
         // @TODO server log print
-        DLOGV("Socket read error: %s", strerror(errno));
-        response = &response_500;
+        DLOGV("Failed to read request (%d) - socket=%d\n", error_status, client_socket);
+        canned = canned_response_of(error_status);
         goto label_send_response;
     }
     
-    if (total_read == 0) {
-        perror("read");
-        close(client_socket);
-        // TODO(server log print)
-        DLOGV("Client disconnected - socket=%d", client_socket); 
-        response = &response_500;
-        goto label_send_response;
-    } 
-    
-    request = parse_http_request(buffer);
+    request = parse_http_request_bytes(buffer->data, (size_t)total_read);
 
     if (request == NULL) {
-        response = &response_500;
+        canned = canned_500;
         goto label_send_response;
     }
 
-    if (request->method == HTTP_OPTIONS) {
-        response = &response_204;
-        goto label_send_response;
+    /* a before hook may answer instead of the route */
+    for (int i = 0; i < middleware_count; i++) {
+        if (middlewares[i].before
+                && (response = adopt_http_response(&buffer->response, middlewares[i].before(request, middlewares[i].data))) != NULL)
+            goto label_send_response;
     }
 
     // 라우트 찾기
     DLOGV("%s\n", request->path);
-    found_route = find_route(route_table, request->path, request->method);
+
+    /* route table read by this worker is not freed until `route_table_epoch` of the buffer is cleared */
+    atomic_store(&buffer->route_table_epoch, atomic_load(&route_table_epoch));
+    table = atomic_load(&active_route_table);
+
+    node = find_route_table_node(table, request->path, &request->cache->path_parameters);
+    found_route = NULL;
+    if (node != NULL && request->method < HTTP_METHOD_UNKNOWN) {
+        found_route = node->routes[request->method];
+        if (found_route == NULL && request->method == HTTP_HEAD)
+            found_route = node->routes[HTTP_GET];
+    }
+
+    /* path is routed, but not for the method: preflight is answered from methods of the path, others are 405 */
+    if (found_route == NULL && node != NULL) {
+        response = &buffer->response;
+        fill_allowed_methods_response(response, node, request->method == HTTP_OPTIONS ? HTTP_NO_CONTENT : HTTP_METHOD_NOT_ALLOWED);
+        goto label_send_response;
+    }
+
+    /* path of static files */
+    if (found_route == NULL && request->method == HTTP_OPTIONS) {
+        canned = canned_204;
+        goto label_send_response;
+    }
 
     if (found_route == NULL) {
         char *full_path = malloc(strlen(static_files_dir) + strlen(request->path) + 1);
-        sprintf(full_path, "%s%s", static_files_dir, request->path);
-        response = get_static_file(full_path);
-        if (strcmp(request->path, "/favicon.ico") == 0) {
-            insert_header(&response->headers, "Content-Type", "image/x-icon");
-        }
+        if (full_path)
+            sprintf(full_path, "%s%s", static_files_dir, request->path);
+        if (full_path && open_static_file(&buffer->response, request, full_path) == 0)
+            response = &buffer->response;
+        else
+            canned = canned_404;
+        free(full_path);
         goto label_send_response;
     } 
+
+    /* fixed response of the route, serialized when it was inserted */
+    if (found_route->canned != NULL) {
+        canned = found_route->canned;
+        goto label_send_response;
+    }
     
-    response = found_route->callback(*request);
+    /* handler fills the response of the slot. callback of the old ABI allocates one, which is adopted into the slot. */
+    if (found_route->handler != NULL)
+        response = found_route->handler(request, &buffer->response) == 0 ? &buffer->response : NULL;
+    else
+        response = adopt_http_response(&buffer->response, found_route->callback(*request));
     
     if (response == NULL) {
-        response = &response_500;
+        canned = canned_500;
         goto label_send_response;
     }
 
     label_send_response:
-    response_str = http_response_stringify(*response);
+    /* after hooks run in reverse order of before hooks. canned responses are shared bytes, so they are not passed. */
+    if (request && response != NULL) {
+        for (int i = middleware_count - 1; i >= 0; i--) {
+            if (middlewares[i].after)
+                middlewares[i].after(request, response, middlewares[i].data);
+        }
+    }
+
+    /* canned response of a route may belong to the route table, so it is kept alive past the epoch */
+    retain_http_canned_response(canned);
 
-    /* response 가 null 일 경우는 없다고 가정 */
-    if (response != &response_404 && response != &response_500 && response != &response_204) {
-        if (response->body)
-            free(response->body);
+    /* route and path parameters are not used after callback */
+    if (buffer != NULL)
+        atomic_store(&buffer->route_table_epoch, 0);
 
-        if (response->headers.capacity)
-            destruct_http_headers(&response->headers);
+    /* canned bytes are written as they are, with the cached `Date` line spliced after the status line.
+       heads of others are serialized into output buffer of the slot, or a one-off buffer without slot.
+       HEAD is answered same as GET, but without body, so `Content-Length` is that of GET. */
+    if (canned != NULL) {
+        const size_t length = request && request->method == HTTP_HEAD ? canned->head_length : canned->length;
 
-        free(response);
+        vectors[vector_count++] = (struct iovec) {canned->data, canned->status_line_length};
+        if (copy_http_date_line(date_line)) {
+            vectors[vector_count++] = (struct iovec) {date_line, HTTP_DATE_LINE_LENGTH};
+        }
+        vectors[vector_count++] = (struct iovec) {canned->data + canned->status_line_length, length - canned->status_line_length};
+    } else {
+        output = buffer != NULL ? &buffer->output : &one_off_output;
+        if (build_http_response_head(output, response, request ? request->version : HTTP_1_1) != -1) {
+            vectors[vector_count++] = (struct iovec) {output->data, output->length};
+            /* body in memory follows the head from where the callback left it, without being copied */
+            if (response->body != NULL && response->body_type != HTTP_BODY_FILE && !response->stream
+                    && !(request && request->method == HTTP_HEAD)) {
+                const size_t body_length = response->body_length ? response->body_length : strlen(response->body);
+                if (body_length)
+                    vectors[vector_count++] = (struct iovec) {(char *)response->body, body_length};
+            }
+        }
     }
 
     // 응답 전송
-    ssize_t total_written = 0;
-    size_t response_len = strlen(response_str);
+    const bool head_sent = vector_count > 0 && write_vectors(client_socket, vectors, vector_count) == 0;
 
-    while (total_written < response_len) {
-        ssize_t written = write(client_socket,
-                                response_str + total_written,
-                                response_len - total_written);
-        if (written <= 0) {
-            if (errno == EINTR)
-                continue;
-            break;
-        }
-        total_written += written;
+    /* streamed body, upgraded connection and file body follow the head, before the response is freed */
+    if (response != NULL && response->stream)
+        run_http_stream(client_socket, response, request ? request->version : HTTP_1_1,
+                        head_sent && !(request && request->method == HTTP_HEAD));
+    else if (response != NULL && response->websocket)
+        run_websocket_session(client_socket, response, head_sent && !(request && request->method == HTTP_HEAD));
+    else if (response != NULL && response->body_type == HTTP_BODY_FILE && head_sent && !(request && request->method == HTTP_HEAD)) {
+        if (response->ranges)
+            send_file_ranges(client_socket, response->body_fd, response->ranges);
+        else
+            send_file_body(client_socket, response->body_fd, response->body_offset, response->body_length);
     }
 
     // 응답이 완전히 전송되도록 보장
     shutdown(client_socket, SHUT_WR);
 
     // 메모리 정리
-    free(response_str);
+    /* response of the slot is reset for the next request, also after a failed handler */
+    if (buffer != NULL)
+        reset_http_response(&buffer->response);
+
+    release_http_canned_response(canned);
+    destruct_http_output_buffer(&one_off_output);
 
     if (request) {
         destruct_http_request(request);
@@ -219,7 +892,21 @@ static void handle_http_request(void* arg) {
 
     close(client_socket);
 
-    atomic_store(&buffer_used[buffer_idx], false);
+    if (buffer != NULL) {
+        /* do not keep memory grown by an unusually large request */
+        if (buffer->capacity > N_KB * KB * 4) {
+            char *shrunk = realloc(buffer->data, N_KB * KB);
+            if (shrunk) {
+                buffer->data = shrunk;
+                buffer->capacity = N_KB * KB;
+            }
+        }
+        if (buffer->output.capacity > N_KB * KB * 4) {
+            destruct_http_output_buffer(&buffer->output);
+            init_http_output_buffer(&buffer->output, N_KB * KB);
+        }
+        atomic_store(&buffer->used, false);
+    }
 }
 
 void cleanup(void) {
@@ -227,53 +914,100 @@ void cleanup(void) {
     threadpool_destroy(pool);
 }
 
+int update_web_server_routes(const struct routes *routes) {
+    struct route_table *table = compile_route_table(routes);
+    if (table == NULL)
+        return -1;
+
+    pthread_mutex_lock(&route_table_update_lock);
+
+    if (atomic_load(&active_route_table) == NULL) {
+        /* server is not running */
+        pthread_mutex_unlock(&route_table_update_lock);
+        free_route_table(table);
+        return -1;
+    }
+
+    struct route_table *old_table = atomic_exchange(&active_route_table, table);
+    unsigned long epoch = atomic_fetch_add(&route_table_epoch, 1) + 1;
+
+    /* grace period: wait until every worker which may still read `old_table` stops using route table */
+    for (int i = 0; i < pool->max_threads; i++) {
+        unsigned long observed;
+        while ((observed = atomic_load(&buffer_list[i].route_table_epoch)) != 0 && observed < epoch)
+            sched_yield();
+    }
+
+    pthread_mutex_unlock(&route_table_update_lock);
+    free_route_table(old_table);
+
+    return 0;
+}
+
 int run_web_server(struct web_server server) {    
     static_files_dir = server.static_files_dir;
     
-    response_500 = (struct http_response) {
-        .body = NULL,
-        .headers = (struct http_headers) {
-            .capacity = 8,
-            .items = malloc(8 * sizeof(struct http_header*)),
-            .size = 0
-        },
-        .http_version = HTTP_1_1,
-        .status_code = HTTP_INTERNAL_SERVER_ERROR
-    };
+    limits.max_request_line_length = server.max_request_line_length ? server.max_request_line_length : 8 * KB;
+    limits.max_header_count = server.max_header_count ? server.max_header_count : 100;
+    limits.max_header_bytes = server.max_header_bytes ? server.max_header_bytes : 16 * KB;
+    limits.max_body_size = server.max_body_size ? server.max_body_size : 16 * KB * KB;
 
-    insert_header(&response_500.headers, "Access-Control-Allow-Origin", "*");
-    insert_header(&response_500.headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-    insert_header(&response_500.headers, "Access-Control-Allow-Headers", "*");
+    snprintf(cors_max_age, sizeof(cors_max_age), "%d", server.cors_max_age ? server.cors_max_age : 600);
+    if (server.static_max_age > 0)
+        snprintf(static_cache_control, sizeof(static_cache_control), "public, max-age=%d", server.static_max_age);
+    else
+        snprintf(static_cache_control, sizeof(static_cache_control), "no-cache");
 
-    response_404 = (struct http_response) {
-        .body = NULL,
-        .headers = (struct http_headers) {
-            .capacity = 8,
-            .items = malloc(8 * sizeof(struct http_header*)),
-            .size = 0
-        },
-        .http_version = HTTP_1_1,
-        .status_code = HTTP_NOT_FOUND
-    };
+    middlewares = server.middlewares;
+    middleware_count = server.middlewares ? server.middleware_count : 0;
 
-    insert_header(&response_404.headers, "Access-Control-Allow-Origin", "*");
-    insert_header(&response_404.headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-    insert_header(&response_404.headers, "Access-Control-Allow-Headers", "*");
+    struct http_headers cors_headers = {};
+    insert_header(&cors_headers, "Access-Control-Allow-Origin", "*");
+    insert_header(&cors_headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
+    insert_header(&cors_headers, "Access-Control-Allow-Headers", "*");
+    cors_header_set = create_http_header_set(&cors_headers);
 
-    response_204 = (struct http_response) {
-        .body = NULL,
-        .headers = (struct http_headers) {
-            .capacity = 8,
-            .items = malloc(8 * sizeof(struct http_header*)),
-            .size = 0
-        },
-        .http_version = HTTP_1_1,
-        .status_code = HTTP_NO_CONTENT
-    };
+    for (int slot = 0; slot < HTTP_MIME_TABLE_SIZE; slot++) {
+        const char *mime_type = get_http_mime_type(slot);
+        if (mime_type == NULL)
+            continue;
+
+        struct http_headers mime_headers = {};
+        for (int i = 0; i < cors_headers.size; i++)
+            insert_header(&mime_headers, cors_headers.items[i]->key, cors_headers.items[i]->value);
+        insert_header(&mime_headers, "Content-Type", (char *)mime_type);
+        mime_header_sets[slot] = create_http_header_set(&mime_headers);
+        destruct_http_headers(&mime_headers);
+    }
+    destruct_http_headers(&cors_headers);
+
+    /* `Date` is formatted once per second by a timer thread, and copied by workers */
+    update_http_date(time(NULL));
+
+    pthread_t date_thread;
+    int thread_error = pthread_create(&date_thread, NULL, refresh_http_date, NULL);
+    if (thread_error != 0) {
+        DLOGV("Failed to start date thread: %s\n", strerror(thread_error));
+        return thread_error;
+    }
+    pthread_detach(date_thread);
 
-    insert_header(&response_204.headers, "Access-Control-Allow-Origin", "*");
-    insert_header(&response_204.headers, "Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-    insert_header(&response_204.headers, "Access-Control-Allow-Headers", "*");
+    struct http_headers preflight_headers = {};
+    insert_header(&preflight_headers, "Access-Control-Max-Age", cors_max_age);
+
+    canned_500 = create_canned_response(HTTP_INTERNAL_SERVER_ERROR, (struct http_headers) {});
+    canned_404 = create_canned_response(HTTP_NOT_FOUND, (struct http_headers) {});
+    canned_400 = create_canned_response(HTTP_BAD_REQUEST, (struct http_headers) {});
+    canned_413 = create_canned_response(HTTP_PAYLOAD_TOO_LARGE, (struct http_headers) {});
+    canned_414 = create_canned_response(HTTP_URI_TOO_LONG, (struct http_headers) {});
+    canned_431 = create_canned_response(HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE, (struct http_headers) {});
+    canned_204 = create_canned_response(HTTP_NO_CONTENT, preflight_headers);
+    destruct_http_headers(&preflight_headers);
+
+    if (!canned_500 || !canned_404 || !canned_400 || !canned_413 || !canned_414 || !canned_431 || !canned_204) {
+        DLOGV("Failed to serialize canned responses\n");
+        return ENOMEM;
+    }
 
 
     // 소켓 생성
@@ -309,18 +1043,27 @@ int run_web_server(struct web_server server) {
         return errno;
     }
 
-    route_table = server.route_table;
-
     pool = threadpool_create(server.threadpool_size);
     
-    buffer_list = malloc(pool->max_threads * sizeof(char *));
+    buffer_list = malloc(pool->max_threads * sizeof(struct request_buffer));
     for (int i = 0; i < pool->max_threads; i++) {
-        buffer_list[i] = malloc(N_KB * KB);
+        buffer_list[i].data = malloc(N_KB * KB);
+        buffer_list[i].capacity = N_KB * KB;
+        buffer_list[i].used = false;
+        buffer_list[i].route_table_epoch = 0;
+        init_http_output_buffer(&buffer_list[i].output, N_KB * KB);
+        buffer_list[i].response = (struct http_response) {};
+        reset_http_response(&buffer_list[i].response);
     }
-    buffer_used = malloc(pool->max_threads * sizeof(atomic_bool));
-    for (int i = 0 ; i < pool->max_threads; i++) {
-        buffer_used[i] = false;
+
+    struct route_table *table = compile_route_table(server.route_table);
+    if (table == NULL) {
+        DLOGV("Failed to compile route table\n");
+        close(server_fd);
+        return -1;
     }
+    /* published after `pool` and `buffer_list` are ready, which `update_web_server_routes` relies on */
+    atomic_store(&active_route_table, table);
 
     DLOGV("[Server] port: %d, backlog: %d\n", server.port_num, server.backlog);  
     
@@ -1,5 +1,35 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
+enum http_version;
+struct http_request;
+struct http_response;
+struct http_response_writer;
+
+/**
+ * @brief Hooks run around route callbacks. Hooks are called from worker threads concurrently, and must not allocate
+ * unless they make a response.
+ */
+struct http_middleware {
+    /**
+     * @brief Called for every parsed request before routing, in order of `web_server::middlewares`. May be NULL.
+     * Return NULL to continue, or a response allocated by `malloc` to answer without routing (later before hooks are skipped).
+     * Path parameters are not captured yet.
+     */
+    struct http_response *(*before)(const struct http_request *request, void *data);
+    /**
+     * @brief Called with the response of every parsed request before it is sent, in reverse order. May be NULL.
+     * It may modify `response`, e.g. attach `http_response::header_set`. Canned error responses shared by requests are not passed.
+     */
+    void (*after)(const struct http_request *request, struct http_response *response, void *data);
+    /**
+     * @brief user data passed to hooks
+     */
+    void *data;
+};
+
 /**
  * @brief Represents a web server with routing and status information.
  * 
@@ -10,6 +40,7 @@
 struct web_server {
     /**
      * @brief Pointer to the routing table containing the routes for the web server.
+     * It is compiled when the server starts, so later changes take effect only through `update_web_server_routes`.
      */
     struct routes *route_table;
     /**
@@ -28,6 +59,43 @@ struct web_server {
      * @brief Root directory of static files.
      */
     char *static_files_dir;
+    /**
+     * @brief Maximum length of request line in bytes, including CRLF. A longer one is rejected with 414.
+     * 0 means default (8 KB).
+     */
+    size_t max_request_line_length;
+    /**
+     * @brief Maximum number of header fields. More fields are rejected with 431. 0 means default (100).
+     */
+    int max_header_count;
+    /**
+     * @brief Maximum length of header section in bytes, excluding request line. A larger one is rejected with 431.
+     * 0 means default (16 KB).
+     */
+    size_t max_header_bytes;
+    /**
+     * @brief Maximum length of body in bytes, after chunked decoding. A larger one is rejected with 413.
+     * 0 means default (16 MB).
+     */
+    size_t max_body_size;
+    /**
+     * @brief Seconds for which browsers may cache a preflight response, sent as `Access-Control-Max-Age`.
+     * 0 means default (600). Browsers cap it (e.g. Chromium at 7200).
+     */
+    int cors_max_age;
+    /**
+     * @brief Seconds for which browsers may use a static file without asking, sent as `Cache-Control: max-age`.
+     * 0 means `no-cache`: every use is revalidated, and answered with 304 without body while the file is unchanged.
+     */
+    int static_max_age;
+    /**
+     * @brief Array of middlewares, which must outlive the server. NULL if none.
+     */
+    const struct http_middleware *middlewares;
+    /**
+     * @brief the number of `middlewares`
+     */
+    int middleware_count;
 };
 
 /**
@@ -35,4 +103,45 @@ struct web_server {
  * @param server Web server configuration structure
  * @return 0 on success, -1 on error
  */
-int run_web_server(struct web_server server);
\ No newline at end of file
+int run_web_server(struct web_server server);
+
+/**
+ * @brief Replace routes of the running web server with `routes`, without stopping workers.   
+ * `routes` is compiled into a new immutable table and published atomically. Workers look up routes without locks,
+ * and the previous table is freed after every worker that may be using it finishes its callback.
+ * @param routes New routes. It is not referenced after return, so it can be modified or freed.
+ * @return 0 on success, -1 on error
+ * @retval -1 If compiling failed or the server is not running
+ * @note Blocks until the previous table can be freed, i.e. while a callback started before the call is running.
+ */
+int update_web_server_routes(const struct routes *routes);
+
+/**
+ * @brief Write `length` bytes of a streamed body. Called from `http_response::stream`.   
+ * Small writes are gathered into one chunk of up to 4 KB, and larger ones are sent as they are without copying.
+ * Writes block while the client does not read, so a fast producer is slowed to the pace of the client with bounded memory.
+ * @param writer writer given to `http_response::stream`
+ * @param data bytes to write. May contain NUL.
+ * @param length the number of bytes. 0 does nothing.
+ * @return 0 on success, -1 on error
+ * @retval -1 If the client has gone, did not read for 30 seconds, or the request is HEAD. Later writes fail, too, so stop producing.
+ */
+int write_http_chunk(struct http_response_writer *writer, const void *data, size_t length);
+
+/**
+ * @brief Send bytes gathered by `write_http_chunk` now, e.g. before waiting for the next data.
+ * @param writer writer given to `http_response::stream`
+ * @return 0 on success, -1 on error, same as `write_http_chunk`
+ */
+int flush_http_chunks(struct http_response_writer *writer);
+
+/**
+ * @brief Run `response->stream` with a writer on `socket`, and end the body with the last chunk.
+ * Called by the server after the head from `build_http_response_head` is sent.
+ * @param socket client socket
+ * @param response response whose `stream` is set
+ * @param request_version `http_request::version` of the request answered. Writes are not chunked for HTTP/1.0,
+ * and the body ends when the connection is closed.
+ * @param writable false if the body must not be written, e.g. HEAD or the head was not sent. `stream` is called anyway.
+ */
+void run_http_stream(int socket, const struct http_response *response, enum http_version request_version, bool writable);
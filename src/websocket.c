@@ -0,0 +1,456 @@
+#define _GNU_SOURCE
+#include <poll.h>
+#include <sys/uio.h>
+
+#include "websocket.h"
+#include "utility.h"
+
+/**
+ * @brief GUID appended to `Sec-WebSocket-Key` before hashing (RFC 6455)
+ */
+static const char WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/**
+ * @brief Length of `Sec-WebSocket-Key` value, base64 of 16 random bytes
+ */
+#define WEBSOCKET_KEY_LENGTH 24
+
+static uint32_t rotate_left(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ * @brief Process one 64 bytes block of SHA-1.
+ */
+static void sha1_block(uint32_t state[5], const uint8_t block[64]) {
+    uint32_t w[80];
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 80; i++)
+        w[i] = rotate_left(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotate_left(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotate_left(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void compute_sha1(const void *data, size_t length, uint8_t digest[20]) {
+    uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    const uint8_t *bytes = data;
+    uint8_t last[128] = {};
+    size_t tail = length % 64;
+    size_t last_length = tail < 56 ? 64 : 128;
+    uint64_t bit_length = (uint64_t)length * 8;
+
+    for (size_t i = 0; i + 64 <= length; i += 64)
+        sha1_block(state, bytes + i);
+
+    /* the rest, 0x80 and big-endian bit length fill one or two blocks */
+    if (tail > 0)
+        memcpy(last, bytes + length - tail, tail);
+    last[tail] = 0x80;
+    for (int i = 0; i < 8; i++)
+        last[last_length - 1 - i] = (uint8_t)(bit_length >> (i * 8));
+    for (size_t i = 0; i < last_length; i += 64)
+        sha1_block(state, last + i);
+
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = (uint8_t)(state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
+
+size_t encode_base64(const void *data, size_t length, char *encoded) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const uint8_t *bytes = data;
+    size_t out = 0;
+
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)bytes[i] << 16;
+        if (i + 1 < length)
+            group |= (uint32_t)bytes[i + 1] << 8;
+        if (i + 2 < length)
+            group |= bytes[i + 2];
+
+        encoded[out++] = alphabet[(group >> 18) & 0x3F];
+        encoded[out++] = alphabet[(group >> 12) & 0x3F];
+        encoded[out++] = i + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=';
+        encoded[out++] = i + 2 < length ? alphabet[group & 0x3F] : '=';
+    }
+    encoded[out] = '\0';
+    return out;
+}
+
+int compute_websocket_accept(const char *key, size_t key_length, char accept[WEBSOCKET_ACCEPT_LENGTH + 1]) {
+    char    concatenated[WEBSOCKET_KEY_LENGTH + sizeof(WEBSOCKET_GUID)];
+    uint8_t digest[20];
+
+    if (key_length > WEBSOCKET_KEY_LENGTH)
+        return -1;
+
+    memcpy(concatenated, key, key_length);
+    memcpy(concatenated + key_length, WEBSOCKET_GUID, sizeof(WEBSOCKET_GUID) - 1);
+    compute_sha1(concatenated, key_length + sizeof(WEBSOCKET_GUID) - 1, digest);
+    encode_base64(digest, sizeof(digest), accept);
+    return 0;
+}
+
+/**
+ * @brief Check comma separated `value` has `token`, case-insensitively, e.g. `keep-alive, Upgrade` has `upgrade`.
+ */
+static bool has_header_token(const char *value, const char *token) {
+    const size_t token_length = strlen(token);
+
+    while (*value) {
+        while (*value == ' ' || *value == '\t' || *value == ',')
+            value++;
+
+        size_t length = strcspn(value, ",");
+        size_t trimmed = length;
+        while (trimmed > 0 && (value[trimmed - 1] == ' ' || value[trimmed - 1] == '\t'))
+            trimmed--;
+
+        if (trimmed == token_length && strncasecmp(value, token, token_length) == 0)
+            return true;
+        value += length;
+    }
+    return false;
+}
+
+int accept_websocket(const struct http_request *request, struct http_response *response,
+                     void (*session)(struct websocket *socket, void *data), void *data) {
+    const struct http_header *upgrade = find_http_request_header(request, "Upgrade");
+    const struct http_header *connection = find_http_request_header(request, "Connection");
+    const struct http_header *version = find_http_request_header(request, "Sec-WebSocket-Version");
+    const struct http_header *key = find_http_request_header(request, "Sec-WebSocket-Key");
+    char accept[WEBSOCKET_ACCEPT_LENGTH + 1];
+
+    response->status_code = HTTP_BAD_REQUEST;
+
+    if (request->method != HTTP_GET || request->version != HTTP_1_1
+            || upgrade == NULL || !has_header_token(upgrade->value, "websocket")
+            || connection == NULL || !has_header_token(connection->value, "upgrade"))
+        return -1;
+
+    /* only the version of RFC 6455 is spoken, and the client is told so */
+    if (version == NULL || strcmp(version->value, "13") != 0) {
+        response->status_code = HTTP_UPGRADE_REQUIRED;
+        insert_header(&response->headers, "Sec-WebSocket-Version", "13");
+        return -1;
+    }
+
+    if (key == NULL || strlen(key->value) != WEBSOCKET_KEY_LENGTH
+            || compute_websocket_accept(key->value, WEBSOCKET_KEY_LENGTH, accept) == -1)
+        return -1;
+
+    response->status_code = HTTP_SWITCHING_PROTOCOLS;
+    insert_header(&response->headers, "Upgrade", "websocket");
+    insert_header(&response->headers, "Connection", "Upgrade");
+    insert_header(&response->headers, "Sec-WebSocket-Accept", accept);
+    response->websocket = session;
+    response->websocket_data = data;
+    return 0;
+}
+
+ssize_t parse_websocket_frame_header(const uint8_t *data, size_t length, struct websocket_frame_header *header) {
+    size_t      needed = 2;
+    uint64_t    payload_length;
+
+    header->header_length = needed;
+    if (length < needed)
+        return 0;
+
+    /* reserved bits are for extensions, and no extension is negotiated */
+    if (data[0] & 0x70)
+        return -1;
+
+    header->fin = (data[0] & 0x80) != 0;
+    header->opcode = (enum websocket_opcode)(data[0] & 0x0F);
+    header->masked = (data[1] & 0x80) != 0;
+    payload_length = data[1] & 0x7F;
+
+    switch (header->opcode) {
+    case WEBSOCKET_CONTINUATION:
+    case WEBSOCKET_TEXT:
+    case WEBSOCKET_BINARY:
+        break;
+    case WEBSOCKET_CLOSE:
+    case WEBSOCKET_PING:
+    case WEBSOCKET_PONG:
+        /* control frames are never fragmented, and their payload fits in 7 bits */
+        if (!header->fin || payload_length > WEBSOCKET_MAX_CONTROL_PAYLOAD)
+            return -1;
+        break;
+    default:
+        return -1;
+    }
+
+    if (payload_length == 126)
+        needed += 2;
+    else if (payload_length == 127)
+        needed += 8;
+    if (header->masked)
+        needed += 4;
+
+    header->header_length = needed;
+    if (length < needed)
+        return 0;
+
+    if (payload_length == 126) {
+        payload_length = (uint64_t)data[2] << 8 | data[3];
+    } else if (payload_length == 127) {
+        payload_length = 0;
+        for (int i = 0; i < 8; i++)
+            payload_length = payload_length << 8 | data[2 + i];
+        if (payload_length >> 63)
+            return -1;
+    }
+    header->payload_length = payload_length;
+
+    if (header->masked)
+        memcpy(header->mask, data + needed - 4, 4);
+    return (ssize_t)needed;
+}
+
+size_t build_websocket_frame_header(uint8_t *header, enum websocket_opcode opcode, bool fin, uint64_t payload_length) {
+    header[0] = (fin ? 0x80 : 0x00) | (uint8_t)opcode;
+
+    if (payload_length < 126) {
+        header[1] = (uint8_t)payload_length;
+        return 2;
+    }
+    if (payload_length <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = (uint8_t)(payload_length >> 8);
+        header[3] = (uint8_t)payload_length;
+        return 4;
+    }
+    header[1] = 127;
+    for (int i = 0; i < 8; i++)
+        header[2 + i] = (uint8_t)(payload_length >> ((7 - i) * 8));
+    return 10;
+}
+
+void mask_websocket_payload(uint8_t *payload, size_t length, const uint8_t mask[4], size_t offset) {
+    for (size_t i = 0; i < length; i++)
+        payload[i] ^= mask[(offset + i) & 3];
+}
+
+/**
+ * @brief Read exactly `length` bytes. Waits `timeout` milliseconds (-1 for ever) for the first byte,
+ * and `WEBSOCKET_IO_TIMEOUT` for the others.
+ *
+ * @return 0 on success, -1 if the peer has gone, timed out, or failed to read
+ */
+static int receive_exactly(struct websocket *socket, void *data, size_t length, int timeout) {
+    size_t received = 0;
+
+    while (received < length) {
+        struct pollfd pfd = {.fd = socket->socket, .events = POLLIN};
+        int ready = poll(&pfd, 1, timeout);
+        if (ready == -1 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            return -1;
+
+        ssize_t bytes_read = read(socket->socket, (char *)data + received, length - received);
+        if (bytes_read == -1 && errno == EINTR)
+            continue;
+        if (bytes_read <= 0)
+            return -1;
+        received += (size_t)bytes_read;
+        timeout = WEBSOCKET_IO_TIMEOUT * 1000;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read a frame header, asking for the exact number of bytes that `parse_websocket_frame_header` needs.
+ *
+ * @return 0 on success, -1 on I/O error, -2 if the header is malformed
+ */
+static int receive_frame_header(struct websocket *socket, struct websocket_frame_header *header, int timeout) {
+    uint8_t data[WEBSOCKET_MAX_FRAME_HEADER_LENGTH];
+    size_t  length = 0;
+    ssize_t parsed;
+
+    while ((parsed = parse_websocket_frame_header(data, length, header)) == 0) {
+        if (receive_exactly(socket, data + length, header->header_length - length, timeout) == -1)
+            return -1;
+        length = header->header_length;
+        timeout = WEBSOCKET_IO_TIMEOUT * 1000;
+    }
+    return parsed == -1 ? -2 : 0;
+}
+
+/**
+ * @brief Write all of `vectors` to the socket, resuming after partial writes. A peer that has gone does not raise `SIGPIPE`.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int send_vectors(int socket, struct iovec *vectors, int count) {
+    while (count > 0) {
+        struct msghdr message = {.msg_iov = vectors, .msg_iovlen = count};
+        ssize_t written = sendmsg(socket, &message, MSG_NOSIGNAL);
+        if (written <= 0) {
+            if (written == -1 && errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        while (count > 0 && (size_t)written >= vectors->iov_len) {
+            written -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char *)vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Send a frame of `opcode` without checking whether it may be sent.
+ */
+static int send_frame(struct websocket *socket, enum websocket_opcode opcode, const void *data, size_t length) {
+    uint8_t header[WEBSOCKET_MAX_FRAME_HEADER_LENGTH];
+    struct iovec vectors[2] = {
+        {header, build_websocket_frame_header(header, opcode, true, length)},
+        {(void *)data, length}
+    };
+
+    if (send_vectors(socket->socket, vectors, length > 0 ? 2 : 1) == -1) {
+        socket->close_sent = true;
+        return -1;
+    }
+    return 0;
+}
+
+int send_websocket_message(struct websocket *socket, enum websocket_opcode opcode, const void *data, size_t length) {
+    if (socket->close_sent || opcode == WEBSOCKET_CLOSE)
+        return -1;
+    if ((opcode & 0x8) && length > WEBSOCKET_MAX_CONTROL_PAYLOAD)
+        return -1;
+    return send_frame(socket, opcode, data, length);
+}
+
+int close_websocket(struct websocket *socket, enum websocket_close_code code) {
+    const uint8_t payload[2] = {(uint8_t)(code >> 8), (uint8_t)code};
+
+    if (socket->close_sent)
+        return -1;
+
+    const int result = send_frame(socket, WEBSOCKET_CLOSE, payload, sizeof(payload));
+    socket->close_sent = true;
+    return result;
+}
+
+/**
+ * @brief Close the connection for a violation of the peer, and fail the receive.
+ */
+static ssize_t fail_websocket(struct websocket *socket, enum websocket_close_code code) {
+    DLOGV("Closing websocket (%d) - socket=%d\n", code, socket->socket);
+    close_websocket(socket, code);
+    socket->closed = true;
+    return -1;
+}
+
+ssize_t receive_websocket_message(struct websocket *socket, void *buffer, size_t size, enum websocket_opcode *opcode) {
+    struct websocket_frame_header   header;
+    uint8_t                         control[WEBSOCKET_MAX_CONTROL_PAYLOAD];
+    size_t                          length = 0;
+    bool                            fragmented = false;
+    int                             timeout = -1;
+
+    if (socket->closed)
+        return -1;
+
+    while (1) {
+        int result = receive_frame_header(socket, &header, timeout);
+        if (result == -2)
+            return fail_websocket(socket, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+        if (result == -1) {
+            socket->closed = true;
+            return -1;
+        }
+        timeout = WEBSOCKET_IO_TIMEOUT * 1000;
+
+        /* every frame from a client is masked */
+        if (!header.masked)
+            return fail_websocket(socket, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+
+        /* control frames may come between fragments of a message */
+        if (header.opcode & 0x8) {
+            if (receive_exactly(socket, control, header.payload_length, timeout) == -1) {
+                socket->closed = true;
+                return -1;
+            }
+            mask_websocket_payload(control, header.payload_length, header.mask, 0);
+
+            if (header.opcode == WEBSOCKET_CLOSE) {
+                socket->closed = true;
+                close_websocket(socket, WEBSOCKET_CLOSE_NORMAL);
+                return -1;
+            }
+            if (header.opcode == WEBSOCKET_PING && send_frame(socket, WEBSOCKET_PONG, control, header.payload_length) == -1) {
+                socket->closed = true;
+                return -1;
+            }
+            if (!fragmented) {
+                *opcode = header.opcode;
+                return 0;
+            }
+            continue;
+        }
+
+        /* continuation must follow an unfinished message, and a new message must not */
+        if ((header.opcode == WEBSOCKET_CONTINUATION) != fragmented)
+            return fail_websocket(socket, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+        if (header.payload_length > size - length)
+            return fail_websocket(socket, WEBSOCKET_CLOSE_MESSAGE_TOO_BIG);
+
+        if (receive_exactly(socket, (char *)buffer + length, header.payload_length, timeout) == -1) {
+            socket->closed = true;
+            return -1;
+        }
+        mask_websocket_payload((uint8_t *)buffer + length, header.payload_length, header.mask, 0);
+        length += header.payload_length;
+
+        if (!fragmented)
+            *opcode = header.opcode;
+        if (header.fin)
+            return (ssize_t)length;
+        fragmented = true;
+    }
+}
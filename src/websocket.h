@@ -0,0 +1,221 @@
+#pragma once
+
+#include "http.h"
+
+/**
+ * @brief Length of `Sec-WebSocket-Accept` value, base64 of SHA-1 digest
+ */
+#define WEBSOCKET_ACCEPT_LENGTH 28
+
+/**
+ * @brief Maximum length of a frame header: 2 bytes, 8 bytes of extended payload length and 4 bytes of masking key
+ */
+#define WEBSOCKET_MAX_FRAME_HEADER_LENGTH 14
+
+/**
+ * @brief Maximum payload length of a control frame (close, ping, pong)
+ */
+#define WEBSOCKET_MAX_CONTROL_PAYLOAD 125
+
+/**
+ * @brief Seconds for which the rest of a frame is waited for once its first byte arrived, and a send waits for the peer to read
+ */
+#define WEBSOCKET_IO_TIMEOUT 30
+
+enum websocket_opcode;
+enum websocket_close_code;
+
+struct websocket;
+struct websocket_frame_header;
+
+/**
+ * @brief Compute SHA-1 digest of `data`. Used for the opening handshake only, not for security.
+ *
+ * @param data bytes to digest
+ * @param length the number of bytes
+ * @param digest out parameter, 20 bytes of digest are stored
+ */
+void compute_sha1(const void *data, size_t length, uint8_t digest[20]);
+
+/**
+ * @brief Encode `data` into base64 with padding (RFC 4648).
+ *
+ * @param data bytes to encode
+ * @param length the number of bytes
+ * @param encoded out parameter, which must hold `4 * ((length + 2) / 3) + 1` bytes. NUL-terminated.
+ * @return Length of `encoded`, excluding NUL
+ */
+size_t encode_base64(const void *data, size_t length, char *encoded);
+
+/**
+ * @brief Compute `Sec-WebSocket-Accept` value from `Sec-WebSocket-Key` value, i.e. base64 of SHA-1 of the key followed by the GUID of RFC 6455.
+ *
+ * @param key value of `Sec-WebSocket-Key`, not necessarily NUL-terminated
+ * @param key_length length of `key`
+ * @param accept out parameter, `WEBSOCKET_ACCEPT_LENGTH` characters and NUL are stored
+ * @return 0 on success, -1 if `key` is longer than a key can be (a base64 of 16 bytes has 24 characters)
+ */
+int compute_websocket_accept(const char *key, size_t key_length, char accept[WEBSOCKET_ACCEPT_LENGTH + 1]);
+
+/**
+ * @brief Answer the opening handshake of WebSocket. Called from a route handler.
+ * If `request` is a valid upgrade request (GET of HTTP/1.1 with `Upgrade: websocket`, `Connection: Upgrade`,
+ * `Sec-WebSocket-Version: 13` and a key), `response` is filled with 101 and its `Sec-WebSocket-Accept`, and `session` is set to
+ * `http_response::websocket`. The server calls `session` with the connection after 101 is sent.
+ *
+ * @param request request given to the handler
+ * @param response response given to the handler
+ * @param session function which talks over the connection. The worker is held until it returns.
+ * @param data user data passed to `session`
+ * @return 0 on success, -1 if `request` is not a valid upgrade request
+ * @retval -1 `response` is set to 400, or 426 with `Sec-WebSocket-Version: 13` if the version is not supported.
+ * It can be sent as it is. `session` is not called.
+ */
+int accept_websocket(const struct http_request *request, struct http_response *response,
+                     void (*session)(struct websocket *socket, void *data), void *data);
+
+/**
+ * @brief Decode a frame header at the start of `data`.
+ *
+ * @param data received bytes
+ * @param length the number of bytes in `data`
+ * @param header out parameter, decoded header
+ * @return Length of the header on success, which is at most `WEBSOCKET_MAX_FRAME_HEADER_LENGTH`.
+ * @retval 0 `data` does not hold a whole header yet. `header->header_length` is set to the number of bytes needed, if known.
+ * @retval -1 Malformed header: reserved bits or opcode, fragmented or too long control frame, or the most significant bit of 64-bit length set
+ */
+ssize_t parse_websocket_frame_header(const uint8_t *data, size_t length, struct websocket_frame_header *header);
+
+/**
+ * @brief Encode a header of an unmasked frame, as servers send.
+ *
+ * @param header out parameter, which must hold `WEBSOCKET_MAX_FRAME_HEADER_LENGTH` bytes
+ * @param opcode opcode of the frame
+ * @param fin whether the frame is the last one of the message
+ * @param payload_length length of payload following the header
+ * @return Length of the header, which is 2, 4 or 10
+ */
+size_t build_websocket_frame_header(uint8_t *header, enum websocket_opcode opcode, bool fin, uint64_t payload_length);
+
+/**
+ * @brief Mask or unmask `payload` in place with `mask` (XOR, so both are the same operation).
+ *
+ * @param payload bytes to mask
+ * @param length the number of bytes
+ * @param mask masking key of the frame
+ * @param offset offset of `payload` in the payload of the frame, for a payload processed in pieces
+ */
+void mask_websocket_payload(uint8_t *payload, size_t length, const uint8_t mask[4], size_t offset);
+
+/**
+ * @brief Receive a message from the peer. Fragmented messages are reassembled into `buffer`.
+ * Ping is answered with pong, and close is answered with close. Waits for the first byte without limit,
+ * so `poll` `websocket::socket` to wait together with other descriptors. The rest of a frame is waited for up to `WEBSOCKET_IO_TIMEOUT`.
+ * Headers and payloads are read with exact lengths, so no byte of the next frame is buffered behind `poll`.
+ *
+ * @param socket connection given to `http_response::websocket`
+ * @param buffer buffer to store the message. Not NUL-terminated.
+ * @param size size of `buffer`
+ * @param opcode out parameter, `WEBSOCKET_TEXT` or `WEBSOCKET_BINARY` of the message.
+ * `WEBSOCKET_PING` or `WEBSOCKET_PONG` if a control frame was handled before any data frame, with 0 returned.
+ * @return Length of the message. 0 for an empty message or a handled control frame.
+ * @retval -1 The connection is closed: close frame received, protocol violation, message larger than `size` (closed with 1009), or I/O error.
+ * Later calls fail, too.
+ * @note UTF-8 of text messages is not validated.
+ */
+ssize_t receive_websocket_message(struct websocket *socket, void *buffer, size_t size, enum websocket_opcode *opcode);
+
+/**
+ * @brief Send a message in one unmasked frame. Blocks while the peer does not read, up to `WEBSOCKET_IO_TIMEOUT`.
+ *
+ * @param socket connection given to `http_response::websocket`
+ * @param opcode opcode of the frame. Control frames (ping, pong) may have `WEBSOCKET_MAX_CONTROL_PAYLOAD` bytes at most.
+ * Use `close_websocket` to close.
+ * @param data payload. May be **NULL** if `length` is 0.
+ * @param length length of payload
+ * @return 0 on success, -1 on error
+ * @retval -1 The peer has gone, did not read for `WEBSOCKET_IO_TIMEOUT`, a close frame was sent, or the control frame is too long
+ */
+int send_websocket_message(struct websocket *socket, enum websocket_opcode opcode, const void *data, size_t length);
+
+/**
+ * @brief Send a close frame with `code`, if not sent yet. Later sends fail. The server sends 1000 after `http_response::websocket` returns,
+ * if the session has not closed.
+ *
+ * @param socket connection given to `http_response::websocket`
+ * @param code status code of closure
+ * @return 0 on success, -1 if sending failed or close frame was already sent
+ */
+int close_websocket(struct websocket *socket, enum websocket_close_code code);
+
+/**
+ * @brief opcode of WebSocket frame
+ */
+enum websocket_opcode {
+    WEBSOCKET_CONTINUATION = 0x0,
+    WEBSOCKET_TEXT = 0x1,
+    WEBSOCKET_BINARY = 0x2,
+    WEBSOCKET_CLOSE = 0x8,
+    WEBSOCKET_PING = 0x9,
+    WEBSOCKET_PONG = 0xA
+};
+
+/**
+ * @brief status code of close frame
+ */
+enum websocket_close_code {
+    WEBSOCKET_CLOSE_NORMAL = 1000,
+    WEBSOCKET_CLOSE_GOING_AWAY = 1001,
+    WEBSOCKET_CLOSE_PROTOCOL_ERROR = 1002,
+    WEBSOCKET_CLOSE_UNSUPPORTED_DATA = 1003,
+    WEBSOCKET_CLOSE_MESSAGE_TOO_BIG = 1009,
+    WEBSOCKET_CLOSE_INTERNAL_ERROR = 1011
+};
+
+/**
+ * @brief Header of WebSocket frame, decoded by `parse_websocket_frame_header`.
+ */
+struct websocket_frame_header {
+    /**
+     * @brief whether the frame is the last one of the message
+     */
+    bool                    fin;
+    /**
+     * @brief opcode of the frame
+     */
+    enum websocket_opcode   opcode;
+    /**
+     * @brief whether payload is masked. Frames from clients must be.
+     */
+    bool                    masked;
+    /**
+     * @brief masking key. Valid if `masked`.
+     */
+    uint8_t                 mask[4];
+    /**
+     * @brief length of payload
+     */
+    uint64_t                payload_length;
+    /**
+     * @brief length of the header
+     */
+    size_t                  header_length;
+};
+
+/**
+ * @brief WebSocket connection, living on the stack of the worker during `http_response::websocket`.
+ */
+struct websocket {
+    /**
+     * @brief client socket. Can be passed to `poll` to wait for the next message.
+     */
+    int     socket;
+    /**
+     * @brief set when close frame was received, or the connection failed. Every later receive fails.
+     */
+    bool    closed;
+    /**
+     * @brief set when close frame was sent, or sending failed. Every later send fails.
+     */
+    bool    close_sent;
+};
@@ -0,0 +1,115 @@
+/**
+ * @file bench_parser.c
+ * @brief Throughput benchmark of `parse_http_request`. Run with `make bench-parser`.
+ *
+ * Each file given as argument holds one raw HTTP request (see `test/corpus`).
+ * Headers, query parameters and body are decoded lazily, so every request is decoded through their accessors,
+ * as route callbacks do. Reports requests/s and ns/request of that for each file, and for whole corpus,
+ * and ns/line of `parse_http_request` alone, i.e. the request line, for comparison.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "http.h"
+
+#define DEFAULT_ITERATIONS 200000
+
+static char *read_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char *content = malloc(size + 1);
+    if (fread(content, 1, size, fp) != (size_t)size) {
+        perror(path);
+        free(content);
+        fclose(fp);
+        return NULL;
+    }
+    content[size] = '\0';
+    fclose(fp);
+    return content;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief Parse `request_string` `iterations` times, decoding headers, query parameters and body if `decode` is set.
+ *
+ * @return elapsed nanoseconds
+ */
+static double time_parsing(const char *request_string, long iterations, bool decode) {
+    struct timespec start, end;
+    volatile size_t sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long n = 0; n < iterations; n++) {
+        struct http_request *request = parse_http_request(request_string);
+        if (decode) {
+            sink += get_http_request_headers(request)->size;
+            sink += get_http_request_query_parameters(request)->size;
+            sink += (unsigned char)get_http_request_body(request)[0] + get_http_request_body_length(request);
+        }
+        destruct_http_request(request);
+        free(request);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)sink;
+    return elapsed_ns(&start, &end);
+}
+
+int main(int argc, char **argv) {
+    long    iterations = DEFAULT_ITERATIONS;
+    double  total_ns = 0;
+    double  total_line_ns = 0;
+    long    total_requests = 0;
+
+    if (getenv("BENCH_ITERATIONS"))
+        iterations = atol(getenv("BENCH_ITERATIONS"));
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <request file>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-32s %14s %12s %12s\n", "corpus", "requests/s", "ns/request", "ns/line");
+    for (int i = 1; i < argc; i++) {
+        char *request_string = read_file(argv[i]);
+        if (request_string == NULL)
+            return EXIT_FAILURE;
+
+        /* make sure the request is parsable, so that failing fast is not measured */
+        struct http_request *request = parse_http_request(request_string);
+        if (request == NULL || get_http_request_headers(request)->capacity == 0) {
+            fprintf(stderr, "%s: failed to parse\n", argv[i]);
+            free(request_string);
+            return EXIT_FAILURE;
+        }
+        destruct_http_request(request);
+        free(request);
+
+        double ns = time_parsing(request_string, iterations, true);
+        double line_ns = time_parsing(request_string, iterations, false);
+        const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        printf("%-32s %14.0f %12.1f %12.1f\n", name, iterations / (ns / 1e9), ns / iterations, line_ns / iterations);
+
+        total_ns += ns;
+        total_line_ns += line_ns;
+        total_requests += iterations;
+        free(request_string);
+    }
+    printf("%-32s %14.0f %12.1f %12.1f\n", "(total)", total_requests / (total_ns / 1e9), total_ns / total_requests,
+           total_line_ns / total_requests);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file fuzz_parser.c
+ * @brief Fuzzing harness for HTTP and JSON parsers. Compatible with libFuzzer and AFL.
+ *
+ * The first byte of input selects the target, and the rest is passed to it as NUL-terminated string.
+ * - 0: `parse_http_request`
+ * - 1: `parse_http_header`
+ * - 2: `parse_query_parameters`
+ * - 3: `parse_json`, and `json_object_stringify` of the parsed object, which must be parsed again into the same string
+ *
+ * Build with `make fuzz-parser` (libFuzzer, needs clang) or `make fuzz-parser-standalone`
+ * (any compiler, reads inputs from files or stdin; use `CC=afl-clang-fast` for AFL).
+ * Both are built with AddressSanitizer and UndefinedBehaviorSanitizer.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http.h"
+#include "json.h"
+
+enum fuzz_target {
+    FUZZ_HTTP_REQUEST,
+    FUZZ_HTTP_HEADER,
+    FUZZ_QUERY_PARAMETERS,
+    FUZZ_JSON,
+    FUZZ_TARGET_COUNT
+};
+
+static void fuzz_http_request(const char *input, size_t length) {
+    /* input may contain NUL, as a binary body does */
+    struct http_request *request = parse_http_request_bytes(input, length);
+    if (request) {
+        /* force lazy decoding of every part */
+        get_http_request_headers(request);
+        get_http_request_query_parameters(request);
+        find_http_request_header(request, "content-type");
+        /* every byte of body must be inside input */
+        memchr(get_http_request_body(request), 0xff, get_http_request_body_length(request));
+        destruct_http_request(request);
+        free(request);
+    }
+}
+
+static void fuzz_http_header(char *input) {
+    /* `parse_http_header` requires a header line ended by CRLF */
+    if (strstr(input, "\r\n") == NULL)
+        return;
+    struct http_header *header = parse_http_header(input);
+    if (header) {
+        free(header->key);
+        free(header->value);
+        free(header);
+    }
+}
+
+static void fuzz_query_parameters(char *input) {
+    struct http_query_parameters query_parameters = parse_query_parameters(input);
+    free_query_parameters(&query_parameters);
+}
+
+static void fuzz_json(const char *input) {
+    struct json_object *object = parse_json(input);
+    if (object) {
+        char *serialized = json_object_stringify(object);
+        destruct_json_object(object);
+
+        object = parse_json(serialized);
+        if (object == NULL)
+            abort();
+        char *reserialized = json_object_stringify(object);
+        if (strcmp(serialized, reserialized) != 0)
+            abort();
+        free(reserialized);
+        free(serialized);
+        destruct_json_object(object);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0)
+        return 0;
+
+    char *input = malloc(size);
+    if (input == NULL)
+        return 0;
+    memcpy(input, data + 1, size - 1);
+    input[size - 1] = '\0';
+
+    switch (data[0] % FUZZ_TARGET_COUNT) {
+    case FUZZ_HTTP_REQUEST:
+        fuzz_http_request(input, size - 1);
+        break;
+    case FUZZ_HTTP_HEADER:
+        fuzz_http_header(input);
+        break;
+    case FUZZ_QUERY_PARAMETERS:
+        fuzz_query_parameters(input);
+        break;
+    case FUZZ_JSON:
+        fuzz_json(input);
+        break;
+    }
+
+    free(input);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+/**
+ * @brief Run each file given as argument (or stdin if none) through `LLVMFuzzerTestOneInput`.
+ * This is the entry point for AFL and for replaying crash inputs without libFuzzer.
+ */
+static int run_file(FILE *fp) {
+    size_t  size = 0;
+    size_t  capacity = 4096;
+    uint8_t *data = malloc(capacity);
+
+    while (!feof(fp)) {
+        if (size == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+        size += fread(data + size, 1, capacity - size, fp);
+        if (ferror(fp)) {
+            free(data);
+            return -1;
+        }
+    }
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2)
+        return run_file(stdin) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    for (int i = 1; i < argc; i++) {
+        FILE *fp = fopen(argv[i], "rb");
+        if (fp == NULL) {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+        run_file(fp);
+        fclose(fp);
+    }
+    return EXIT_SUCCESS;
+}
+#endif
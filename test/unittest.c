@@ -1,7 +1,11 @@
 #include <CUnit/CUnit.h>
 #include <CUnit/Basic.h>
 #include <webserver/http.h>
+#include <webserver/json.h>
+#include <webserver/router.h>
+#include <webserver/runner.h>
 #include <webserver/utility.h>
+#include <webserver/websocket.h>
 #include <pthread.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -91,6 +95,353 @@ void test_find_header() {
     CU_ASSERT(find_header(&headers, "k0") == NULL);
 }
 
+/**
+ * @brief Test for `create_http_header_set`. Header set is serialized once and written before headers of response.
+ * @warning **[Dependency of tests]**   
+ * `insert_header`   
+ * `http_response_stringify`   
+ */
+void test_http_header_set() {
+    struct http_headers headers = {};
+
+    CU_ASSERT(insert_header(&headers, "Access-Control-Allow-Origin", "*") != NULL);
+    CU_ASSERT(insert_header(&headers, "Content-Type", "application/json") != NULL);
+
+    struct http_header_set *header_set = create_http_header_set(&headers);
+    destruct_http_headers(&headers);
+
+    CU_ASSERT_FATAL(header_set != NULL);
+    CU_ASSERT_STRING_EQUAL(header_set->data, "Access-Control-Allow-Origin: *\r\nContent-Type: application/json\r\n");
+    CU_ASSERT(header_set->length == strlen(header_set->data));
+
+    struct http_response response = {
+        .status_code = HTTP_OK,
+        .http_version = HTTP_1_1,
+        .headers = {},
+        .body = "{}",
+        .header_set = retain_http_header_set(header_set)
+    };
+    CU_ASSERT(insert_header(&response.headers, "X-Pid", "10") != NULL);
+
+    char *response_string = http_response_stringify(response);
+    CU_ASSERT_STRING_EQUAL(response_string,
+        "HTTP/1.1 200 OK\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Content-Type: application/json\r\n"
+        "X-Pid: 10\r\n"
+        "Content-Length: 2\r\n"
+        "\r\n"
+        "{}");
+    free(response_string);
+    destruct_http_headers(&response.headers);
+
+    /* set is alive until the last reference is released */
+    release_http_header_set(response.header_set);
+    CU_ASSERT(atomic_load(&header_set->references) == 1);
+    release_http_header_set(header_set);
+}
+
+/**
+ * @brief Stream function which writes nothing, for `http_response::stream`
+ */
+static void discard_stream(struct http_response_writer *writer, void *data) {
+    (void)writer;
+    (void)data;
+}
+
+/**
+ * @brief Test for `build_http_response`. Output buffer is reused, and grows only when a response does not fit.
+ * @warning **[Dependency of tests]**   
+ * `insert_header`   
+ */
+void test_build_http_response() {
+    struct http_output_buffer buffer;
+    struct http_response response = {
+        .status_code = HTTP_NOT_FOUND,
+        .http_version = HTTP_1_1,
+        .headers = {},
+        .body = NULL
+    };
+
+    CU_ASSERT(init_http_output_buffer(&buffer, 16) == 0);
+
+    CU_ASSERT(build_http_response(&buffer, &response) == 45);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    CU_ASSERT(buffer.head_length == buffer.length);
+
+    char body[1024];
+    memset(body, 'a', sizeof(body) - 1);
+    body[sizeof(body) - 1] = '\0';
+
+    response = (struct http_response) {
+        .status_code = HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE,
+        .http_version = HTTP_1_0,
+        .headers = {},
+        .body = body
+    };
+    insert_header(&response.headers, "Content-Type", "text/plain");
+    insert_header(&response.headers, "Connection", "close");
+
+    const char *expected_head =
+        "HTTP/1.0 431 Request Header Fields Too Large\r\n"
+        "Content-Type: text/plain\r\n"
+        "Connection: close\r\n"
+        "Content-Length: 1023\r\n"
+        "\r\n";
+    CU_ASSERT(build_http_response(&buffer, &response) == (ssize_t)(strlen(expected_head) + strlen(body)));
+    CU_ASSERT(buffer.length == strlen(expected_head) + strlen(body));
+    CU_ASSERT(strncmp(buffer.data, expected_head, strlen(expected_head)) == 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data + strlen(expected_head), body);
+    CU_ASSERT(buffer.head_length == strlen(expected_head));
+    CU_ASSERT(buffer.capacity > buffer.length);
+
+    /* smaller response reuses the grown buffer */
+    const size_t capacity = buffer.capacity;
+    response.status_code = 299;
+    response.body = NULL;
+    destruct_http_headers(&response.headers);
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.0 299 Unknown Status\r\nContent-Length: 0\r\n\r\n");
+    CU_ASSERT(buffer.capacity == capacity);
+    CU_ASSERT_STRING_EQUAL(http_status_code_stringify(HTTP_URI_TOO_LONG), "URI Too Long");
+
+    /* no body is allowed for 204, and explicit Content-Length is kept */
+    response.status_code = HTTP_NO_CONTENT;
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.0 204 No Content\r\n\r\n");
+
+    response.status_code = HTTP_OK;
+    response.headers = (struct http_headers) {};
+    insert_header(&response.headers, "content-length", "5");
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.0 200 OK\r\ncontent-length: 5\r\n\r\n");
+    destruct_http_headers(&response.headers);
+    response.headers = (struct http_headers) {};
+
+    /* streamed body is not serialized, and framed by chunks except for HTTP/1.0 */
+    response.body = "ignored";
+    response.stream = discard_stream;
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.0 200 OK\r\n\r\n");
+
+    response.http_version = HTTP_1_1;
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+    CU_ASSERT(buffer.head_length == buffer.length);
+    CU_ASSERT(create_http_canned_response(&response) == NULL);
+
+    /* framing follows the version of the client, not of the response */
+    CU_ASSERT(build_http_response_head(&buffer, &response, HTTP_1_0) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.1 200 OK\r\n\r\n");
+
+    /* binary body is copied by its length, and file body is only counted */
+    response = (struct http_response) {
+        .status_code = HTTP_OK,
+        .http_version = HTTP_1_1,
+        .headers = {},
+        .body = "\x89PNG\0\x1a",
+        .body_length = 6,
+        .body_type = HTTP_BODY_BORROWED
+    };
+    CU_ASSERT(build_http_response(&buffer, &response) == (ssize_t)(strlen("HTTP/1.1 200 OK\r\nContent-Length: 6\r\n\r\n") + 6));
+    CU_ASSERT(memcmp(buffer.data + buffer.head_length, "\x89PNG\0\x1a", 6) == 0);
+
+    /* head alone leaves the body to be sent from the response */
+    CU_ASSERT(build_http_response_head(&buffer, &response, HTTP_1_1) == (ssize_t)strlen("HTTP/1.1 200 OK\r\nContent-Length: 6\r\n\r\n"));
+    CU_ASSERT(buffer.length == buffer.head_length);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.1 200 OK\r\nContent-Length: 6\r\n\r\n");
+
+    response.body = NULL;
+    response.body_length = 1 << 20;
+    response.body_type = HTTP_BODY_FILE;
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data, "HTTP/1.1 200 OK\r\nContent-Length: 1048576\r\n\r\n");
+    CU_ASSERT(create_http_canned_response(&response) == NULL);
+
+    destruct_http_output_buffer(&buffer);
+}
+
+/**
+ * @brief Rewrite the cached `Date` line with two times differing in every field, until `*data` is set. For `test_http_date`.
+ */
+static void *flip_http_date(void *data) {
+    atomic_bool *stop = (atomic_bool *)data;
+    for (time_t now = 784111777; !atomic_load(stop); now = now == 784111777 ? 784111777 + 90061 : 784111777)
+        update_http_date(now);
+    return NULL;
+}
+
+/**
+ * @brief Test for `update_http_date`. Cached line is written after the status line, but not into canned responses.
+ * @warning Date cache is global and stays updated, so this test must be registered last.
+ */
+void test_http_date() {
+    struct http_output_buffer buffer = {};
+    struct http_response response = {
+        .status_code = HTTP_OK,
+        .http_version = HTTP_1_1,
+        .headers = {},
+        .body = "ok"
+    };
+
+    char line[HTTP_DATE_LINE_LENGTH];
+
+    update_http_date(784111777);
+    CU_ASSERT_FATAL(copy_http_date_line(line));
+    CU_ASSERT(strncmp(line, "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n", HTTP_DATE_LINE_LENGTH) == 0);
+
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data,
+        "HTTP/1.1 200 OK\r\n"
+        "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+        "Content-Length: 2\r\n"
+        "\r\n"
+        "ok");
+
+    update_http_date(784111778);
+    CU_ASSERT(copy_http_date_line(line));
+    CU_ASSERT(strncmp(line, "Date: Sun, 06 Nov 1994 08:49:38 GMT\r\n", HTTP_DATE_LINE_LENGTH) == 0);
+
+    /* copies made while the line is rewritten are always one of the published lines */
+    pthread_t updater;
+    atomic_bool stop = false;
+    bool torn = false;
+    update_http_date(784111777);
+    CU_ASSERT_FATAL(pthread_create(&updater, NULL, flip_http_date, &stop) == 0);
+    for (int i = 0; i < 200000; i++) {
+        CU_ASSERT_FATAL(copy_http_date_line(line));
+        if (strncmp(line, "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n", HTTP_DATE_LINE_LENGTH) != 0
+                && strncmp(line, "Date: Mon, 07 Nov 1994 09:50:38 GMT\r\n", HTTP_DATE_LINE_LENGTH) != 0)
+            torn = true;
+    }
+    atomic_store(&stop, true);
+    pthread_join(updater, NULL);
+    CU_ASSERT_FALSE(torn);
+    update_http_date(784111778);
+
+    struct http_canned_response *canned = create_http_canned_response(&response);
+    CU_ASSERT_FATAL(canned != NULL);
+    CU_ASSERT_STRING_EQUAL(canned->data, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    CU_ASSERT(canned->status_line_length == strlen("HTTP/1.1 200 OK\r\n"));
+    release_http_canned_response(canned);
+
+    destruct_http_output_buffer(&buffer);
+}
+
+/**
+ * @brief Test for `create_http_canned_response` and `insert_canned_route`. Canned bytes are shared with compiled tables by reference.
+ * @warning **[Dependency of tests]**   
+ * `init_routes`, `compile_route_table`   
+ */
+void test_canned_response() {
+    struct http_response response = {
+        .status_code = HTTP_OK,
+        .http_version = HTTP_1_1,
+        .headers = {},
+        .body = "{\"status\":\"ok\"}"
+    };
+    CU_ASSERT(insert_header(&response.headers, "Content-Type", "application/json") != NULL);
+
+    const char *expected =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 15\r\n"
+        "\r\n"
+        "{\"status\":\"ok\"}";
+
+    struct http_canned_response *canned = create_http_canned_response(&response);
+    CU_ASSERT_FATAL(canned != NULL);
+    CU_ASSERT_STRING_EQUAL(canned->data, expected);
+    CU_ASSERT(canned->length == strlen(expected));
+    CU_ASSERT(canned->head_length == strlen(expected) - strlen(response.body));
+    release_http_canned_response(canned);
+
+    struct routes routes;
+    CU_ASSERT_FATAL(init_routes(&routes) != NULL);
+    CU_ASSERT_FATAL(insert_canned_route(&routes, "/health", HTTP_GET, &response) != NULL);
+    CU_ASSERT(insert_canned_route(&routes, "/health", HTTP_GET, &response) == NULL);
+    destruct_http_headers(&response.headers);
+
+    struct route *route = find_route(&routes, "/health", HTTP_GET);
+    CU_ASSERT_FATAL(route != NULL);
+    CU_ASSERT(route->callback == NULL);
+    CU_ASSERT_FATAL(route->canned != NULL);
+    CU_ASSERT_STRING_EQUAL(route->canned->data, expected);
+
+    /* compiled table shares the bytes, and keeps them after the route is removed */
+    struct route_table *table = compile_route_table(&routes);
+    CU_ASSERT_FATAL(table != NULL);
+    CU_ASSERT(atomic_load(&route->canned->references) == 2);
+    CU_ASSERT(remove_route(&routes, "/health", HTTP_GET) != NULL);
+
+    const struct route_table_node *node = find_route_table_node(table, "/health", NULL);
+    CU_ASSERT_FATAL(node != NULL && node->routes[HTTP_GET] != NULL);
+    CU_ASSERT_STRING_EQUAL(node->routes[HTTP_GET]->canned->data, expected);
+    CU_ASSERT(atomic_load(&node->routes[HTTP_GET]->canned->references) == 1);
+
+    free_route_table(table);
+    free_route_nodes(routes.tree);
+    free(routes.items);
+}
+
+/**
+ * @brief Route handler for `test_route_handler`, filling the response given by the server
+ */
+static int fill_pid_response(const struct http_request *request, struct http_response *response) {
+    (void)request;
+    response->status_code = HTTP_CREATED;
+    response->body = "{\"pid\":10}";
+    response->body_type = HTTP_BODY_BORROWED;
+    return insert_header(&response->headers, "Content-Type", "application/json") ? 0 : -1;
+}
+
+/**
+ * @brief Test for `insert_route_handler` and `reset_http_response`. Response is filled, reset, and reused with its header array.
+ * @warning **[Dependency of tests]**   
+ * `init_routes`, `build_http_response`   
+ */
+void test_route_handler() {
+    struct routes routes;
+    CU_ASSERT_FATAL(init_routes(&routes) != NULL);
+    CU_ASSERT_FATAL(insert_route_handler(&routes, "/program", HTTP_POST, fill_pid_response) != NULL);
+
+    struct route *route = find_route(&routes, "/program", HTTP_POST);
+    CU_ASSERT_FATAL(route != NULL);
+    CU_ASSERT(route->callback == NULL);
+    CU_ASSERT_FATAL(route->handler == fill_pid_response);
+
+    struct http_response response = {};
+    reset_http_response(&response);
+    CU_ASSERT(response.status_code == HTTP_OK);
+    CU_ASSERT(response.http_version == HTTP_1_1);
+
+    CU_ASSERT(route->handler(NULL, &response) == 0);
+    struct http_output_buffer buffer = {};
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer.data,
+        "HTTP/1.1 201 Created\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 10\r\n"
+        "\r\n"
+        "{\"pid\":10}");
+
+    /* borrowed body is not freed, and header array is kept */
+    struct http_header **items = response.headers.items;
+    reset_http_response(&response);
+    CU_ASSERT(response.status_code == HTTP_OK);
+    CU_ASSERT(response.body == NULL);
+    CU_ASSERT(response.headers.size == 0);
+    CU_ASSERT(response.headers.items == items && response.headers.capacity > 0);
+
+    destruct_http_headers(&response.headers);
+    CU_ASSERT(response.headers.items == NULL);
+    destruct_http_output_buffer(&buffer);
+    free_route_nodes(routes.tree);
+    free(routes.items[0]->path);
+    free(routes.items[0]);
+    free(routes.items);
+}
+
 /**
  * @brief parse_http_request() test code. Input need to be parsed successfully.
  * Input is GET method and has no body.
@@ -112,20 +463,20 @@ void test_parse_http_request_1() {
     
     CU_ASSERT_STRING_EQUAL(request.path, "/search");
     
-    CU_ASSERT_STRING_EQUAL(request.headers.items[0]->key,     "Host");
-    CU_ASSERT_STRING_EQUAL(request.headers.items[0]->value,   "www.example.com");
+    CU_ASSERT_STRING_EQUAL(get_http_request_headers(&request)->items[0]->key,     "Host");
+    CU_ASSERT_STRING_EQUAL(get_http_request_headers(&request)->items[0]->value,   "www.example.com");
 
-    CU_ASSERT_STRING_EQUAL(request.headers.items[1]->key,     "User-Agent");
-    CU_ASSERT_STRING_EQUAL(request.headers.items[1]->value,   "TestClient/1.0");
+    CU_ASSERT_STRING_EQUAL(get_http_request_headers(&request)->items[1]->key,     "User-Agent");
+    CU_ASSERT_STRING_EQUAL(get_http_request_headers(&request)->items[1]->value,   "TestClient/1.0");
 
-    CU_ASSERT_STRING_EQUAL(request.headers.items[2]->key,     "Accept");
-    CU_ASSERT_STRING_EQUAL(request.headers.items[2]->value,   "text/html");
+    CU_ASSERT_STRING_EQUAL(get_http_request_headers(&request)->items[2]->key,     "Accept");
+    CU_ASSERT_STRING_EQUAL(get_http_request_headers(&request)->items[2]->value,   "text/html");
 
-    CU_ASSERT_STRING_EQUAL(request.query_parameters.items[0]->key,     "q");
-    CU_ASSERT_STRING_EQUAL(request.query_parameters.items[0]->value,   "example");
+    CU_ASSERT_STRING_EQUAL(get_http_request_query_parameters(&request)->items[0]->key,     "q");
+    CU_ASSERT_STRING_EQUAL(get_http_request_query_parameters(&request)->items[0]->value,   "example");
 
-    CU_ASSERT_STRING_EQUAL(request.query_parameters.items[1]->key,     "lang");
-    CU_ASSERT_STRING_EQUAL(request.query_parameters.items[1]->value,   "en");
+    CU_ASSERT_STRING_EQUAL(get_http_request_query_parameters(&request)->items[1]->key,     "lang");
+    CU_ASSERT_STRING_EQUAL(get_http_request_query_parameters(&request)->items[1]->value,   "en");
 
     char *http_request_no_headers = "GET /search HTTP/1.1\r\n\r\n";
     parse_http_request(http_request_no_headers);
@@ -134,6 +485,27 @@ void test_parse_http_request_1() {
     parse_http_request(http_request_ilformed);
 }
 
+/**
+ * @brief Test for `parse_http_request_bytes`. Body containing NUL is kept with its length.
+ */
+void test_parse_http_request_bytes() {
+    const char http_request[] =
+        "POST /upload HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "a\0b\0c";
+
+    struct http_request *request = parse_http_request_bytes(http_request, sizeof(http_request) - 1);
+    CU_ASSERT_FATAL(request != NULL);
+    CU_ASSERT(get_http_request_body_length(request) == 5);
+    CU_ASSERT(memcmp(get_http_request_body(request), "a\0b\0c", 5) == 0);
+    destruct_http_request(request);
+    free(request);
+
+    /* length shorter than headers is rejected */
+    CU_ASSERT(parse_http_request_bytes(http_request, 10) == NULL);
+}
+
 /**
  * @brief Test for `init_routes`. Test that members of routes are correctly set and allocated.
  */
@@ -234,6 +606,280 @@ void test_find_route() {
     CU_ASSERT(find_route(&routes, "/path/to/api1/", HTTP_POST) == 0);
 }
 
+/**
+ * @brief Test for radix tree of `struct routes`. Routes sharing prefixes split nodes of the tree,
+ * and each node keeps a route per method.
+ * @warning **[Dependency of tests]**   
+ * `init_routes`   
+ * `insert_route`   
+ */
+void test_find_route_tree() {
+    struct routes routes;
+
+    init_routes(&routes);
+    CU_ASSERT(find_route(&routes, "/", HTTP_GET) == NULL);
+
+    CU_ASSERT(insert_route(&routes, "/program", HTTP_GET, empty_callback) != NULL);
+    CU_ASSERT(insert_route(&routes, "/program", HTTP_POST, empty_callback) != NULL);
+    CU_ASSERT(insert_route(&routes, "/program/", HTTP_POST, empty_callback) == NULL);
+    CU_ASSERT(insert_route(&routes, "/programs", HTTP_GET, empty_callback) != NULL);
+    CU_ASSERT(insert_route(&routes, "/pro", HTTP_GET, empty_callback) != NULL);
+    CU_ASSERT(insert_route(&routes, "/", HTTP_GET, empty_callback) != NULL);
+    CU_ASSERT(insert_route(&routes, "/input", HTTP_POST, empty_callback) != NULL);
+    CU_ASSERT(routes.size == 6);
+
+    CU_ASSERT(find_route(&routes, "/", HTTP_GET) == routes.items[4]);
+    CU_ASSERT(find_route(&routes, "/program", HTTP_GET) == routes.items[0]);
+    CU_ASSERT(find_route(&routes, "/program/", HTTP_POST) == routes.items[1]);
+    CU_ASSERT(find_route(&routes, "/programs", HTTP_GET) == routes.items[2]);
+    CU_ASSERT(find_route(&routes, "/pro/", HTTP_GET) == routes.items[3]);
+    CU_ASSERT(find_route(&routes, "/input", HTTP_POST) == routes.items[5]);
+
+    /* intermediate nodes and partial matches are not routes */
+    CU_ASSERT(find_route(&routes, "/p", HTTP_GET) == NULL);
+    CU_ASSERT(find_route(&routes, "/prog", HTTP_GET) == NULL);
+    CU_ASSERT(find_route(&routes, "/programss", HTTP_GET) == NULL);
+    CU_ASSERT(find_route(&routes, "/program//", HTTP_GET) == NULL);
+    CU_ASSERT(find_route(&routes, "/input", HTTP_GET) == NULL);
+    CU_ASSERT(find_route(&routes, "/input", HTTP_METHOD_UNKNOWN) == NULL);
+
+    for (int i = 0; i < 300; i++) {
+        char path[64];
+        sprintf(path, "/problem/%d/submit", i);
+        CU_ASSERT(insert_route(&routes, path, HTTP_POST, empty_callback) != NULL);
+    }
+    for (int i = 0; i < 300; i++) {
+        char path[64];
+        sprintf(path, "/problem/%d/submit/", i);
+        CU_ASSERT(find_route(&routes, path, HTTP_POST) == routes.items[6 + i]);
+    }
+}
+
+/**
+ * @brief Test for `match_route`. `:name` and `*` segments capture slices of the request path.
+ * @warning **[Dependency of tests]**   
+ * `init_routes`   
+ * `insert_route`   
+ * `parse_http_request`   
+ */
+void test_match_route_parameters() {
+    struct routes routes;
+    struct http_request *request;
+    const char *value;
+    size_t length;
+
+    init_routes(&routes);
+    CU_ASSERT(insert_route(&routes, "/program/:pid", HTTP_GET, empty_callback) != NULL);
+    CU_ASSERT(insert_route(&routes, "/program/:pid/stdin", HTTP_POST, empty_callback) != NULL);
+    CU_ASSERT(insert_route(&routes, "/program/list", HTTP_GET, empty_callback) != NULL);
+    CU_ASSERT(insert_route(&routes, "/static/*", HTTP_GET, empty_callback) != NULL);
+    /* invalid or conflicting parameter segments */
+    CU_ASSERT(insert_route(&routes, "/program/:id", HTTP_DELETE, empty_callback) == NULL);
+    CU_ASSERT(insert_route(&routes, "/files/*path/raw", HTTP_GET, empty_callback) == NULL);
+    CU_ASSERT(insert_route(&routes, "/a/:/b", HTTP_GET, empty_callback) == NULL);
+    CU_ASSERT(routes.size == 4);
+
+    request = parse_http_request("GET /program/42 HTTP/1.1\r\n\r\n");
+    CU_ASSERT(match_route(&routes, request, request->method) == routes.items[0]);
+    value = find_http_request_path_parameter(request, "pid", &length);
+    CU_ASSERT(value != NULL && length == 2 && strncmp(value, "42", length) == 0);
+    destruct_http_request(request);
+    free(request);
+
+    request = parse_http_request("POST /program/42/stdin HTTP/1.1\r\n\r\n");
+    CU_ASSERT(match_route(&routes, request, request->method) == routes.items[1]);
+    value = find_http_request_path_parameter(request, "pid", &length);
+    CU_ASSERT(value != NULL && length == 2 && strncmp(value, "42", length) == 0);
+    destruct_http_request(request);
+    free(request);
+
+    /* static segment precedes, and parameter is tried when static one leads nowhere */
+    request = parse_http_request("GET /program/list/ HTTP/1.1\r\n\r\n");
+    CU_ASSERT(match_route(&routes, request, request->method) == routes.items[2]);
+    CU_ASSERT(find_http_request_path_parameter(request, "pid", NULL) == NULL);
+    destruct_http_request(request);
+    free(request);
+
+    request = parse_http_request("POST /program/list/stdin HTTP/1.1\r\n\r\n");
+    CU_ASSERT(match_route(&routes, request, request->method) == routes.items[1]);
+    value = find_http_request_path_parameter(request, "pid", &length);
+    CU_ASSERT(value != NULL && length == 4 && strncmp(value, "list", length) == 0);
+    destruct_http_request(request);
+    free(request);
+
+    request = parse_http_request("GET /static/css/site.css?v=1 HTTP/1.1\r\n\r\n");
+    CU_ASSERT(match_route(&routes, request, request->method) == routes.items[3]);
+    value = find_http_request_path_parameter(request, "*", &length);
+    CU_ASSERT(value != NULL && length == 12 && strncmp(value, "css/site.css", length) == 0);
+    destruct_http_request(request);
+    free(request);
+
+    /* parameter does not match an empty segment */
+    request = parse_http_request("GET /program/ HTTP/1.1\r\n\r\n");
+    CU_ASSERT(match_route(&routes, request, request->method) == NULL);
+    CU_ASSERT(match_route(&routes, request, HTTP_POST) == NULL);
+    destruct_http_request(request);
+    free(request);
+}
+
+/**
+ * @brief Test for `compile_route_table` and `remove_route`. Compiled table matches same as `struct routes`,
+ * and does not refer to `struct routes` after compiled.
+ * @warning **[Dependency of tests]**   
+ * `init_routes`   
+ * `insert_route`   
+ * `parse_http_request`   
+ */
+void test_compile_route_table() {
+    struct routes routes;
+    struct route_table *table;
+    struct http_request *request;
+    const char *value;
+    size_t length;
+
+    init_routes(&routes);
+    table = compile_route_table(&routes);
+    CU_ASSERT(table != NULL && table->node_count == 0);
+    CU_ASSERT(find_route_table_node(table, "/", NULL) == NULL);
+    free_route_table(table);
+
+    insert_route(&routes, "/", HTTP_GET, empty_callback);
+    insert_route(&routes, "/program", HTTP_GET, empty_callback);
+    insert_route(&routes, "/program/:pid", HTTP_GET, empty_callback);
+    insert_route(&routes, "/program/:pid", HTTP_DELETE, empty_callback);
+    insert_route(&routes, "/programs", HTTP_POST, empty_callback);
+    insert_route(&routes, "/static/*file", HTTP_GET, empty_callback);
+    CU_ASSERT(routes.size == 6);
+
+    table = compile_route_table(&routes);
+    CU_ASSERT(table != NULL);
+    CU_ASSERT(table->route_count == 6);
+
+    /* routes are copied, so table keeps working after they are removed */
+    CU_ASSERT(remove_route(&routes, "/program/:pid", HTTP_GET) == &routes);
+    CU_ASSERT(remove_route(&routes, "/program/:pid", HTTP_GET) == NULL);
+    CU_ASSERT(remove_route(&routes, "/static/*file/", HTTP_GET) == &routes);
+    CU_ASSERT(routes.size == 4);
+    CU_ASSERT(find_route(&routes, "/static/a.txt", HTTP_GET) == NULL);
+    CU_ASSERT(find_route(&routes, "/program/1", HTTP_GET) == NULL);
+    CU_ASSERT(find_route(&routes, "/program/1", HTTP_DELETE) != NULL);
+
+    request = parse_http_request("GET /program/7/ HTTP/1.1\r\n\r\n");
+    struct route *route = match_route_table(table, request, HTTP_GET);
+    CU_ASSERT(route != NULL && strcmp(route->path, "/program/:pid") == 0 && route->method == HTTP_GET);
+    value = find_http_request_path_parameter(request, "pid", &length);
+    CU_ASSERT(value != NULL && length == 1 && value[0] == '7');
+    CU_ASSERT(match_route_table(table, request, HTTP_POST) == NULL);
+    CU_ASSERT(find_http_request_path_parameter(request, "pid", NULL) == NULL);
+    destruct_http_request(request);
+    free(request);
+
+    request = parse_http_request("GET /static/js/app.js HTTP/1.1\r\n\r\n");
+    CU_ASSERT(match_route_table(table, request, HTTP_GET) != NULL);
+    value = find_http_request_path_parameter(request, "file", &length);
+    CU_ASSERT(value != NULL && length == 9 && strncmp(value, "js/app.js", length) == 0);
+    destruct_http_request(request);
+    free(request);
+
+    CU_ASSERT_STRING_EQUAL(find_route_table_node(table, "/", NULL)->allow, "GET, HEAD, OPTIONS");
+    CU_ASSERT_STRING_EQUAL(find_route_table_node(table, "/programs/", NULL)->allow, "POST, OPTIONS");
+    CU_ASSERT_STRING_EQUAL(find_route_table_node(table, "/program/3", NULL)->allow, "GET, HEAD, DELETE, OPTIONS");
+    CU_ASSERT(find_route_table_node(table, "/prog", NULL) == NULL);
+    free_route_table(table);
+
+    table = compile_route_table(&routes);
+    CU_ASSERT(table != NULL && table->route_count == 4);
+    CU_ASSERT(find_route_table_node(table, "/static/a.txt", NULL) == NULL);
+    free_route_table(table);
+}
+
+/**
+ * @brief Test for `decode_http_chunked`. Body is fed byte by byte and decoded in place.
+ */
+void test_decode_http_chunked() {
+    char body[] = "4\r\nWiki\r\n5;name=value\r\npedia\r\n0\r\nExpires: never\r\n\r\nGET";
+    struct http_chunked_decoder decoder;
+    size_t body_end = 0;
+    size_t pending = 0;
+    size_t consumed;
+
+    init_http_chunked_decoder(&decoder);
+    while (decoder.state != HTTP_CHUNKED_DONE && pending < strlen(body)) {
+        ssize_t decoded = decode_http_chunked(&decoder, body + body_end, body + pending, 1, &consumed);
+        CU_ASSERT(decoded >= 0);
+        body_end += decoded;
+        pending += consumed;
+    }
+    CU_ASSERT(decoder.state == HTTP_CHUNKED_DONE);
+    CU_ASSERT(body_end == 9);
+    CU_ASSERT(decoder.decoded_length == 9);
+    CU_ASSERT(strncmp(body, "Wikipedia", 9) == 0);
+    /* bytes of next message are not consumed */
+    CU_ASSERT_STRING_EQUAL(body + pending, "GET");
+
+    char malformed[] = "4\r\nWikiX\r\n0\r\n\r\n";
+    init_http_chunked_decoder(&decoder);
+    CU_ASSERT(decode_http_chunked(&decoder, malformed, malformed, strlen(malformed), &consumed) == -1);
+}
+
+/**
+ * @brief Test for `scan_http_header`.
+ */
+void test_scan_http_header() {
+    char *headers =
+        "Host: www.example.com\r\n"
+        "content-length:   12  \r\n"
+        "\r\n"
+        "Transfer-Encoding: chunked\r\n";
+    size_t value_length;
+
+    const char *value = scan_http_header(headers, strlen(headers), "Content-Length", &value_length);
+    CU_ASSERT(value != NULL && value_length == 2 && strncmp(value, "12", 2) == 0);
+    /* headers after the empty line are not scanned */
+    CU_ASSERT(scan_http_header(headers, strlen(headers), "Transfer-Encoding", &value_length) == NULL);
+}
+
+/**
+ * @brief Test for `parse_http_request_line`, `parse_http_method` and `parse_http_version`.
+ */
+void test_parse_http_request_line() {
+    struct http_request_line request_line;
+    char *line = "PATCH /api/items?id=3 HTTP/1.1\r\n";
+
+    CU_ASSERT(parse_http_request_line(line, strlen(line), &request_line) == 0);
+    CU_ASSERT(request_line.method == HTTP_PATCH);
+    CU_ASSERT(request_line.version == HTTP_1_1);
+    CU_ASSERT(request_line.target_length == 15);
+    CU_ASSERT(request_line.path_length == 10);
+    CU_ASSERT(strncmp(request_line.target, "/api/items", 10) == 0);
+    CU_ASSERT(request_line.length == strlen(line));
+
+    line = "BREW /pot HTTP/1.0\r\n";
+    CU_ASSERT(parse_http_request_line(line, strlen(line), &request_line) == 0);
+    CU_ASSERT(request_line.method == HTTP_METHOD_UNKNOWN);
+    CU_ASSERT(request_line.version == HTTP_1_0);
+
+    /* invalid characters in token, target, or version */
+    line = "GE(T / HTTP/1.1\r\n";
+    CU_ASSERT(parse_http_request_line(line, strlen(line), &request_line) == -1);
+    line = "GET /a b HTTP/1.1\r\n";
+    CU_ASSERT(parse_http_request_line(line, strlen(line), &request_line) == -1);
+    line = "GET /<> HTTP/1.1\r\n";
+    CU_ASSERT(parse_http_request_line(line, strlen(line), &request_line) == -1);
+    line = "GET / HTTP/1.9\r\n";
+    CU_ASSERT(parse_http_request_line(line, strlen(line), &request_line) == -1);
+
+    for (enum http_method method = HTTP_GET; method < HTTP_METHOD_UNKNOWN; method++) {
+        CU_ASSERT(parse_http_method(http_method_stringify(method)) == method);
+    }
+    CU_ASSERT(parse_http_method("GETS") == HTTP_METHOD_UNKNOWN);
+    CU_ASSERT(parse_http_method("GE") == HTTP_METHOD_UNKNOWN);
+    CU_ASSERT(parse_http_method("OPTIONSX") == HTTP_METHOD_UNKNOWN);
+    CU_ASSERT(parse_http_version("HTTP/1.1") == HTTP_1_1);
+    CU_ASSERT(parse_http_version("HTTP/3.0") == HTTP_3_0);
+    CU_ASSERT(parse_http_version("HTTP/1.1 ") == HTTP_VERSION_UNKNOWN);
+}
+
 // 테스트용 콜백 함수
 struct http_response test_callback(struct http_request request) {
     struct http_headers headers = {};
@@ -246,6 +892,725 @@ struct http_response test_callback(struct http_request request) {
 }
 
 
+/**
+ * @brief Test for validators of conditional GET: HTTP-date, ETag comparison and `is_http_not_modified`.
+ */
+void test_conditional_request() {
+    char date[HTTP_DATE_LENGTH + 1];
+    char etag[HTTP_ETAG_MAX_LENGTH];
+    time_t parsed;
+
+    format_http_date(784111777, date);
+    CU_ASSERT_STRING_EQUAL(date, "Sun, 06 Nov 1994 08:49:37 GMT");
+    CU_ASSERT(parse_http_date(date, &parsed) == 0 && parsed == 784111777);
+    /* obsolete formats and garbage are invalid dates */
+    CU_ASSERT(parse_http_date("Sunday, 06-Nov-94 08:49:37 GMT", &parsed) == -1);
+    CU_ASSERT(parse_http_date("Sun Nov  6 08:49:37 1994", &parsed) == -1);
+    CU_ASSERT(parse_http_date("Sun, 06 Foo 1994 08:49:37 GMT", &parsed) == -1);
+
+    struct stat file_stat = {.st_ino = 0x1234, .st_size = 10};
+    file_stat.st_mtime = 1;
+    format_http_etag(&file_stat, etag);
+    CU_ASSERT_STRING_EQUAL(etag, "\"1234-a-3b9aca00\"");
+
+    CU_ASSERT(match_http_etag("\"1234-a-3b9aca00\"", etag));
+    CU_ASSERT(match_http_etag("\"x\", W/\"1234-a-3b9aca00\" ", etag));
+    CU_ASSERT(match_http_etag("*", etag));
+    /* as parsed from `If-None-Match: "x", "1234-a-3b9aca00"` */
+    CU_ASSERT(match_http_etag("x\", \"1234-a-3b9aca00", etag));
+    CU_ASSERT(!match_http_etag("\"x\", \"1234-a-3b9aca\"", etag));
+
+    struct http_request *request = parse_http_request(
+        "GET /index.html HTTP/1.1\r\n"
+        "If-None-Match: \"other\"\r\n"
+        "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+        "\r\n");
+    CU_ASSERT_FATAL(request != NULL);
+    /* If-Modified-Since is ignored when If-None-Match is present */
+    CU_ASSERT(!is_http_not_modified(request, etag, 784111777));
+    CU_ASSERT(is_http_not_modified(request, "\"other\"", 784111777 + 60));
+    destruct_http_request(request);
+    free(request);
+
+    request = parse_http_request(
+        "GET /index.html HTTP/1.1\r\n"
+        "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+        "\r\n");
+    CU_ASSERT_FATAL(request != NULL);
+    CU_ASSERT(is_http_not_modified(request, etag, 784111777));
+    CU_ASSERT(!is_http_not_modified(request, etag, 784111777 + 1));
+    destruct_http_request(request);
+    free(request);
+
+    request = parse_http_request("POST /index.html HTTP/1.1\r\nIf-None-Match: *\r\n\r\n");
+    CU_ASSERT_FATAL(request != NULL);
+    CU_ASSERT(!is_http_not_modified(request, etag, 0));
+    destruct_http_request(request);
+    free(request);
+}
+
+/**
+ * @brief Test for MIME type table. Every extension of the table is found at its own slot, so no entry is shadowed by a collision.
+ */
+void test_http_mime_type() {
+    const char *extensions[] = {
+        "bz2", "js", "ogg", "c", "yaml", "xz", "zst", "bmp", "map", "webm", "png", "woff2", "cpp", "ttf", "webp",
+        "wasm", "json", "mjs", "html", "avif", "gz", "ico", "mp3", "css", "wav", "h", "7z", "csv", "zip", "txt", "svg",
+        "md", "woff", "jpg", "tar", "jpeg", "tgz", "htm", "sh", "pdf", "otf", "hpp", "mp4", "gif", "xml", "py", "yml"
+    };
+    const int count = sizeof(extensions) / sizeof(extensions[0]);
+    int filled = 0;
+    char path[32];
+
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "/static/file.%s", extensions[i]);
+        CU_ASSERT(find_http_mime_type(path) >= 0);
+    }
+    for (int slot = 0; slot < HTTP_MIME_TABLE_SIZE; slot++)
+        filled += get_http_mime_type(slot) != NULL;
+    CU_ASSERT(filled == count);
+
+    CU_ASSERT_STRING_EQUAL(get_http_mime_type(find_http_mime_type("/app.js")), "text/javascript; charset=utf-8");
+    CU_ASSERT_STRING_EQUAL(get_http_mime_type(find_http_mime_type("/module.WASM")), "application/wasm");
+    CU_ASSERT_STRING_EQUAL(get_http_mime_type(find_http_mime_type("favicon.ico")), "image/x-icon");
+    CU_ASSERT_STRING_EQUAL(get_http_mime_type(find_http_mime_type("/toolchain.tar.gz")), "application/gzip");
+
+    /* no extension, a dot of directory, unknown and too long extensions */
+    CU_ASSERT(find_http_mime_type("/Makefile") == -1);
+    CU_ASSERT(find_http_mime_type("/v1.2/README") == -1);
+    CU_ASSERT(find_http_mime_type("/file.") == -1);
+    CU_ASSERT(find_http_mime_type("/file.exe") == -1);
+    CU_ASSERT(find_http_mime_type("/file.javascript") == -1);
+    CU_ASSERT(get_http_mime_type(-1) == NULL);
+    CU_ASSERT(get_http_mime_type(HTTP_MIME_TABLE_SIZE) == NULL);
+}
+
+/**
+ * @brief Test for `parse_http_range`, `match_http_if_range` and delimiters of `multipart/byteranges`.
+ */
+void test_http_range() {
+    struct http_byte_range ranges[4];
+
+    CU_ASSERT(parse_http_range("bytes=0-499", 10000, ranges, 4) == 1);
+    CU_ASSERT(ranges[0].first == 0 && ranges[0].last == 499);
+    /* open range, suffix range and last position beyond the end */
+    CU_ASSERT(parse_http_range("bytes=9500-, -500,9000-20000", 10000, ranges, 4) == 3);
+    CU_ASSERT(ranges[0].first == 9500 && ranges[0].last == 9999);
+    CU_ASSERT(ranges[1].first == 9500 && ranges[1].last == 9999);
+    CU_ASSERT(ranges[2].first == 9000 && ranges[2].last == 9999);
+    CU_ASSERT(parse_http_range("bytes=-20000", 10000, ranges, 4) == 1 && ranges[0].first == 0);
+
+    /* unsatisfiable ranges are dropped */
+    CU_ASSERT(parse_http_range("bytes=10000-, 0-0", 10000, ranges, 4) == 1 && ranges[0].last == 0);
+    CU_ASSERT(parse_http_range("bytes=10000-10001, -0", 10000, ranges, 4) == 0);
+    CU_ASSERT(parse_http_range("bytes=0-", 0, ranges, 4) == 0);
+
+    /* malformed, other unit and too many ranges are ignored */
+    CU_ASSERT(parse_http_range("bytes=5-1", 10000, ranges, 4) == -1);
+    CU_ASSERT(parse_http_range("bytes=a-1", 10000, ranges, 4) == -1);
+    CU_ASSERT(parse_http_range("bytes=", 10000, ranges, 4) == -1);
+    CU_ASSERT(parse_http_range("items=0-1", 10000, ranges, 4) == -1);
+    CU_ASSERT(parse_http_range("bytes=99999999999999999999-", 10000, ranges, 4) == -1);
+    CU_ASSERT(parse_http_range("bytes=0-1,2-3,4-5,6-7,8-9", 10000, ranges, 4) == -1);
+
+    struct http_request *request = parse_http_request(
+        "GET /archive.tar.gz HTTP/1.1\r\n"
+        "Range: bytes=0-9\r\n"
+        "If-Range: \"1-2-3\"\r\n"
+        "\r\n");
+    CU_ASSERT_FATAL(request != NULL);
+    CU_ASSERT(match_http_if_range(request, "\"1-2-3\"", 0));
+    CU_ASSERT(!match_http_if_range(request, "\"1-2-4\"", 0));
+    destruct_http_request(request);
+    free(request);
+
+    request = parse_http_request(
+        "GET /archive.tar.gz HTTP/1.1\r\n"
+        "If-Range: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+        "\r\n");
+    CU_ASSERT_FATAL(request != NULL);
+    CU_ASSERT(match_http_if_range(request, "\"1-2-3\"", 784111777));
+    CU_ASSERT(!match_http_if_range(request, "\"1-2-3\"", 784111778));
+    destruct_http_request(request);
+    free(request);
+
+    struct http_byte_ranges *parts = malloc(sizeof(struct http_byte_ranges) + 2 * sizeof(struct http_byte_range));
+    CU_ASSERT_FATAL(parts != NULL);
+    *parts = (struct http_byte_ranges) {.size = 100, .boundary = "B", .count = 2};
+    parts->items[0] = (struct http_byte_range) {0, 9};
+    parts->items[1] = (struct http_byte_range) {90, 99};
+
+    char delimiter[HTTP_RANGE_DELIMITER_MAX_LENGTH];
+    CU_ASSERT(format_http_range_delimiter(delimiter, parts, 1) == strlen("\r\n--B\r\nContent-Range: bytes 90-99/100\r\n\r\n"));
+    CU_ASSERT_STRING_EQUAL(delimiter, "\r\n--B\r\nContent-Range: bytes 90-99/100\r\n\r\n");
+    CU_ASSERT(format_http_range_delimiter(delimiter, parts, 2) == 9);
+    CU_ASSERT_STRING_EQUAL(delimiter, "\r\n--B--\r\n");
+
+    /* Content-Length counts delimiters and ranges, and ranges are freed with the response */
+    struct http_response response = {};
+    reset_http_response(&response);
+    response.status_code = HTTP_PARTIAL_CONTENT;
+    response.body_type = HTTP_BODY_FILE;
+    response.ranges = parts;
+    struct http_output_buffer buffer = {};
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT(strstr(buffer.data, "Content-Length: 109\r\n") != NULL);
+    reset_http_response(&response);
+    CU_ASSERT(response.ranges == NULL);
+    destruct_http_headers(&response.headers);
+    destruct_http_output_buffer(&buffer);
+}
+
+/**
+ * @brief Test for the opening handshake: SHA-1, base64, `Sec-WebSocket-Accept` of RFC 6455 and `accept_websocket`.
+ */
+void test_websocket_handshake() {
+    uint8_t digest[20];
+    char encoded[32];
+    char accept[WEBSOCKET_ACCEPT_LENGTH + 1];
+
+    compute_sha1("abc", 3, digest);
+    CU_ASSERT(memcmp(digest, "\xa9\x99\x3e\x36\x47\x06\x81\x6a\xba\x3e\x25\x71\x78\x50\xc2\x6c\x9c\xd0\xd8\x9d", 20) == 0);
+    /* padding spills into the second block */
+    compute_sha1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, digest);
+    CU_ASSERT(memcmp(digest, "\x84\x98\x3e\x44\x1c\x3b\xd2\x6e\xba\xae\x4a\xa1\xf9\x51\x29\xe5\xe5\x46\x70\xf1", 20) == 0);
+
+    CU_ASSERT(encode_base64("", 0, encoded) == 0 && strcmp(encoded, "") == 0);
+    CU_ASSERT(encode_base64("f", 1, encoded) == 4 && strcmp(encoded, "Zg==") == 0);
+    CU_ASSERT(encode_base64("fo", 2, encoded) == 4 && strcmp(encoded, "Zm8=") == 0);
+    CU_ASSERT(encode_base64("foobar", 6, encoded) == 8 && strcmp(encoded, "Zm9vYmFy") == 0);
+
+    CU_ASSERT(compute_websocket_accept("dGhlIHNhbXBsZSBub25jZQ==", 24, accept) == 0);
+    CU_ASSERT_STRING_EQUAL(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+
+    struct http_request *request = parse_http_request(
+        "GET /chat HTTP/1.1\r\n"
+        "Host: server.example.com\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: keep-alive, Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "\r\n");
+    CU_ASSERT_FATAL(request != NULL);
+
+    struct http_response response = {};
+    reset_http_response(&response);
+    CU_ASSERT(accept_websocket(request, &response, NULL, request) == 0);
+    CU_ASSERT(response.status_code == HTTP_SWITCHING_PROTOCOLS);
+    CU_ASSERT(response.websocket_data == request);
+
+    struct http_output_buffer buffer = {};
+    CU_ASSERT(build_http_response(&buffer, &response) > 0);
+    CU_ASSERT(strstr(buffer.data, "HTTP/1.1 101 Switching Protocols\r\n") == buffer.data);
+    CU_ASSERT(strstr(buffer.data, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != NULL);
+    CU_ASSERT(strstr(buffer.data, "Content-Length") == NULL);
+    destruct_http_request(request);
+    free(request);
+
+    /* unsupported version is told which one is supported */
+    request = parse_http_request(
+        "GET /chat HTTP/1.1\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 8\r\n"
+        "\r\n");
+    CU_ASSERT_FATAL(request != NULL);
+    reset_http_response(&response);
+    CU_ASSERT(accept_websocket(request, &response, NULL, NULL) == -1);
+    CU_ASSERT(response.status_code == HTTP_UPGRADE_REQUIRED);
+    CU_ASSERT(response.websocket == NULL);
+    destruct_http_request(request);
+    free(request);
+
+    /* plain request is not upgraded */
+    request = parse_http_request("GET /chat HTTP/1.1\r\nHost: server.example.com\r\n\r\n");
+    CU_ASSERT_FATAL(request != NULL);
+    reset_http_response(&response);
+    CU_ASSERT(accept_websocket(request, &response, NULL, NULL) == -1);
+    CU_ASSERT(response.status_code == HTTP_BAD_REQUEST);
+    destruct_http_request(request);
+    free(request);
+
+    reset_http_response(&response);
+    destruct_http_headers(&response.headers);
+    destruct_http_output_buffer(&buffer);
+}
+
+/**
+ * @brief Test for frame codec, and messages exchanged over a socket pair: fragments, ping between them, and close.
+ */
+void test_websocket_frame() {
+    /* masked "Hello" of RFC 6455 */
+    uint8_t hello[] = {0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58};
+    struct websocket_frame_header header;
+    uint8_t data[WEBSOCKET_MAX_FRAME_HEADER_LENGTH];
+
+    CU_ASSERT(parse_websocket_frame_header(hello, 1, &header) == 0 && header.header_length == 2);
+    CU_ASSERT(parse_websocket_frame_header(hello, 4, &header) == 0 && header.header_length == 6);
+    CU_ASSERT_FATAL(parse_websocket_frame_header(hello, sizeof(hello), &header) == 6);
+    CU_ASSERT(header.fin && header.opcode == WEBSOCKET_TEXT && header.masked && header.payload_length == 5);
+    mask_websocket_payload(hello + 6, 5, header.mask, 0);
+    CU_ASSERT(memcmp(hello + 6, "Hello", 5) == 0);
+
+    /* reserved bits, reserved opcode and fragmented control frame */
+    CU_ASSERT(parse_websocket_frame_header((uint8_t[]) {0xc1, 0x00}, 2, &header) == -1);
+    CU_ASSERT(parse_websocket_frame_header((uint8_t[]) {0x83, 0x00}, 2, &header) == -1);
+    CU_ASSERT(parse_websocket_frame_header((uint8_t[]) {0x09, 0x00}, 2, &header) == -1);
+    CU_ASSERT(parse_websocket_frame_header((uint8_t[]) {0x89, 0x7e, 0x00, 0x7e}, 4, &header) == -1);
+
+    CU_ASSERT(build_websocket_frame_header(data, WEBSOCKET_BINARY, true, 125) == 2);
+    CU_ASSERT(build_websocket_frame_header(data, WEBSOCKET_BINARY, true, 65535) == 4);
+    CU_ASSERT(parse_websocket_frame_header(data, 4, &header) == 4 && header.payload_length == 65535 && !header.masked);
+    CU_ASSERT(build_websocket_frame_header(data, WEBSOCKET_TEXT, false, 65536) == 10);
+    CU_ASSERT(parse_websocket_frame_header(data, 10, &header) == 10 && header.payload_length == 65536 && !header.fin);
+
+    int sockets[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    struct websocket socket = {.socket = sockets[0]};
+    enum websocket_opcode opcode;
+    char message[16];
+
+    /* "Hel" + ping + "lo", every frame masked with zero key */
+    const uint8_t frames[] = {
+        0x01, 0x83, 0, 0, 0, 0, 'H', 'e', 'l',
+        0x89, 0x81, 0, 0, 0, 0, '!',
+        0x80, 0x82, 0, 0, 0, 0, 'l', 'o'
+    };
+    CU_ASSERT_FATAL(write(sockets[1], frames, sizeof(frames)) == sizeof(frames));
+    CU_ASSERT(receive_websocket_message(&socket, message, sizeof(message), &opcode) == 5);
+    CU_ASSERT(opcode == WEBSOCKET_TEXT && memcmp(message, "Hello", 5) == 0);
+    CU_ASSERT(read(sockets[1], data, sizeof(data)) == 3 && memcmp(data, "\x8a\x01!", 3) == 0);
+
+    CU_ASSERT(send_websocket_message(&socket, WEBSOCKET_BINARY, "out", 3) == 0);
+    CU_ASSERT(read(sockets[1], data, sizeof(data)) == 5 && memcmp(data, "\x82\x03out", 5) == 0);
+
+    /* message larger than the buffer closes with 1009 */
+    const uint8_t too_long[] = {0x82, 0x80 | 17, 0, 0, 0, 0};
+    CU_ASSERT_FATAL(write(sockets[1], too_long, sizeof(too_long)) == sizeof(too_long));
+    CU_ASSERT(receive_websocket_message(&socket, message, sizeof(message), &opcode) == -1);
+    CU_ASSERT(read(sockets[1], data, sizeof(data)) == 4 && memcmp(data, "\x88\x02\x03\xf1", 4) == 0);
+    CU_ASSERT(socket.closed && socket.close_sent);
+    CU_ASSERT(send_websocket_message(&socket, WEBSOCKET_TEXT, "late", 4) == -1);
+    close(sockets[0]);
+    close(sockets[1]);
+
+    /* close from the peer is answered */
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    socket = (struct websocket) {.socket = sockets[0]};
+    const uint8_t close_frame[] = {0x88, 0x82, 0, 0, 0, 0, 0x03, 0xe8};
+    CU_ASSERT_FATAL(write(sockets[1], close_frame, sizeof(close_frame)) == sizeof(close_frame));
+    CU_ASSERT(receive_websocket_message(&socket, message, sizeof(message), &opcode) == -1);
+    CU_ASSERT(read(sockets[1], data, sizeof(data)) == 4 && memcmp(data, "\x88\x02\x03\xe8", 4) == 0);
+    CU_ASSERT(close_websocket(&socket, WEBSOCKET_CLOSE_NORMAL) == -1);
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+/**
+ * @brief Writes of `test_http_stream`, and their results
+ */
+struct stream_script {
+    const char *large;
+    int results[5];
+};
+
+/**
+ * @brief Stream function which writes two small pieces, a piece of 4 KB and one more small piece, for `test_http_stream`
+ */
+static void scripted_stream(struct http_response_writer *writer, void *data) {
+    struct stream_script *script = (struct stream_script *)data;
+
+    script->results[0] = write_http_chunk(writer, "ab", 2);
+    script->results[1] = write_http_chunk(writer, "cd", 2);
+    script->results[2] = write_http_chunk(writer, script->large, 4096);
+    script->results[3] = write_http_chunk(writer, "ef", 2);
+    script->results[4] = flush_http_chunks(writer);
+}
+
+/**
+ * @brief Run `scripted_stream` on a socket pair, and read everything written until the writer side is closed.
+ * 
+ * @param close_peer close the reading side before the stream runs, so that writes fail
+ * @return the number of bytes read
+ */
+static size_t run_scripted_stream(struct stream_script *script, enum http_version request_version, bool writable,
+                                  bool close_peer, char *output, size_t size) {
+    int sockets[2];
+    size_t length = 0;
+    ssize_t received;
+    struct http_response response = {.stream = scripted_stream, .stream_data = script};
+
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    if (close_peer)
+        close(sockets[1]);
+
+    run_http_stream(sockets[0], &response, request_version, writable);
+    close(sockets[0]);
+    if (close_peer)
+        return 0;
+
+    while (length < size && (received = read(sockets[1], output + length, size - length)) > 0)
+        length += received;
+    close(sockets[1]);
+    return length;
+}
+
+/**
+ * @brief Test for chunk framing of a streamed body over a socket pair: gathered small writes, a large write passed through,
+ * the last chunk, HTTP/1.0 without framing, HEAD and a client which has gone.
+ */
+void test_http_stream() {
+    static char large[4096];
+    static char output[8192];
+    struct stream_script script = {.large = large};
+    memset(large, 'x', sizeof(large));
+
+    /* small writes are gathered into one chunk, and flushed before a write of 4 KB which is sent as it is */
+    size_t length = run_scripted_stream(&script, HTTP_1_1, true, false, output, sizeof(output));
+    CU_ASSERT(length == 9 + 6 + 4096 + 14);
+    CU_ASSERT(memcmp(output, "4\r\nabcd\r\n", 9) == 0);
+    CU_ASSERT(memcmp(output + 9, "1000\r\n", 6) == 0);
+    CU_ASSERT(memcmp(output + 15, large, 4096) == 0);
+    CU_ASSERT(memcmp(output + 15 + 4096, "\r\n2\r\nef\r\n0\r\n\r\n", 14) == 0);
+    for (int i = 0; i < 5; i++)
+        CU_ASSERT(script.results[i] == 0);
+
+    /* body of HTTP/1.0 is not framed, and ends when the connection is closed */
+    length = run_scripted_stream(&script, HTTP_1_0, true, false, output, sizeof(output));
+    CU_ASSERT(length == 4 + 4096 + 2);
+    CU_ASSERT(memcmp(output, "abcd", 4) == 0);
+    CU_ASSERT(memcmp(output + 4, large, 4096) == 0);
+    CU_ASSERT(memcmp(output + 4 + 4096, "ef", 2) == 0);
+
+    /* HEAD: every write fails, and nothing is written, not even the last chunk */
+    length = run_scripted_stream(&script, HTTP_1_1, false, false, output, sizeof(output));
+    CU_ASSERT(length == 0);
+    for (int i = 0; i < 5; i++)
+        CU_ASSERT(script.results[i] == -1);
+
+    /* client has gone: gathered writes succeed until they are sent, and every later write fails */
+    run_scripted_stream(&script, HTTP_1_1, true, true, output, sizeof(output));
+    CU_ASSERT(script.results[0] == 0 && script.results[1] == 0);
+    CU_ASSERT(script.results[2] == -1 && script.results[3] == -1 && script.results[4] == -1);
+}
+
+void test_json_parse() {
+    struct json_object *object = parse_json(
+        " {\"source_code\": \"int main() {\\n\\treturn 0;\\n}\", \"n\": -1.5e3, \"ok\": true, \"none\": null,"
+        " \"nested\": {\"list\": [1, \"two\", [], {}, [false]], \"empty\": \"\"}, \"esc\": \"\\\\\\\"\\u00e9\\ud83d\\ude00\\ud800\"} ");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(object);
+    CU_ASSERT_EQUAL(object->size, 6);
+
+    struct json_element *element = find_json_element(object, "source_code");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(element);
+    CU_ASSERT_EQUAL(element->value_type, JSON_STRING);
+    CU_ASSERT_STRING_EQUAL(element->value, "int main() {\n\treturn 0;\n}");
+    CU_ASSERT_EQUAL(element->size, 25);
+
+    element = find_json_element(object, "n");
+    CU_ASSERT_EQUAL(element->value_type, JSON_NUMBER);
+    CU_ASSERT_STRING_EQUAL(element->value, "-1.5e3");
+    CU_ASSERT_EQUAL(find_json_element(object, "ok")->value_type, JSON_BOOLEAN);
+    CU_ASSERT_STRING_EQUAL(find_json_element(object, "ok")->value, "true");
+    CU_ASSERT_EQUAL(find_json_element(object, "none")->value_type, JSON_NULL);
+    CU_ASSERT_PTR_NULL(find_json_element(object, "missing"));
+
+    /* children are stored contiguously in order of input */
+    struct json_element *nested = find_json_element(object, "nested");
+    CU_ASSERT_FATAL(nested->value_type == JSON_OBJECT);
+    CU_ASSERT_EQUAL(nested->size, 2);
+    struct json_element *list = find_json_member(nested, "list");
+    CU_ASSERT_FATAL(list == &nested->items[0]);
+    CU_ASSERT_FATAL(list->value_type == JSON_ARRAY);
+    CU_ASSERT_FATAL(list->size == 5);
+    CU_ASSERT_PTR_NULL(list->items[0].key);
+    CU_ASSERT_STRING_EQUAL(list->items[0].value, "1");
+    CU_ASSERT_STRING_EQUAL(list->items[1].value, "two");
+    CU_ASSERT_EQUAL(list->items[2].value_type, JSON_ARRAY);
+    CU_ASSERT_EQUAL(list->items[2].size, 0);
+    CU_ASSERT_EQUAL(list->items[3].value_type, JSON_OBJECT);
+    CU_ASSERT_EQUAL(list->items[4].items[0].value_type, JSON_BOOLEAN);
+    CU_ASSERT_STRING_EQUAL(find_json_member(nested, "empty")->value, "");
+    CU_ASSERT_PTR_NULL(find_json_member(list, "two"));
+
+    /* `\\` does not escape the following quotation mark, and UTF-16 is decoded into UTF-8 */
+    CU_ASSERT_STRING_EQUAL(find_json_element(object, "esc")->value, "\\\"\xc3\xa9\xf0\x9f\x98\x80\xef\xbf\xbd");
+
+    char *serialized = json_object_stringify(object);
+    CU_ASSERT_STRING_EQUAL(serialized,
+        "{\"source_code\":\"int main() {\\n\\treturn 0;\\n}\",\"n\":-1.5e3,\"ok\":true,\"none\":null,"
+        "\"nested\":{\"list\":[1,\"two\",[],{},[false]],\"empty\":\"\"},\"esc\":\"\\\\\\\"\xc3\xa9\xf0\x9f\x98\x80\xef\xbf\xbd\"}");
+    free(serialized);
+    destruct_json_object(object);
+
+    object = parse_json("{}");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(object);
+    CU_ASSERT_EQUAL(object->size, 0);
+    serialized = json_object_stringify(object);
+    CU_ASSERT_STRING_EQUAL(serialized, "{}");
+    free(serialized);
+    destruct_json_object(object);
+
+    /* a large document grows its arena */
+    char *large = malloc(64 * 1024);
+    int length = sprintf(large, "{\"a\":[");
+    for (int i = 0; i < 5000; i++)
+        length += sprintf(large + length, "%s{\"k\":%d}", i ? "," : "", i);
+    strcpy(large + length, "]}");
+    object = parse_json(large);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(object);
+    CU_ASSERT_EQUAL(object->items[0].size, 5000);
+    CU_ASSERT_STRING_EQUAL(find_json_member(&object->items[0].items[4999], "k")->value, "4999");
+    destruct_json_object(object);
+
+    /* nesting deeper than JSON_MAX_DEPTH */
+    length = sprintf(large, "{\"a\":");
+    for (int i = 0; i < JSON_MAX_DEPTH; i++)
+        large[length++] = '[';
+    for (int i = 0; i < JSON_MAX_DEPTH; i++)
+        large[length++] = ']';
+    strcpy(large + length, "}");
+    CU_ASSERT_PTR_NULL(parse_json(large));
+    free(large);
+
+    const char *malformed[] = {
+        "", "[1]", "{", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "{\"a\":1 \"b\":2}", "{a:1}", "{\"a\":01}", "{\"a\":1.}",
+        "{\"a\":-}", "{\"a\":1e}", "{\"a\":tru}", "{\"a\":[1,]}", "{\"a\":\"\\x\"}", "{\"a\":\"\\u12g4\"}",
+        "{\"a\":\"line\nbreak\"}", "{\"a\":\"open}", "{\"a\":1} x", "{\"a\":\"\\\\\"\"}"
+    };
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        CU_ASSERT_PTR_NULL(parse_json(malformed[i]));
+    }
+
+    object = create_json_object();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(object);
+    for (int i = 0; i < 20; i++) {
+        char key[8];
+        sprintf(key, "k%d", i);
+        CU_ASSERT(insert_json_element(object, key, key, JSON_STRING) == object);
+    }
+    CU_ASSERT_PTR_NULL(insert_json_element(object, "k3", "x", JSON_STRING));
+    CU_ASSERT_PTR_NULL(insert_json_element(object, "o", "{}", JSON_OBJECT));
+    CU_ASSERT_EQUAL(object->size, 20);
+    CU_ASSERT_STRING_EQUAL(find_json_element(object, "k19")->value, "k19");
+    destruct_json_object(object);
+}
+
+void test_json_string_token() {
+    /* special characters at every offset around blocks of 32 bytes, scanned at once */
+    char token[128];
+    char expected[128];
+    for (int length = 0; length < 100; length++) {
+        for (int at = 0; at <= length; at++) {
+            memset(token + 1, 'a', length);
+            token[0] = '"';
+            token[length + 1] = '"';
+            strcpy(token + length + 2, "tail\"");
+
+            optional_t parsed = parse_string_token(token);
+            CU_ASSERT_EQUAL(parsed.stat, length + 2);
+            memset(expected, 'a', length);
+            expected[length] = '\0';
+            CU_ASSERT_STRING_EQUAL(parsed.value, expected);
+            free(parsed.value);
+
+            if (at == length)
+                continue;
+            /* `\\"` at `at` is an escaped backslash followed by closing quotation mark */
+            token[at + 1] = '\\';
+            token[at + 2] = '\\';
+            token[at + 3] = '"';
+            parsed = parse_string_token(token);
+            CU_ASSERT_EQUAL(parsed.stat, at + 4);
+            expected[at] = '\\';
+            expected[at + 1] = '\0';
+            CU_ASSERT_STRING_EQUAL(parsed.value, expected);
+            free(parsed.value);
+
+            token[at + 1] = '\t';
+            parsed = parse_string_token(token);
+            CU_ASSERT_EQUAL(parsed.stat, 0);
+            CU_ASSERT_PTR_NULL(parsed.value);
+        }
+    }
+
+    optional_t parsed = parse_string_token("\"a\\n\\\"b\\u0041\\/\"rest");
+    CU_ASSERT_EQUAL(parsed.stat, 16);
+    CU_ASSERT_STRING_EQUAL(parsed.value, "a\n\"bA/");
+    free(parsed.value);
+    CU_ASSERT_EQUAL(parse_string_token("\"not closed").stat, 0);
+    CU_ASSERT_EQUAL(parse_string_token("\"escaped end\\\"").stat, 0);
+    CU_ASSERT_EQUAL(parse_string_token("no quotation mark").stat, 0);
+}
+
+struct json_sink {
+    char data[16384];
+    size_t length;
+    int flushes;
+    size_t fail_after;
+};
+
+static int flush_json_sink(void *data, const void *bytes, size_t length) {
+    struct json_sink *sink = data;
+    if (sink->length + length > sink->fail_after)
+        return -1;
+    memcpy(sink->data + sink->length, bytes, length);
+    sink->length += length;
+    sink->flushes++;
+    return 0;
+}
+
+void test_json_writer() {
+    struct json_writer writer;
+    init_json_writer(&writer, NULL, NULL);
+    begin_json_object(&writer);
+    write_json_key(&writer, "pid");
+    write_json_integer(&writer, -42);
+    write_json_key(&writer, "out\"put");
+    write_json_string(&writer, "a\x1b[0m\"\\/\n\0z", 11);
+    write_json_key(&writer, "list");
+    begin_json_array(&writer);
+    write_json_number(&writer, 0.1);
+    write_json_number(&writer, 1e300 * 1e300);
+    write_json_boolean(&writer, true);
+    write_json_null(&writer);
+    begin_json_object(&writer);
+    end_json_object(&writer);
+    begin_json_array(&writer);
+    end_json_array(&writer);
+    end_json_array(&writer);
+    end_json_object(&writer);
+    CU_ASSERT_EQUAL(finish_json_writer(&writer), 0);
+    const char *expected = "{\"pid\":-42,\"out\\\"put\":\"a\\u001b[0m\\\"\\\\/\\n\\u0000z\",\"list\":[0.1,null,true,null,{},[]]}";
+    CU_ASSERT_STRING_EQUAL(writer.buffer, expected);
+    CU_ASSERT_EQUAL(writer.length, strlen(expected));
+    destruct_json_writer(&writer);
+
+    /* escapes at every offset around blocks, and output grown over JSON_WRITER_BUFFER_SIZE */
+    char string[8192];
+    memset(string, 'x', sizeof(string));
+    for (size_t i = 0; i < sizeof(string); i += 31)
+        string[i] = i % 2 ? '"' : '\n';
+    init_json_writer(&writer, NULL, NULL);
+    write_json_string(&writer, string, sizeof(string));
+    CU_ASSERT_FATAL(finish_json_writer(&writer) == 0);
+    char *document = malloc(writer.length + 8);
+    sprintf(document, "{\"a\":%s}", writer.buffer);
+    destruct_json_writer(&writer);
+    struct json_object *parsed = parse_json(document);
+    free(document);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parsed);
+    CU_ASSERT_EQUAL(parsed->items[0].size, (int)sizeof(string));
+    CU_ASSERT(memcmp(parsed->items[0].value, string, sizeof(string)) == 0);
+
+    /* a parsed document is written back as it was, except whitespaces */
+    char *serialized = json_object_stringify(parsed);
+    destruct_json_object(parsed);
+    parsed = parse_json(serialized);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parsed);
+    char *reserialized = json_object_stringify(parsed);
+    CU_ASSERT_STRING_EQUAL(serialized, reserialized);
+    free(serialized);
+    free(reserialized);
+    destruct_json_object(parsed);
+
+    /* small writes are gathered, and a long run of string is flushed as it is */
+    struct json_sink *sink = calloc(1, sizeof(struct json_sink));
+    sink->fail_after = sizeof(sink->data);
+    init_json_writer(&writer, flush_json_sink, sink);
+    begin_json_array(&writer);
+    for (int i = 0; i < 10; i++)
+        write_json_integer(&writer, i);
+    memset(string, 'y', sizeof(string));
+    write_json_string(&writer, string, sizeof(string));
+    end_json_array(&writer);
+    CU_ASSERT_EQUAL(sink->flushes, 2);
+    CU_ASSERT_EQUAL(finish_json_writer(&writer), 0);
+    CU_ASSERT_EQUAL(sink->flushes, 3);
+    CU_ASSERT_EQUAL(sink->length, 1 + 20 + 2 + sizeof(string) + 1);
+    CU_ASSERT(memcmp(sink->data, "[0,1,2,3,4,5,6,7,8,9,\"yy", 24) == 0);
+    CU_ASSERT(memcmp(sink->data + sink->length - 4, "yy\"]", 4) == 0);
+    destruct_json_writer(&writer);
+
+    /* a failed flush fails the rest */
+    sink->length = 0;
+    sink->fail_after = 100;
+    init_json_writer(&writer, flush_json_sink, sink);
+    write_json_string(&writer, string, sizeof(string));
+    write_json_null(&writer);
+    CU_ASSERT_EQUAL(finish_json_writer(&writer), -1);
+    destruct_json_writer(&writer);
+    free(sink);
+}
+
+void test_json_index() {
+    /* an object with as many members as the threshold or more is indexed, including nested one and duplicate keys */
+    char *document = malloc(64 * 1024);
+    int length = sprintf(document, "{\"small\":{\"a\":1},\"nested\":{");
+    for (int i = 0; i < JSON_INDEX_THRESHOLD; i++)
+        length += sprintf(document + length, "%s\"n%d\":%d", i ? "," : "", i, i);
+    length += sprintf(document + length, "}");
+    for (int i = 0; i < 300; i++)
+        length += sprintf(document + length, ",\"key%d\":\"%d\"", i, i);
+    strcpy(document + length, ",\"key7\":\"duplicate\"}");
+
+    struct json_object *object = parse_json(document);
+    free(document);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(object);
+    CU_ASSERT_EQUAL(object->size, 303);
+    for (int i = 0; i < 300; i++) {
+        char key[16];
+        char value[16];
+        sprintf(key, "key%d", i);
+        sprintf(value, "%d", i);
+        struct json_element *element = find_json_element(object, key);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(element);
+        CU_ASSERT_STRING_EQUAL(element->value, value);
+        /* members are kept in order of input */
+        CU_ASSERT(element == &object->items[i + 2]);
+    }
+    CU_ASSERT_PTR_NULL(find_json_element(object, "key300"));
+    CU_ASSERT_PTR_NULL(find_json_element(object, "key"));
+    CU_ASSERT_PTR_NULL(find_json_element(object, ""));
+    CU_ASSERT_STRING_EQUAL(object->items[302].value, "duplicate");
+
+    struct json_element *nested = find_json_element(object, "nested");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(nested);
+    CU_ASSERT_STRING_EQUAL(find_json_member(nested, "n0")->value, "0");
+    CU_ASSERT_STRING_EQUAL(find_json_member(nested, "n15")->value, "15");
+    CU_ASSERT_PTR_NULL(find_json_member(nested, "n16"));
+    CU_ASSERT_STRING_EQUAL(find_json_member(find_json_element(object, "small"), "a")->value, "1");
+
+    /* inserting into a parsed object keeps the index */
+    CU_ASSERT(insert_json_element(object, "key5", "x", JSON_STRING) == NULL);
+    CU_ASSERT(insert_json_element(object, "added", "1", JSON_NUMBER) == object);
+    CU_ASSERT_STRING_EQUAL(find_json_element(object, "added")->value, "1");
+    CU_ASSERT_STRING_EQUAL(find_json_element(object, "key299")->value, "299");
+    destruct_json_object(object);
+
+    /* an object built by insertion is indexed when it reaches the threshold, and while it grows */
+    object = create_json_object();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(object);
+    for (int i = 0; i < 200; i++) {
+        char key[16];
+        sprintf(key, "k%d", i);
+        CU_ASSERT(insert_json_element(object, key, key, JSON_STRING) == object);
+        CU_ASSERT(insert_json_element(object, key, key, JSON_STRING) == NULL);
+    }
+    for (int i = 0; i < 200; i++) {
+        char key[16];
+        sprintf(key, "k%d", i);
+        CU_ASSERT(find_json_element(object, key) == &object->items[i]);
+    }
+    CU_ASSERT_PTR_NULL(find_json_element(object, "k200"));
+
+    char *serialized = json_object_stringify(object);
+    CU_ASSERT(strncmp(serialized, "{\"k0\":\"k0\",\"k1\":\"k1\",", 21) == 0);
+    free(serialized);
+    destruct_json_object(object);
+}
+
 int main() {
     if (CUE_SUCCESS != CU_initialize_registry()) {
         return CU_get_error();
@@ -271,10 +1636,30 @@ int main() {
         CU_cleanup_registry();
         return CU_get_error();
     } 
+    if (NULL == CU_add_test(suite, "test of parse_http_request_bytes", test_parse_http_request_bytes)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
     if (NULL == CU_add_test(suite, "test of find_header", test_find_header)) {
         CU_cleanup_registry();
         return CU_get_error();
     }
+    if (NULL == CU_add_test(suite, "test of create_http_header_set", test_http_header_set)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of build_http_response", test_build_http_response)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of create_http_canned_response", test_canned_response)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of insert_route_handler", test_route_handler)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
     if (NULL == CU_add_test(suite, "test of init_routes", test_init_routes_1)) {
         CU_cleanup_registry();
         return CU_get_error();
@@ -291,6 +1676,75 @@ int main() {
         CU_cleanup_registry();
         return CU_get_error();
     }
+    if (NULL == CU_add_test(suite, "test of find_route: radix tree", test_find_route_tree)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of match_route: path parameters", test_match_route_parameters)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of compile_route_table", test_compile_route_table)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of decode_http_chunked", test_decode_http_chunked)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of scan_http_header", test_scan_http_header)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of parse_http_request_line", test_parse_http_request_line)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of is_http_not_modified", test_conditional_request)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of find_http_mime_type", test_http_mime_type)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of parse_http_range", test_http_range)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of accept_websocket", test_websocket_handshake)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of receive_websocket_message", test_websocket_frame)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of write_http_chunk", test_http_stream)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of parse_json", test_json_parse)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of parse_string_token", test_json_string_token)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of json_writer", test_json_writer)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    if (NULL == CU_add_test(suite, "test of find_json_element with hash index", test_json_index)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+    /* date cache is global, so this test is the last */
+    if (NULL == CU_add_test(suite, "test of update_http_date", test_http_date)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
 
     CU_basic_set_mode(CU_BRM_VERBOSE);
     CU_basic_run_tests();